@@ -0,0 +1,320 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "blake2b-multi.h"
+#include <string.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#	define BLAKE2B_MULTI_X86
+#	include <immintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#		define BLAKE2B_MULTI_TARGET_AVX2
+#	else
+#		define BLAKE2B_MULTI_TARGET_AVX2 __attribute__((target("avx2")))
+#	endif
+#endif
+
+namespace
+{
+	constexpr uint64_t s_pIV[8] =
+	{
+		0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+		0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+		0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+		0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+	};
+
+	constexpr uint8_t s_pSigma[12][16] =
+	{
+		{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+		{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+		{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+		{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+		{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+		{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+		{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+		{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+		{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+		{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+		{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+		{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+	};
+
+	// Sigma indices must be compile-time constants, so that the message words stay in registers
+#define BLAKE2B_MULTI_ROUND(r) \
+		G(v[0], v[4], v[ 8], v[12], m[s_pSigma[r][ 0]], m[s_pSigma[r][ 1]]) \
+		G(v[1], v[5], v[ 9], v[13], m[s_pSigma[r][ 2]], m[s_pSigma[r][ 3]]) \
+		G(v[2], v[6], v[10], v[14], m[s_pSigma[r][ 4]], m[s_pSigma[r][ 5]]) \
+		G(v[3], v[7], v[11], v[15], m[s_pSigma[r][ 6]], m[s_pSigma[r][ 7]]) \
+		G(v[0], v[5], v[10], v[15], m[s_pSigma[r][ 8]], m[s_pSigma[r][ 9]]) \
+		G(v[1], v[6], v[11], v[12], m[s_pSigma[r][10]], m[s_pSigma[r][11]]) \
+		G(v[2], v[7], v[ 8], v[13], m[s_pSigma[r][12]], m[s_pSigma[r][13]]) \
+		G(v[3], v[4], v[ 9], v[14], m[s_pSigma[r][14]], m[s_pSigma[r][15]])
+
+#define BLAKE2B_MULTI_ROUNDS \
+		BLAKE2B_MULTI_ROUND(0) BLAKE2B_MULTI_ROUND(1) BLAKE2B_MULTI_ROUND(2) BLAKE2B_MULTI_ROUND(3) \
+		BLAKE2B_MULTI_ROUND(4) BLAKE2B_MULTI_ROUND(5) BLAKE2B_MULTI_ROUND(6) BLAKE2B_MULTI_ROUND(7) \
+		BLAKE2B_MULTI_ROUND(8) BLAKE2B_MULTI_ROUND(9) BLAKE2B_MULTI_ROUND(10) BLAKE2B_MULTI_ROUND(11)
+
+	// Per-batch working set. Lane-major, each lane owns up to 2 message blocks.
+	struct Lanes
+	{
+		uint64_t m_pH[BLAKE2B_MULTI_LANES][8];
+		uint8_t m_pBlock[2][BLAKE2B_MULTI_LANES][128];
+	};
+
+	inline uint64_t Load64(const uint8_t* p)
+	{
+		uint64_t x;
+#if defined(_MSC_VER) || (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__))
+		memcpy(&x, p, sizeof(x));
+#else
+		x = 0;
+		for (int i = 8; i--; )
+			x = (x << 8) | p[i];
+#endif
+		return x;
+	}
+
+	inline uint64_t RotR(uint64_t x, int n)
+	{
+		return (x >> n) | (x << (64 - n));
+	}
+
+	void CompressScalar(uint64_t* pH, const uint8_t* pBlock, uint64_t t, bool bLast)
+	{
+		uint64_t m[16], v[16];
+		for (int i = 0; i < 16; i++)
+			m[i] = Load64(pBlock + i * 8);
+
+		for (int i = 0; i < 8; i++)
+		{
+			v[i] = pH[i];
+			v[i + 8] = s_pIV[i];
+		}
+		v[12] ^= t;
+		if (bLast)
+			v[14] = ~v[14];
+
+#define G(a, b, c, d, x, y) \
+		a += b + x; d = RotR(d ^ a, 32); c += d; b = RotR(b ^ c, 24); \
+		a += b + y; d = RotR(d ^ a, 16); c += d; b = RotR(b ^ c, 63);
+
+		BLAKE2B_MULTI_ROUNDS
+
+#undef G
+
+		for (int i = 0; i < 8; i++)
+			pH[i] ^= v[i] ^ v[i + 8];
+	}
+
+	void CompressLanesScalar(Lanes& x, uint32_t iBlock, uint64_t t, bool bLast)
+	{
+		for (uint32_t i = 0; i < BLAKE2B_MULTI_LANES; i++)
+			CompressScalar(x.m_pH[i], x.m_pBlock[iBlock][i], t, bLast);
+	}
+
+#ifdef BLAKE2B_MULTI_X86
+
+	// 4x4 transpose of 64-bit words: row i of the input is lane i, row j of the output is word j
+	BLAKE2B_MULTI_TARGET_AVX2
+	inline void Transpose(__m256i& a, __m256i& b, __m256i& c, __m256i& d)
+	{
+		__m256i t0 = _mm256_unpacklo_epi64(a, b);
+		__m256i t1 = _mm256_unpackhi_epi64(a, b);
+		__m256i t2 = _mm256_unpacklo_epi64(c, d);
+		__m256i t3 = _mm256_unpackhi_epi64(c, d);
+
+		a = _mm256_permute2x128_si256(t0, t2, 0x20);
+		b = _mm256_permute2x128_si256(t1, t3, 0x20);
+		c = _mm256_permute2x128_si256(t0, t2, 0x31);
+		d = _mm256_permute2x128_si256(t1, t3, 0x31);
+	}
+
+	BLAKE2B_MULTI_TARGET_AVX2
+	void CompressLanesAvx2(Lanes& x, uint32_t iBlock, uint64_t t, bool bLast)
+	{
+		static_assert(BLAKE2B_MULTI_LANES == 4, "one lane per 64-bit slot of a ymm register");
+
+		const __m256i r16 = _mm256_setr_epi8(
+			2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+			2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+		const __m256i r24 = _mm256_setr_epi8(
+			3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+			3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+
+		__m256i m[16], v[16], h[8];
+
+		for (int j = 0; j < 16; j += 4)
+		{
+			for (int i = 0; i < 4; i++)
+				m[j + i] = _mm256_loadu_si256((const __m256i*) (x.m_pBlock[iBlock][i] + j * 8));
+			Transpose(m[j], m[j + 1], m[j + 2], m[j + 3]);
+		}
+
+		for (int j = 0; j < 8; j += 4)
+		{
+			for (int i = 0; i < 4; i++)
+				h[j + i] = _mm256_loadu_si256((const __m256i*) (x.m_pH[i] + j));
+			Transpose(h[j], h[j + 1], h[j + 2], h[j + 3]);
+		}
+
+		for (int i = 0; i < 8; i++)
+		{
+			v[i] = h[i];
+			v[i + 8] = _mm256_set1_epi64x((int64_t) s_pIV[i]);
+		}
+		v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x((int64_t) t));
+		if (bLast)
+			v[14] = _mm256_xor_si256(v[14], _mm256_set1_epi64x(-1));
+
+#define ADD(a, b) _mm256_add_epi64(a, b)
+#define XOR(a, b) _mm256_xor_si256(a, b)
+#define G(a, b, c, d, x, y) \
+		a = ADD(ADD(a, b), x); d = _mm256_shuffle_epi32(XOR(d, a), _MM_SHUFFLE(2, 3, 0, 1)); \
+		c = ADD(c, d); b = _mm256_shuffle_epi8(XOR(b, c), r24); \
+		a = ADD(ADD(a, b), y); d = _mm256_shuffle_epi8(XOR(d, a), r16); \
+		c = ADD(c, d); b = XOR(b, c); b = XOR(_mm256_srli_epi64(b, 63), ADD(b, b));
+
+		BLAKE2B_MULTI_ROUNDS
+
+#undef G
+#undef XOR
+#undef ADD
+
+		for (int i = 0; i < 8; i++)
+			h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+
+		for (int j = 0; j < 8; j += 4)
+		{
+			Transpose(h[j], h[j + 1], h[j + 2], h[j + 3]);
+			for (int i = 0; i < 4; i++)
+				_mm256_storeu_si256((__m256i*) (x.m_pH[i] + j), h[j + i]);
+		}
+	}
+
+	bool IsAvx2Supported()
+	{
+#if defined(_MSC_VER)
+		int pInfo[4];
+		__cpuid(pInfo, 0);
+		if (pInfo[0] < 7)
+			return false;
+
+		__cpuid(pInfo, 1);
+		const int nOsxSaveAvx = (1 << 27) | (1 << 28);
+		if ((pInfo[2] & nOsxSaveAvx) != nOsxSaveAvx)
+			return false;
+		if ((_xgetbv(0) & 6) != 6) // ymm state is preserved by the OS
+			return false;
+
+		__cpuidex(pInfo, 7, 0);
+		return 0 != (pInfo[1] & (1 << 5));
+#else
+		__builtin_cpu_init();
+		return 0 != __builtin_cpu_supports("avx2");
+#endif
+	}
+
+#endif // BLAKE2B_MULTI_X86
+
+	typedef void (*CompressLanesFn)(Lanes&, uint32_t iBlock, uint64_t t, bool bLast);
+
+	bool IsSimdSupported()
+	{
+#ifdef BLAKE2B_MULTI_X86
+		static const bool s_bSupported = IsAvx2Supported();
+		return s_bSupported;
+#else
+		return false;
+#endif
+	}
+
+	std::atomic<bool> g_bSimdEnabled(true);
+
+	CompressLanesFn SelectCompress()
+	{
+#ifdef BLAKE2B_MULTI_X86
+		if (g_bSimdEnabled.load(std::memory_order_relaxed) && IsSimdSupported())
+			return CompressLanesAvx2;
+#endif
+		return CompressLanesScalar;
+	}
+
+} // namespace
+
+extern "C" {
+
+int blake2b_multi_simd_active( void )
+{
+	return (g_bSimdEnabled.load(std::memory_order_relaxed) && IsSimdSupported()) ? 1 : 0;
+}
+
+void blake2b_multi_simd_enable( int bEnable )
+{
+	g_bSimdEnabled.store(0 != bEnable, std::memory_order_relaxed);
+}
+
+void blake2b_multi_index( const blake2b_multi_base *base, const uint32_t *pIdx, size_t n, uint8_t *pOut, size_t outlen )
+{
+	const CompressLanesFn pfnCompress = SelectCompress();
+
+	// The suffix either fits the pending block, or spills into one more block. Same for all the lanes.
+	const size_t nFill = sizeof(base->buf) - base->buflen;
+	const bool bSpill = nFill < sizeof(uint32_t);
+	const size_t nHead = bSpill ? nFill : sizeof(uint32_t);
+
+	Lanes x;
+	memset(x.m_pBlock, 0, sizeof(x.m_pBlock));
+	for (uint32_t i = 0; i < BLAKE2B_MULTI_LANES; i++)
+		memcpy(x.m_pBlock[0][i], base->buf, base->buflen);
+
+	for (size_t i0 = 0; i0 < n; i0 += BLAKE2B_MULTI_LANES)
+	{
+		const size_t nLanes = (n - i0 < BLAKE2B_MULTI_LANES) ? (n - i0) : BLAKE2B_MULTI_LANES;
+
+		for (uint32_t i = 0; i < BLAKE2B_MULTI_LANES; i++)
+		{
+			memcpy(x.m_pH[i], base->h, sizeof(base->h));
+
+			const uint32_t idx = pIdx[i0 + ((i < nLanes) ? i : 0)]; // unused lanes just repeat the 1st one
+			uint8_t pLe[sizeof(uint32_t)];
+			for (uint32_t k = 0; k < sizeof(pLe); k++)
+				pLe[k] = (uint8_t) (idx >> (k * 8));
+
+			memcpy(x.m_pBlock[0][i] + base->buflen, pLe, nHead);
+			if (bSpill)
+				memcpy(x.m_pBlock[1][i], pLe + nHead, sizeof(pLe) - nHead);
+		}
+
+		if (bSpill)
+		{
+			pfnCompress(x, 0, base->counter + sizeof(base->buf), false);
+			pfnCompress(x, 1, base->counter + sizeof(base->buf) + sizeof(uint32_t) - nHead, true);
+		}
+		else
+			pfnCompress(x, 0, base->counter + base->buflen + sizeof(uint32_t), true);
+
+		for (size_t i = 0; i < nLanes; i++)
+		{
+			uint8_t* pDst = pOut + (i0 + i) * outlen;
+			for (size_t k = 0; k < outlen; k++)
+				pDst[k] = (uint8_t) (x.m_pH[i][k / 8] >> ((k % 8) * 8));
+		}
+	}
+}
+
+} // extern "C"
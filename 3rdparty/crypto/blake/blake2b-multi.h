@@ -0,0 +1,46 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+  // Multi-lane blake2b finalization. Hashes many short suffixes appended to the same absorbed prefix,
+  // 4 lanes at once (AVX2 when the CPU supports it, portable code otherwise).
+  enum { BLAKE2B_MULTI_LANES = 4 };
+
+  // Layout-independent snapshot of a blake2b state (both ref and sse states convert to it)
+  typedef struct blake2b_multi_base
+  {
+    uint64_t h[8];
+    uint64_t counter;  // bytes already compressed
+    uint8_t  buf[128]; // pending bytes, not compressed yet
+    size_t   buflen;   // 0..128
+  } blake2b_multi_base;
+
+  // For each i < n: pOut + i*outlen = blake2b(base || le32(pIdx[i])), truncated to outlen (<= 64)
+  void blake2b_multi_index( const blake2b_multi_base *base, const uint32_t *pIdx, size_t n, uint8_t *pOut, size_t outlen );
+
+  // Nonzero if the AVX2 kernel is in use. Disabling is meant for tests and benchmarks.
+  int blake2b_multi_simd_active( void );
+  void blake2b_multi_simd_enable( int bEnable );
+
+#if defined(__cplusplus)
+}
+#endif
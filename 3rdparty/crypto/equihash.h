@@ -33,6 +33,12 @@ void CompressArray(const unsigned char* in, size_t in_len,
                    unsigned char* out, size_t out_len,
                    size_t bit_len, size_t byte_pad=0);
 
+void GenerateHash(const eh_HashState& base_state, eh_index g,
+                  unsigned char* hash, size_t hLen, size_t N);
+// Same as GenerateHash for each of pG[0..n), several indices at once. hash receives n*hLen bytes
+void GenerateHashes(const eh_HashState& base_state, const eh_index* pG, size_t n,
+                    unsigned char* hash, size_t hLen, size_t N);
+
 eh_index ArrayToEhIndex(const unsigned char* array);
 eh_trunc TruncateIndex(const eh_index i, const unsigned int ilen);
 
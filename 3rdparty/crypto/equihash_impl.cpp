@@ -18,6 +18,7 @@
 
 #include "compat/endian.h"
 #include "crypto/equihash.h"
+#include "crypto/blake/blake2b-multi.h"
 //#include "util.h"
 
 #include <algorithm>
@@ -31,6 +32,9 @@ EhSolverCancelledException solver_cancelled;
 
 namespace
 {
+    // indices hashed per GenerateHashes call while generating the initial list
+    constexpr eh_index HashBatch = 16 * BLAKE2B_MULTI_LANES;
+
     constexpr void ZeroizeUnusedBits(size_t N, unsigned char* hash, size_t hLen)
     {
         uint8_t rem = N % 8;
@@ -85,6 +89,25 @@ void GenerateHash(const eh_HashState& base_state, eh_index g,
     ZeroizeUnusedBits(N, hash, hLen);
 }
 
+void GenerateHashes(const eh_HashState& base_state, const eh_index* pG, size_t n,
+                    unsigned char* hash, size_t hLen, size_t N)
+{
+    blake2b_multi_base base;
+    memcpy(base.h, base_state.h, sizeof(base.h));
+#if defined(__ANDROID__) || !defined(BEAM_USE_AVX)
+    base.counter = base_state.t[0];
+#else
+    base.counter = base_state.counter;
+#endif
+    base.buflen = base_state.buflen;
+    memcpy(base.buf, base_state.buf, base.buflen);
+
+    blake2b_multi_index(&base, pG, n, hash, hLen);
+
+    for (size_t i = 0; i < n; i++)
+        ZeroizeUnusedBits(N, hash + i * hLen, hLen);
+}
+
 void ExpandArray(const unsigned char* in, size_t in_len,
                  unsigned char* out, size_t out_len,
                  size_t bit_len, size_t byte_pad)
@@ -374,12 +397,19 @@ bool Equihash<N,K>::BasicSolve(const eh_HashState& base_state,
     size_t lenIndices = sizeof(eh_index);
     std::vector<FullStepRow<FullWidth>> X;
     X.reserve(init_size);
-    unsigned char tmpHash[HashOutput];
-    for (eh_index g = 0; X.size() < init_size; g++) {
-        GenerateHash(base_state, g, tmpHash, HashOutput, N);
-        for (eh_index i = 0; i < IndicesPerHashOutput && X.size() < init_size; i++) {
-            X.emplace_back(tmpHash+(i*GetSizeInBytes(N)), GetSizeInBytes(N), HashLength,
-                           CollisionBitLength, static_cast<int>(g*IndicesPerHashOutput)+i);
+    eh_index pG[HashBatch];
+    unsigned char tmpHash[HashBatch * HashOutput];
+    for (eh_index g0 = 0; X.size() < init_size; g0 += HashBatch) {
+        for (eh_index j = 0; j < HashBatch; j++)
+            pG[j] = g0 + j;
+        GenerateHashes(base_state, pG, HashBatch, tmpHash, HashOutput, N);
+        for (eh_index j = 0; j < HashBatch && X.size() < init_size; j++) {
+            const eh_index g = g0 + j;
+            const unsigned char* pHash = tmpHash + j * HashOutput;
+            for (eh_index i = 0; i < IndicesPerHashOutput && X.size() < init_size; i++) {
+                X.emplace_back(pHash+(i*GetSizeInBytes(N)), GetSizeInBytes(N), HashLength,
+                               CollisionBitLength, static_cast<int>(g*IndicesPerHashOutput)+i);
+            }
         }
         if (cancelled(ListGeneration)) throw solver_cancelled;
     }
@@ -554,12 +584,19 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
         size_t lenIndices = sizeof(eh_trunc);
         std::vector<TruncatedStepRow<TruncatedWidth>> Xt;
         Xt.reserve(init_size);
-        unsigned char tmpHash[HashOutput];
-        for (eh_index g = 0; Xt.size() < init_size; g++) {
-            GenerateHash(base_state, g, tmpHash, HashOutput, N);
-            for (eh_index i = 0; i < IndicesPerHashOutput && Xt.size() < init_size; i++) {
-                Xt.emplace_back(tmpHash+(i*GetSizeInBytes(N)), GetSizeInBytes(N), HashLength, CollisionBitLength,
-                    static_cast<eh_index>(g*IndicesPerHashOutput)+i, static_cast<unsigned int>(CollisionBitLength + 1));
+        eh_index pG[HashBatch];
+        unsigned char tmpHash[HashBatch * HashOutput];
+        for (eh_index g0 = 0; Xt.size() < init_size; g0 += HashBatch) {
+            for (eh_index j = 0; j < HashBatch; j++)
+                pG[j] = g0 + j;
+            GenerateHashes(base_state, pG, HashBatch, tmpHash, HashOutput, N);
+            for (eh_index j = 0; j < HashBatch && Xt.size() < init_size; j++) {
+                const eh_index g = g0 + j;
+                const unsigned char* pHash = tmpHash + j * HashOutput;
+                for (eh_index i = 0; i < IndicesPerHashOutput && Xt.size() < init_size; i++) {
+                    Xt.emplace_back(pHash+(i*GetSizeInBytes(N)), GetSizeInBytes(N), HashLength, CollisionBitLength,
+                        static_cast<eh_index>(g*IndicesPerHashOutput)+i, static_cast<unsigned int>(CollisionBitLength + 1));
+                }
             }
             if (cancelled(ListGeneration)) throw solver_cancelled;
         }
@@ -765,12 +802,19 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
         return false;
     }
 
+    std::vector<eh_index> vIndices = GetIndicesFromMinimal(soln, CollisionBitLength);
+    std::vector<eh_index> vG(vIndices.size());
+    for (size_t j = 0; j < vIndices.size(); j++)
+        vG[j] = vIndices[j] / IndicesPerHashOutput;
+
+    std::vector<unsigned char> vHash(vG.size() * HashOutput);
+    GenerateHashes(base_state, vG.data(), vG.size(), vHash.data(), HashOutput, N);
+
     std::vector<FullStepRow<FinalFullWidth>> X;
     X.reserve(1 << K);
-    unsigned char tmpHash[HashOutput];
-    for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
-        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput, N);
-        X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * GetSizeInBytes(N)),
+    for (size_t j = 0; j < vIndices.size(); j++) {
+        eh_index i = vIndices[j];
+        X.emplace_back(&vHash[j * HashOutput] + ((i % IndicesPerHashOutput) * GetSizeInBytes(N)),
                        GetSizeInBytes(N), HashLength, CollisionBitLength, i);
     }
 
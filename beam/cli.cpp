@@ -128,6 +128,8 @@ int main_impl(int argc, char* argv[])
 
 		const auto path = boost::filesystem::system_complete("./logs");
 		auto logger = beam::Logger::create(logLevel, logLevel, fileLogLevel, "node_", path.string());
+		if (vm.count(cli::LOG_ASYNC) && vm[cli::LOG_ASYNC].as<bool>())
+			logger->enable_async();
 
 		try
 		{
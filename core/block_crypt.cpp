@@ -287,6 +287,81 @@ namespace beam
 		}
 	}
 
+	void Output::CreateMany(Output* const* ppOut, ECC::Scalar::Native* pSk, const Key::IDV* pKidv, size_t nCount, Key::IKdf& coinKdf, Key::IPKdf& tagKdf, uint32_t nThreads /* = 0 */)
+	{
+		struct Context
+			:public ThreadPool::Context
+		{
+			Output* const* m_ppOut;
+			ECC::Scalar::Native* m_pSk;
+			const Key::IDV* m_pKidv;
+			Key::IKdf& m_CoinKdf;
+			Key::IPKdf& m_TagKdf;
+
+			Context(Key::IKdf& coinKdf, Key::IPKdf& tagKdf) :m_CoinKdf(coinKdf), m_TagKdf(tagKdf) {}
+
+			virtual void Do(size_t i) override
+			{
+				m_ppOut[i]->Create(m_pSk[i], m_CoinKdf, m_pKidv[i], m_TagKdf);
+			}
+
+		} ctx(coinKdf, tagKdf);
+
+		ctx.m_ppOut = ppOut;
+		ctx.m_pSk = pSk;
+		ctx.m_pKidv = pKidv;
+
+		ctx.DoAll(nCount, nThreads);
+	}
+
+	/////////////
+	// ThreadPool
+	void ThreadPool::Context::DoRange(size_t i0, size_t i1)
+	{
+		for (; i0 < i1; i0++)
+			Do(i0);
+	}
+
+	void ThreadPool::Context::DoAll(size_t nTasks, uint32_t nThreads /* = 0 */)
+	{
+		ThreadPool tp(*this, nTasks, nThreads);
+	}
+
+	ThreadPool::ThreadPool(Context& ctx, size_t nTasks, uint32_t nThreads /* = 0 */)
+	{
+		size_t numCores = nThreads ? nThreads : std::thread::hardware_concurrency();
+		if (!numCores)
+			numCores = 1; //?
+		if (numCores > nTasks)
+			numCores = nTasks;
+
+		if (!numCores)
+			return;
+
+		// the last range is handled by the caller thread
+		m_vThreads.resize(numCores - 1);
+		size_t iTask0 = 0;
+
+		for (size_t i = 0; i < m_vThreads.size(); i++)
+		{
+			size_t iTask1 = nTasks * (i + 1) / numCores;
+			assert(iTask1 > iTask0); // otherwise it means that redundant threads were created
+
+			m_vThreads[i] = std::thread(&Context::DoRange, &ctx, iTask0, iTask1);
+
+			iTask0 = iTask1;
+		}
+
+		ctx.DoRange(iTask0, nTasks);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		for (size_t i = 0; i < m_vThreads.size(); i++)
+			if (m_vThreads[i].joinable())
+				m_vThreads[i].join();
+	}
+
 	void Output::get_SeedKid(ECC::uintBig& seed, Key::IPKdf& tagKdf) const
 	{
 		ECC::Hash::Processor() << m_Commitment >> seed;
@@ -16,6 +16,7 @@
 #include "ecc_native.h"
 #include "merkle.h"
 #include "difficulty.h"
+#include <thread>
 
 namespace beam
 {
@@ -138,6 +139,24 @@ namespace beam
 		void Recover(ECC::Point::Native& comm, Key::IPKdf&, const Key::IDV&) const;
 	};
 
+	// Runs the tasks in parallel, each thread handles a contiguous range. The caller thread works too, and blocks until all the tasks are done.
+	class ThreadPool
+	{
+		std::vector<std::thread> m_vThreads;
+	public:
+
+		struct Context
+		{
+			virtual void Do(size_t iTask) = 0;
+
+			void DoRange(size_t i0, size_t i1);
+			void DoAll(size_t nTasks, uint32_t nThreads = 0); // 0 = all the cores
+		};
+
+		ThreadPool(Context&, size_t nTasks, uint32_t nThreads = 0);
+		~ThreadPool();
+	};
+
 	struct TxElement
 	{
 		ECC::Point m_Commitment;
@@ -217,6 +236,10 @@ namespace beam
 
 		void Create(ECC::Scalar::Native&, Key::IKdf& coinKdf, const Key::IDV&, Key::IPKdf& tagKdf, bool bPublic = false);
 
+		// Creates (confidential) outputs concurrently. The other output params (incubation and etc.) should be set in advance.
+		// Each output depends on its own params only, so that the result doesn't depend on the number of threads. 0 = auto
+		static void CreateMany(Output* const* ppOut, ECC::Scalar::Native* pSk, const Key::IDV* pKidv, size_t nCount, Key::IKdf& coinKdf, Key::IPKdf& tagKdf, uint32_t nThreads = 0);
+
 		bool Recover(Key::IPKdf& tagKdf, Key::IDV&) const;
 		bool VerifyRecovered(Key::IPKdf& coinKdf, const Key::IDV&) const;
 
@@ -318,7 +341,7 @@ namespace beam
 			virtual void Write(const TxKernel&) = 0;
 
 			void Dump(IReader&&);
-			bool Combine(IReader** ppR, int nR, const volatile bool& bStop); // combine consequent blocks, merge-sort and delete consumed outputs
+			bool Combine(IReader** ppR, int nR, const volatile bool& bStop); // combine consequent blocks, merge-sort (k-way, via heap) and delete consumed outputs
 			// returns false if aborted
 			bool Combine(IReader&& r0, IReader&& r1, const volatile bool& bStop);
 		};
@@ -559,6 +582,7 @@ namespace beam
 				virtual void put_Start(const BodyBase&, const SystemState::Sequence::Prefix&) = 0;
 				virtual void put_NextHdr(const SystemState::Sequence::Element&) = 0;
 
+				bool CombineHdr(IMacroReader** ppR, int nR, const volatile bool& bStop); // consequent ranges, in order
 				bool CombineHdr(IMacroReader&& r0, IMacroReader&& r1, const volatile bool& bStop);
 			};
 
@@ -625,6 +649,11 @@ namespace beam
 		bool ShouldAbort() const;
 
 		bool HandleElementHeight(const HeightRange&);
+		bool HandleInput(const Input* pPrev, IReader&, ECC::Point::Native&);
+		bool HandleOutput(const Output* pPrev, const Output&, ECC::Point::Native&);
+		bool HandleKernel(const TxKernel* pPrev, const TxKernel&);
+		bool SeekSlice(Block::BodyBase::RW&, int iData, uint64_t& iEnd, uint64_t& nCount) const;
+		bool ValidateAndSummarizeSliceInternal(const TxBase&, Block::BodyBase::RW&);
 
 	public:
 		// Tests the validity of all the components, overall arithmetics, and the lexicographical order of the components.
@@ -668,6 +697,11 @@ namespace beam
 		bool ValidateAndSummarize(const TxBase&, IReader&&);
 		bool Merge(const Context&);
 
+		// Range-partitioned alternative for the indexed macroblock data. Each verifier handles a contiguous slice of inputs and outputs,
+		// elements out of its slice are not read. The index isn't trusted: each slice verifies the index entries it passes, and fails on mismatch.
+		// Kernels are read sequentially by each verifier (the 'kx' data isn't indexed), and verified interleaved. Fails if the data isn't indexed.
+		bool ValidateAndSummarizeSlice(const TxBase&, Block::BodyBase::RW&);
+
 		// hi-level functions, should be used after all parts were validated and merged
 		bool IsValidTransaction();
 		bool IsValidBlock(const Block::BodyBase&);
@@ -699,9 +733,75 @@ namespace beam
 
 		static const char* const s_pszSufix[Type::count];
 
+		// Inputs and outputs are indexed by their (maturity, commitment) every s_IndexStep elements. The index is written to a separate local file upon Close(),
+		// it's not a part of the data (which is served to others as-is). For the data obtained without the index (downloaded) it's created by CreateIndex().
+		// Data without the index (legacy, or unsorted) is still readable, seek falls back to the sequential scan.
+		static const uint32_t s_IndexStep = 64;
+
+		struct IndexEntry
+		{
+			uintBigFor<Height>::Type m_Maturity;
+			ECC::Point m_Commitment;
+			uintBigFor<uint64_t>::Type m_Pos; // element offset, past its maturity delta
+		};
+
+		struct IndexTrailer
+		{
+			uintBigFor<uint64_t>::Type m_Entries;
+			uintBigFor<uint64_t>::Type m_SizeData; // size of the indexed data file. The index of a different (stale) data is ignored
+			uint8_t m_pMagic[8]; // the last byte is the format version
+		};
+
 	private:
 
-		std::FStream m_pS[Type::count];
+		// read-only view of a memory-mapped file
+		struct MappedStream
+		{
+			std::shared_ptr<void> m_pGuard;
+			std::shared_ptr<void> m_pGuardIdx;
+			const uint8_t* m_pBuf;
+			uint64_t m_Size;
+			uint64_t m_Pos;
+			uint64_t m_PosElem; // the most recently loaded element
+			uint64_t m_nElem; // number of the elements up to (and including) the most recently loaded one
+			const IndexEntry* m_pIdx;
+			uint64_t m_IdxEntries;
+			bool m_bIndexed;
+
+			MappedStream() { Close(); }
+
+			bool IsOpen() const { return m_pGuard != nullptr; }
+			void Close();
+			uint64_t get_Remaining() const { return m_Size - m_Pos; }
+
+			void Restart() { m_Pos = 0; m_nElem = 0; }
+			void Seek(uint64_t);
+			uint64_t Tell() const { return m_Pos; }
+
+			size_t read(void* pPtr, size_t nSize);
+			size_t write(const void* pPtr, size_t nSize);
+
+			char getch();
+			char peekch() const;
+			void ungetch(char);
+		};
+
+		std::FStream m_pS[Type::count]; // write mode
+		MappedStream m_pM[Type::count]; // read mode
+
+		struct IndexBuilder
+		{
+			std::vector<IndexEntry> m_v;
+			uint64_t m_Count;
+			Height m_hLast;
+			ECC::Point m_Last;
+			bool m_bValid; // only sorted data is indexed
+
+			void Reset();
+			void Add(const TxElement&, uint64_t nPos);
+		} m_pIdxW[2]; // write mode, ui and uo
+
+		static bool IsIndexedType(int iData) { return (Type::ui == iData) || (Type::uo == iData); }
 
 		Input::Ptr m_pGuardUtxoIn[2];
 		Output::Ptr m_pGuardUtxoOut[2];
@@ -720,6 +820,13 @@ namespace beam
 		template <typename T>
 		void WriteInternal(const T&, int);
 		void WriteMaturity(const TxElement&, int);
+		void WriteIndexed(const TxElement&, int);
+		std::FStream& get_WStream(int);
+		void WriteIndex(int);
+		void SaveIndex(int, const IndexBuilder&, uint64_t nSizeData) const;
+		void OpenIndex(int);
+		void LoadUtxo(int);
+		void VerifyIndex(int);
 
 		bool OpenInternal(int iData);
 		void PostOpen(int iData);
@@ -727,7 +834,7 @@ namespace beam
 
 	public:
 
-		RW() :m_bAutoDelete(false) {}
+		RW() :m_bRead(true) ,m_bAutoDelete(false) {}
 		~RW();
 
 		// do not modify between Open() and Close()
@@ -737,6 +844,7 @@ namespace beam
 		Merkle::Hash m_hvContentTag; // needed to make sure all the files indeed belong to the same data set
 
 		void GetPath(std::string&, int iData) const;
+		bool GetIndexPath(std::string&, int iData) const; // false if the data isn't indexed
 
 		void ROpen();
 		void WCreate();
@@ -746,6 +854,14 @@ namespace beam
 		void Delete(); // must be closed
 
 		void NextKernelFF(Height hMin);
+		void NextUtxoOutFF(Height hMaturity, const ECC::Point&); // skip to the 1st output not less than the given (maturity, commitment)
+
+		// Index access (read mode), for range-partitioned processing. Applicable to ui/uo.
+		bool IsIndexed() const; // both ui and uo are either indexed or absent
+		void CreateIndex(); // for the data opened without the index. The element is not loaded, call Reset() afterwards
+		uint64_t get_IndexEntries(int iData) const;
+		void SeekIndex(int iData, uint64_t iEntry); // the element is loaded. The entry itself is verified only when the data is scanned through it
+		bool IsAtIndex(int iData, uint64_t iEntry) const; // the loaded element is indeed the one pointed by the index
 
 		// IReader
 		virtual void Clone(Ptr&) override;
@@ -796,7 +912,7 @@ namespace beam
 		void Create(ISource&, const SystemState::Full& sRoot);
 		bool IsValid(SystemState::Full* pTip = NULL) const;
 		bool Crop(); // according to current bound
-		bool Crop(const ChainWorkProof& src);
+		bool Crop(const ChainWorkProof& src, bool bVerifyPoW = true); // skip PoW verification only if the source is trusted (i.e. self-made)
 		bool IsEmpty() const { return m_Heading.m_vElements.empty(); }
 
 		template <typename Archive>
@@ -813,7 +929,7 @@ namespace beam
 
 	private:
 		struct Sampler;
-		bool IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, SystemState::Full* pTip) const;
+		bool IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, SystemState::Full* pTip, bool bVerifyPoW) const;
 		void ZeroInit();
 	};
 
@@ -19,6 +19,7 @@
 #include "core/serialization_adapters.h"
 #include "aes.h"
 #include "pkcs5_pbkdf2.h"
+#include "utility/io/buffer.h"
 
 namespace beam
 {
@@ -30,12 +31,80 @@ namespace beam
 #undef THE_MACRO
 	};
 
+	static_assert(sizeof(Block::BodyBase::RW::IndexEntry) == 49, "IndexEntry must be packed");
+
+	const uint8_t g_pMbIndexMagic[8] = { 'b', 'e', 'a', 'm', 'm', 'b', 'i', 2 };
+
+	void Block::BodyBase::RW::MappedStream::Close()
+	{
+		m_pGuard.reset();
+		m_pGuardIdx.reset();
+		m_pBuf = NULL;
+		m_Size = 0;
+		m_Pos = 0;
+		m_PosElem = 0;
+		m_nElem = 0;
+		m_pIdx = NULL;
+		m_IdxEntries = 0;
+		m_bIndexed = false;
+	}
+
+	void Block::BodyBase::RW::MappedStream::Seek(uint64_t n)
+	{
+		m_Pos = std::min(n, m_Size);
+	}
+
+	size_t Block::BodyBase::RW::MappedStream::read(void* pPtr, size_t nSize)
+	{
+		if (nSize > get_Remaining())
+			throw std::runtime_error("underflow");
+
+		memcpy(pPtr, m_pBuf + m_Pos, nSize);
+		m_Pos += nSize;
+		return nSize;
+	}
+
+	size_t Block::BodyBase::RW::MappedStream::write(const void*, size_t)
+	{
+		throw std::runtime_error("not impl");
+	}
+
+	char Block::BodyBase::RW::MappedStream::getch()
+	{
+		char ch;
+		read(&ch, 1);
+		return ch;
+	}
+
+	char Block::BodyBase::RW::MappedStream::peekch() const
+	{
+		if (!get_Remaining())
+			throw std::runtime_error("underflow");
+		return m_pBuf[m_Pos];
+	}
+
+	void Block::BodyBase::RW::MappedStream::ungetch(char)
+	{
+		assert(m_Pos);
+		m_Pos--;
+	}
+
 	void Block::BodyBase::RW::GetPath(std::string& s, int iData) const
 	{
 		assert(iData < Type::count);
 		s = m_sPath + s_pszSufix[iData];
 	}
 
+	bool Block::BodyBase::RW::GetIndexPath(std::string& s, int iData) const
+	{
+		if (!IsIndexedType(iData))
+			return false;
+
+		GetPath(s, iData);
+		s += "_idx";
+		return true;
+	}
+
 	void Block::BodyBase::RW::ROpen()
 	{
 		Open(true);
@@ -53,6 +122,9 @@ namespace beam
 		m_bRead = bRead;
 		ZeroObject(m_pMaturity);
 
+		for (size_t i = 0; i < _countof(m_pIdxW); i++)
+			m_pIdxW[i].Reset();
+
 		if (bRead)
 		{
 			static_assert(Type::hd == 0, ""); // must be the 1st to open
@@ -68,18 +140,82 @@ namespace beam
 	{
 		std::string s;
 		GetPath(s, iData);
-		if (!m_pS[iData].Open(s.c_str(), m_bRead))
-			return false;
+
+		if (m_bRead)
+		{
+			{
+				std::FStream fs; // make sure the file exists, the mapping may create it otherwise
+				if (!fs.Open(s.c_str(), true))
+					return false;
+			}
+
+			io::SharedBuffer buf = io::map_file_read_only(s.c_str());
+
+			MappedStream& ms = m_pM[iData];
+			ms.Close();
+			ms.m_pGuard = std::move(buf.guard);
+			ms.m_pBuf = buf.data;
+			ms.m_Size = buf.size;
+
+			OpenIndex(iData);
+		}
+		else
+		{
+			if (!m_pS[iData].Open(s.c_str(), false))
+				return false;
+		}
 
 		PostOpen(iData);
 		return true;
 	}
 
+	void Block::BodyBase::RW::OpenIndex(int iData)
+	{
+		std::string s;
+		if (!GetIndexPath(s, iData))
+			return;
+
+		{
+			std::FStream fs;
+			if (!fs.Open(s.c_str(), true))
+				return; // not indexed
+		}
+
+		io::SharedBuffer buf = io::map_file_read_only(s.c_str());
+
+		const uint64_t nTrailer = sizeof(IndexTrailer);
+		if (buf.size < nTrailer)
+			return;
+
+		const IndexTrailer& t = *reinterpret_cast<const IndexTrailer*>(buf.data + buf.size - nTrailer);
+		if (memcmp(t.m_pMagic, g_pMbIndexMagic, sizeof(g_pMbIndexMagic)))
+			return; // different version
+
+		MappedStream& ms = m_pM[iData];
+
+		uint64_t nSizeData;
+		t.m_SizeData.Export(nSizeData);
+		if (nSizeData != ms.m_Size)
+			return; // stale
+
+		uint64_t nEntries;
+		t.m_Entries.Export(nEntries);
+
+		uint64_t nIdx = nEntries * sizeof(IndexEntry);
+		if ((nIdx / sizeof(IndexEntry) != nEntries) || (buf.size - nTrailer != nIdx))
+			throw std::runtime_error("MB index corrupted");
+
+		ms.m_pGuardIdx = std::move(buf.guard);
+		ms.m_pIdx = reinterpret_cast<const IndexEntry*>(buf.data);
+		ms.m_IdxEntries = nEntries;
+		ms.m_bIndexed = true;
+	}
+
 	void Block::BodyBase::RW::PostOpen(int iData)
 	{
 		if (m_bRead)
 		{
-			yas::binary_iarchive<std::FStream, SERIALIZE_OPTIONS> arc(m_pS[iData]);
+			yas::binary_iarchive<MappedStream, SERIALIZE_OPTIONS> arc(m_pM[iData]);
 			ECC::Hash::Value hv;
 			arc & hv;
 
@@ -114,35 +250,138 @@ namespace beam
 			std::string s;
 			GetPath(s, i);
 			DeleteFile(s.c_str());
+
+			if (GetIndexPath(s, i))
+				DeleteFile(s.c_str());
 		}
 	}
 
 	void Block::BodyBase::RW::Close()
 	{
+		if (!m_bRead)
+		{
+			WriteIndex(Type::ui);
+			WriteIndex(Type::uo);
+		}
+
 		for (int i = 0; i < Type::count; i++)
+		{
 			m_pS[i].Close();
+			m_pM[i].Close();
+		}
 	}
 
 	Block::BodyBase::RW::~RW()
 	{
-		if (m_bAutoDelete)
-		{
+		try {
 			Close();
+		} catch (const std::exception&) {
+			// the data is incomplete anyway
+		}
+
+		if (m_bAutoDelete)
 			Delete();
+	}
+
+	void Block::BodyBase::RW::WriteIndex(int iData)
+	{
+		std::FStream& s = m_pS[iData];
+		if (s.IsOpen())
+		{
+			s.Flush();
+			SaveIndex(iData, m_pIdxW[iData - Type::ui], s.Tell());
+		}
+	}
+
+	void Block::BodyBase::RW::SaveIndex(int iData, const IndexBuilder& x, uint64_t nSizeData) const
+	{
+		if (!x.m_bValid)
+			return; // unsorted, not indexed
+
+		std::string sPath;
+		verify(GetIndexPath(sPath, iData));
+
+		std::FStream fs;
+		fs.Open(sPath.c_str(), false, true);
+
+		if (!x.m_v.empty())
+			fs.write(&x.m_v.front(), sizeof(IndexEntry) * x.m_v.size());
+
+		IndexTrailer t;
+		t.m_Entries = x.m_v.size();
+		t.m_SizeData = nSizeData;
+		static_assert(sizeof(t.m_pMagic) == sizeof(g_pMbIndexMagic), "");
+		memcpy(t.m_pMagic, g_pMbIndexMagic, sizeof(g_pMbIndexMagic));
+
+		fs.write(&t, sizeof(t));
+	}
+
+	void Block::BodyBase::RW::CreateIndex()
+	{
+		assert(m_bRead);
+		if (IsIndexed())
+			return;
+
+		Reset();
+
+		IndexBuilder pX[2];
+		for (size_t i = 0; i < _countof(pX); i++)
+			pX[i].Reset();
+
+		for (; m_pUtxoIn; NextUtxoIn())
+			pX[0].Add(*m_pUtxoIn, m_pM[Type::ui].m_PosElem);
+
+		for (; m_pUtxoOut; NextUtxoOut())
+			pX[1].Add(*m_pUtxoOut, m_pM[Type::uo].m_PosElem);
+
+		for (int iData = Type::ui; iData <= Type::uo; iData++)
+		{
+			MappedStream& s = m_pM[iData];
+			if (s.IsOpen() && !s.m_bIndexed)
+			{
+				SaveIndex(iData, pX[iData - Type::ui], s.m_Size);
+				OpenIndex(iData);
+			}
+		}
+	}
+
+	void Block::BodyBase::RW::IndexBuilder::Reset()
+	{
+		m_v.clear();
+		m_Count = 0;
+		m_hLast = 0;
+		m_bValid = true;
+	}
+
+	void Block::BodyBase::RW::IndexBuilder::Add(const TxElement& v, uint64_t nPos)
+	{
+		if (m_Count && ((v.m_Maturity < m_hLast) || ((v.m_Maturity == m_hLast) && (v.m_Commitment.cmp(m_Last) < 0))))
+			m_bValid = false;
+
+		m_hLast = v.m_Maturity;
+		m_Last = v.m_Commitment;
+
+		if (!(m_Count++ % s_IndexStep))
+		{
+			m_v.emplace_back();
+			IndexEntry& e = m_v.back();
+			e.m_Maturity = v.m_Maturity;
+			e.m_Commitment = v.m_Commitment;
+			e.m_Pos = nPos;
 		}
 	}
 
 	void Block::BodyBase::RW::Reset()
 	{
 		for (int i = 0; i < Type::count; i++)
-			if (m_pS[i].IsOpen())
+			if (m_pM[i].IsOpen())
 			{
-				m_pS[i].Restart();
+				m_pM[i].Restart();
 				PostOpen(i);
 			}
 
 		ZeroObject(m_pMaturity);
-		m_KrnSizeTotal() = m_pS[Type::ko].Tell() + m_pS[Type::ko].get_Remaining();
+		m_KrnSizeTotal() = m_pM[Type::ko].Tell() + m_pM[Type::ko].get_Remaining();
 
 		LoadMaturity(Type::ko); // maturity of the 1st kernel
 		NextKernelThreshold();
@@ -172,18 +411,18 @@ namespace beam
 	void Block::BodyBase::RW::NextUtxoIn()
 	{
 		LoadMaturity(Type::ui);
-		LoadInternal(m_pUtxoIn, Type::ui, m_pGuardUtxoIn);
+		LoadUtxo(Type::ui);
 	}
 
 	void Block::BodyBase::RW::NextUtxoOut()
 	{
 		LoadMaturity(Type::uo);
-		LoadInternal(m_pUtxoOut, Type::uo, m_pGuardUtxoOut);
+		LoadUtxo(Type::uo);
 	}
 
 	void Block::BodyBase::RW::NextKernel()
 	{
-		uint64_t nPos = m_KrnSizeTotal() - m_pS[Type::ko].get_Remaining();
+		uint64_t nPos = m_KrnSizeTotal() - m_pM[Type::ko].get_Remaining();
 
 		while (nPos == m_KrnThresholdPos())
 		{
@@ -209,26 +448,173 @@ namespace beam
 			{
 				uint64_t offs = (dh - 2) * sizeof(m_KrnThresholdPos());
 
-				std::FStream& s = m_pS[Type::kx];
+				MappedStream& s = m_pM[Type::kx];
 				s.Seek(s.Tell() + std::min(s.get_Remaining(), offs));
 			}
 			NextKernelThreshold();
 		}
 
-		std::FStream& s2 = m_pS[Type::ko];
+		MappedStream& s2 = m_pM[Type::ko];
 		s2.Seek(std::min(m_KrnThresholdPos(), m_KrnSizeTotal()));
 
 		m_pMaturity[Type::ko] = hMin;
 		NextKernelThreshold();
 
-		LoadInternal(m_pKernel, Type::ko, m_pGuardKernel);
+		RW::NextKernel(); // in case there are no kernels at hMin
+	}
+
+	void Block::BodyBase::RW::NextUtxoOutFF(Height hMaturity, const ECC::Point& comm)
+	{
+		struct Key
+		{
+			Height m_Maturity;
+			const ECC::Point* m_pComm;
+
+			bool IsLess(Height h, const ECC::Point& c) const
+			{
+				return (h < m_Maturity) || ((h == m_Maturity) && (c.cmp(*m_pComm) < 0));
+			}
+		};
+
+		Key k;
+		k.m_Maturity = hMaturity;
+		k.m_pComm = &comm;
+
+		if (!m_pUtxoOut || !k.IsLess(m_pUtxoOut->m_Maturity, m_pUtxoOut->m_Commitment))
+			return;
+
+		MappedStream& s = m_pM[Type::uo];
+		if (s.m_IdxEntries)
+		{
+			// the last indexed element less than the key
+			uint64_t n0 = 0, n1 = s.m_IdxEntries;
+			while (n0 < n1)
+			{
+				uint64_t nMid = (n0 + n1) >> 1;
+				const IndexEntry& e = s.m_pIdx[nMid];
+
+				Height h;
+				e.m_Maturity.Export(h);
+
+				if (k.IsLess(h, e.m_Commitment))
+					n0 = nMid + 1;
+				else
+					n1 = nMid;
+			}
+
+			if (n0)
+			{
+				const IndexEntry& e = s.m_pIdx[n0 - 1];
+
+				uint64_t nPos;
+				e.m_Pos.Export(nPos);
+
+				if (nPos >= s.Tell())
+					SeekIndex(Type::uo, n0 - 1);
+			}
+		}
+
+		while (m_pUtxoOut && k.IsLess(m_pUtxoOut->m_Maturity, m_pUtxoOut->m_Commitment))
+			NextUtxoOut();
+	}
+
+	bool Block::BodyBase::RW::IsIndexed() const
+	{
+		for (int i = Type::ui; i <= Type::uo; i++)
+		{
+			const MappedStream& s = m_pM[i];
+			if (s.IsOpen() && !s.m_bIndexed)
+				return false;
+		}
+		return true;
+	}
+
+	uint64_t Block::BodyBase::RW::get_IndexEntries(int iData) const
+	{
+		assert(IsIndexedType(iData));
+		return m_pM[iData].m_IdxEntries;
+	}
+
+	void Block::BodyBase::RW::SeekIndex(int iData, uint64_t iEntry)
+	{
+		assert(IsIndexedType(iData));
+		MappedStream& s = m_pM[iData];
+		assert(iEntry < s.m_IdxEntries);
+
+		const IndexEntry& e = s.m_pIdx[iEntry];
+
+		uint64_t nPos;
+		e.m_Pos.Export(nPos);
+		if (nPos > s.m_Size)
+			throw std::runtime_error("MB index corrupted");
+
+		s.Seek(nPos);
+		s.m_nElem = iEntry * s_IndexStep;
+		e.m_Maturity.Export(m_pMaturity[iData]);
+		LoadUtxo(iData);
+	}
+
+	bool Block::BodyBase::RW::IsAtIndex(int iData, uint64_t iEntry) const
+	{
+		assert(IsIndexedType(iData));
+		const MappedStream& s = m_pM[iData];
+		if (iEntry >= s.m_IdxEntries)
+			return false;
+
+		const TxElement* pElem = (Type::ui == iData) ? static_cast<const TxElement*>(m_pUtxoIn) : static_cast<const TxElement*>(m_pUtxoOut);
+		if (!pElem)
+			return false;
+
+		const IndexEntry& e = s.m_pIdx[iEntry];
+
+		uint64_t nPos;
+		Height h;
+		e.m_Pos.Export(nPos);
+		e.m_Maturity.Export(h);
+
+		return
+			(nPos == s.m_PosElem) &&
+			(h == pElem->m_Maturity) &&
+			(e.m_Commitment == pElem->m_Commitment);
+	}
+
+	void Block::BodyBase::RW::LoadUtxo(int iData)
+	{
+		if (Type::ui == iData)
+			LoadInternal(m_pUtxoIn, Type::ui, m_pGuardUtxoIn);
+		else
+			LoadInternal(m_pUtxoOut, Type::uo, m_pGuardUtxoOut);
+
+		VerifyIndex(iData);
+	}
+
+	void Block::BodyBase::RW::VerifyIndex(int iData)
+	{
+		// The index is not covered by the data hashes, yet it's used to seek. Make sure each entry points to the element it describes,
+		// and there's exactly one entry per s_IndexStep elements. Seeking by a bad entry goes unnoticed only until the data is scanned through it.
+		MappedStream& s = m_pM[iData];
+		if (!s.m_bIndexed)
+			return;
+
+		const TxElement* pElem = (Type::ui == iData) ? static_cast<const TxElement*>(m_pUtxoIn) : static_cast<const TxElement*>(m_pUtxoOut);
+		if (pElem)
+		{
+			uint64_t iElem = s.m_nElem++;
+			if (!(iElem % s_IndexStep) && !IsAtIndex(iData, iElem / s_IndexStep))
+				throw std::runtime_error("MB index mismatch");
+		}
+		else
+		{
+			if (s.m_IdxEntries != (s.m_nElem + s_IndexStep - 1) / s_IndexStep)
+				throw std::runtime_error("MB index mismatch");
+		}
 	}
 
 	void Block::BodyBase::RW::get_Start(BodyBase& body, SystemState::Sequence::Prefix& prefix)
 	{
-		if (!m_pS[Type::hd].IsOpen())
+		if (!m_pM[Type::hd].IsOpen())
 			std::ThrowLastError();
-		yas::binary_iarchive<std::FStream, SERIALIZE_OPTIONS> arc(m_pS[Type::hd]);
+		yas::binary_iarchive<MappedStream, SERIALIZE_OPTIONS> arc(m_pM[Type::hd]);
 
 		arc & body;
 		arc & prefix;
@@ -236,11 +622,11 @@ namespace beam
 
 	bool Block::BodyBase::RW::get_NextHdr(SystemState::Sequence::Element& elem)
 	{
-		std::FStream& s = m_pS[Type::hd];
+		MappedStream& s = m_pM[Type::hd];
 		if (!s.get_Remaining())
 			return false;
 
-		yas::binary_iarchive<std::FStream, SERIALIZE_OPTIONS> arc(s);
+		yas::binary_iarchive<MappedStream, SERIALIZE_OPTIONS> arc(s);
 		arc & elem;
 
 		return true;
@@ -248,16 +634,22 @@ namespace beam
 
 	void Block::BodyBase::RW::Write(const Input& v)
 	{
-		WriteMaturity(v, Type::ui);
+		WriteIndexed(v, Type::ui);
 		WriteInternal(v, Type::ui);
 	}
 
 	void Block::BodyBase::RW::Write(const Output& v)
 	{
-		WriteMaturity(v, Type::uo);
+		WriteIndexed(v, Type::uo);
 		WriteInternal(v, Type::uo);
 	}
 
+	void Block::BodyBase::RW::WriteIndexed(const TxElement& v, int iData)
+	{
+		WriteMaturity(v, iData);
+		m_pIdxW[iData - Type::ui].Add(v, get_WStream(iData).Tell());
+	}
+
 	void Block::BodyBase::RW::Write(const TxKernel& v)
 	{
 		if (!m_pMaturity[Type::ko])
@@ -272,7 +664,7 @@ namespace beam
 
 		for (; v.m_Maturity > m_pMaturity[Type::ko]; m_pMaturity[Type::ko]++)
 		{
-			uintBigFor<Height>::Type val = m_pS[Type::ko].Tell();
+			uintBigFor<Height>::Type val = get_WStream(Type::ko).Tell();
 			WriteInternal(val, Type::kx);
 		}
 
@@ -292,11 +684,11 @@ namespace beam
 
 	bool Block::BodyBase::RW::LoadMaturity(int iData)
 	{
-		std::FStream& s = m_pS[iData];
+		MappedStream& s = m_pM[iData];
 		if (!s.get_Remaining())
 			return false;
 
-		yas::binary_iarchive<std::FStream, SERIALIZE_OPTIONS> arc(s);
+		yas::binary_iarchive<MappedStream, SERIALIZE_OPTIONS> arc(s);
 
 		Height dh;
 		arc & dh;
@@ -307,10 +699,10 @@ namespace beam
 
 	void Block::BodyBase::RW::NextKernelThreshold()
 	{
-		std::FStream& s = m_pS[Type::kx];
+		MappedStream& s = m_pM[Type::kx];
 		if (s.get_Remaining())
 		{
-			yas::binary_iarchive<std::FStream, SERIALIZE_OPTIONS> arc(s);
+			yas::binary_iarchive<MappedStream, SERIALIZE_OPTIONS> arc(s);
 
 			uintBigFor<Height>::Type val;
 			arc & val;
@@ -324,15 +716,17 @@ namespace beam
 	template <typename T>
 	void Block::BodyBase::RW::LoadInternal(const T*& pPtr, int iData, typename T::Ptr* ppGuard)
 	{
-		std::FStream& s = m_pS[iData];
+		MappedStream& s = m_pM[iData];
 
 		if (s.get_Remaining())
 		{
+			s.m_PosElem = s.Tell();
+
 			ppGuard[0].swap(ppGuard[1]);
 			//if (!ppGuard[0])
 				ppGuard[0].reset(new T);
 
-			yas::binary_iarchive<std::FStream, SERIALIZE_OPTIONS> arc(s);
+			yas::binary_iarchive<MappedStream, SERIALIZE_OPTIONS> arc(s);
 
 			arc & *ppGuard[0];
 			ppGuard[0]->m_Maturity = m_pMaturity[iData];
@@ -350,14 +744,19 @@ namespace beam
 		m_pMaturity[iData] = v.m_Maturity;
 	}
 
-	template <typename T>
-	void Block::BodyBase::RW::WriteInternal(const T& v, int iData)
+	std::FStream& Block::BodyBase::RW::get_WStream(int iData)
 	{
 		std::FStream& s = m_pS[iData];
 		if (!s.IsOpen() && !OpenInternal(iData))
 			std::ThrowLastError();
 
-		yas::binary_oarchive<std::FStream, SERIALIZE_OPTIONS> arc(s);
+		return s;
+	}
+
+	template <typename T>
+	void Block::BodyBase::RW::WriteInternal(const T& v, int iData)
+	{
+		yas::binary_oarchive<std::FStream, SERIALIZE_OPTIONS> arc(get_WStream(iData));
 		arc & v;
 	}
 
@@ -394,37 +793,83 @@ namespace beam
 		return Combine(ppR, _countof(ppR), bStop);
 	}
 
+	// Min-heap of the readers, wrt their current element of the given kind. Ties are resolved by the reader index, so that the result is deterministic
+	template <typename T>
+	class CombineHeap
+	{
+		typedef const T* TxBase::IReader::*Member;
+
+		TxBase::IReader** m_ppR;
+		Member m_pMember;
+		std::vector<int> m_v;
+
+		const T& get_Elem(int i) const { return *(m_ppR[i]->*m_pMember); }
+
+		bool IsGreater(int a, int b) const
+		{
+			int n = get_Elem(a).cmp(get_Elem(b));
+			return n ? (n > 0) : (a > b);
+		}
+
+		struct Cmp
+		{
+			const CombineHeap& m_This;
+			bool operator()(int a, int b) const { return m_This.IsGreater(a, b); }
+		};
+
+	public:
+		CombineHeap(TxBase::IReader** ppR, int nR, Member pMember)
+			:m_ppR(ppR)
+			,m_pMember(pMember)
+		{
+			m_v.reserve(nR);
+			for (int i = 0; i < nR; i++)
+				if (ppR[i]->*pMember)
+					m_v.push_back(i);
+
+			std::make_heap(m_v.begin(), m_v.end(), Cmp{ *this });
+		}
+
+		const T* get_Top(int& i) const
+		{
+			if (m_v.empty())
+				return NULL;
+
+			i = m_v.front();
+			return &get_Elem(i);
+		}
+
+		// call after the top reader has been moved to its next element
+		void OnTopMoved()
+		{
+			assert(!m_v.empty());
+			std::pop_heap(m_v.begin(), m_v.end(), Cmp{ *this });
+
+			int i = m_v.back();
+			if (m_ppR[i]->*m_pMember)
+				std::push_heap(m_v.begin(), m_v.end(), Cmp{ *this });
+			else
+				m_v.pop_back();
+		}
+	};
+
 	bool TxBase::IWriter::Combine(IReader** ppR, int nR, const volatile bool& bStop)
 	{
 		for (int i = 0; i < nR; i++)
 			ppR[i]->Reset();
 
 		// Utxo
+		CombineHeap<Input> hInp(ppR, nR, &IReader::m_pUtxoIn);
+		CombineHeap<Output> hOut(ppR, nR, &IReader::m_pUtxoOut);
+
 		while (true)
 		{
 			if (bStop)
 				return false;
 
-			const Input* pInp = NULL;
-			const Output* pOut = NULL;
 			int iInp = 0, iOut = 0; // initialized just to suppress the warning, not really needed
-
-			for (int i = 0; i < nR; i++)
-			{
-				const Input* pi = ppR[i]->m_pUtxoIn;
-				if (pi && (!pInp || (*pInp > *pi)))
-				{
-					pInp = pi;
-					iInp = i;
-				}
-
-				const Output* po = ppR[i]->m_pUtxoOut;
-				if (po && (!pOut || (*pOut > *po)))
-				{
-					pOut = po;
-					iOut = i;
-				}
-			}
+			const Input* pInp = hInp.get_Top(iInp);
+			const Output* pOut = hOut.get_Top(iOut);
 
 			if (pInp)
 			{
@@ -438,7 +883,9 @@ namespace beam
 						{
 							// skip both
 							ppR[iInp]->NextUtxoIn();
+							hInp.OnTopMoved();
 							ppR[iOut]->NextUtxoOut();
+							hOut.OnTopMoved();
 							continue;
 						}
 				}
@@ -452,39 +899,34 @@ namespace beam
 			{
 				Write(*pInp);
 				ppR[iInp]->NextUtxoIn();
+				hInp.OnTopMoved();
 			}
 			else
 			{
 				Write(*pOut);
 				ppR[iOut]->NextUtxoOut();
+				hOut.OnTopMoved();
 			}
 		}
 
 
 		// Kernels
+		CombineHeap<TxKernel> hKrn(ppR, nR, &IReader::m_pKernel);
+
 		while (true)
 		{
 			if (bStop)
 				return false;
 
-			const TxKernel* pKrn = NULL;
 			int iSrc = 0; // initialized just to suppress the warning, not really needed
-
-			for (int i = 0; i < nR; i++)
-			{
-				const TxKernel* po = ppR[i]->m_pKernel;
-				if (po && (!pKrn || (*pKrn > *po)))
-				{
-					pKrn = po;
-					iSrc = i;
-				}
-			}
+			const TxKernel* pKrn = hKrn.get_Top(iSrc);
 
 			if (!pKrn)
 				break;
 
 			Write(*pKrn);
 			ppR[iSrc]->NextKernel();
+			hKrn.OnTopMoved();
 		}
 
 		return true;
@@ -492,30 +934,38 @@ namespace beam
 
 	bool Block::BodyBase::IMacroWriter::CombineHdr(IMacroReader&& r0, IMacroReader&& r1, const volatile bool& bStop)
 	{
+		IMacroReader* ppR[] = { &r0, &r1 };
+		return CombineHdr(ppR, _countof(ppR), bStop);
+	}
+
+	bool Block::BodyBase::IMacroWriter::CombineHdr(IMacroReader** ppR, int nR, const volatile bool& bStop)
+	{
+		assert(nR > 0);
+
 		Block::BodyBase body0, body1;
 		Block::SystemState::Sequence::Prefix prefix0, prefix1;
 		Block::SystemState::Sequence::Element elem;
 
-		r0.Reset();
-		r0.get_Start(body0, prefix0);
-		r1.Reset();
-		r1.get_Start(body1, prefix1);
-
-		body0.Merge(body1);
-		put_Start(body0, prefix0);
+		ppR[0]->Reset();
+		ppR[0]->get_Start(body0, prefix0);
 
-		while (r0.get_NextHdr(elem))
+		for (int i = 1; i < nR; i++)
 		{
-			if (bStop)
-				return false;
-			put_NextHdr(elem);
+			ppR[i]->Reset();
+			ppR[i]->get_Start(body1, prefix1);
+			body0.Merge(body1);
 		}
 
-		while (r1.get_NextHdr(elem))
+		put_Start(body0, prefix0);
+
+		for (int i = 0; i < nR; i++)
 		{
-			if (bStop)
-				return false;
-			put_NextHdr(elem);
+			while (ppR[i]->get_NextHdr(elem))
+			{
+				if (bStop)
+					return false;
+				put_NextHdr(elem);
+			}
 		}
 
 		return true;
@@ -75,6 +75,65 @@ namespace beam
 		return true;
 	}
 
+	bool TxBase::Context::HandleInput(const Input* pPrev, IReader& r, ECC::Point::Native& pt)
+	{
+		if (m_bVerifyOrder)
+		{
+			if (pPrev && (*pPrev > *r.m_pUtxoIn))
+				return false;
+
+			// make sure no redundant outputs
+			for (; r.m_pUtxoOut; r.NextUtxoOut())
+			{
+				int n = CmpInOut(*r.m_pUtxoIn, *r.m_pUtxoOut);
+				if (n < 0)
+					break;
+
+				if (!n)
+					return false; // duplicate!
+			}
+		}
+
+		if (!pt.Import(r.m_pUtxoIn->m_Commitment))
+			return false;
+
+		m_Sigma += pt;
+		return true;
+	}
+
+	bool TxBase::Context::HandleOutput(const Output* pPrev, const Output& v, ECC::Point::Native& pt)
+	{
+		if (m_bVerifyOrder && pPrev && (*pPrev > v))
+			return false;
+
+		if (!v.IsValid(pt))
+			return false;
+
+		m_Sigma += pt;
+
+		if (v.m_Coinbase)
+		{
+			if (!m_bBlockMode)
+				return false; // regular transactions should not produce coinbase outputs, only the miner should do this.
+
+			assert(v.m_pPublic); // must have already been checked
+			m_Coinbase += uintBigFrom(v.m_pPublic->m_Value);
+		}
+
+		return true;
+	}
+
+	bool TxBase::Context::HandleKernel(const TxKernel* pPrev, const TxKernel& v)
+	{
+		if (m_bVerifyOrder && pPrev && (*pPrev > v))
+			return false;
+
+		if (!v.IsValid(m_Fee, m_Sigma))
+			return false;
+
+		return HandleElementHeight(v.m_Height);
+	}
+
 	bool TxBase::Context::ValidateAndSummarize(const TxBase& txb, IReader&& r)
 	{
 		if (m_Height.IsEmpty())
@@ -95,30 +154,8 @@ namespace beam
 			if (ShouldAbort())
 				return false;
 
-			if (ShouldVerify(iV))
-			{
-				if (m_bVerifyOrder)
-				{
-					if (pPrev && (*pPrev > *r.m_pUtxoIn))
-						return false;
-
-					// make sure no redundant outputs
-					for (; r.m_pUtxoOut; r.NextUtxoOut())
-					{
-						int n = CmpInOut(*r.m_pUtxoIn, *r.m_pUtxoOut);
-						if (n < 0)
-							break;
-
-						if (!n)
-							return false; // duplicate!
-					}
-				}
-
-				if (!pt.Import(r.m_pUtxoIn->m_Commitment))
-					return false;
-
-				m_Sigma += pt;
-			}
+			if (ShouldVerify(iV) && !HandleInput(pPrev, r, pt))
+				return false;
 		}
 
 		m_Sigma = -m_Sigma;
@@ -131,46 +168,142 @@ namespace beam
 			if (ShouldAbort())
 				return false;
 
-			if (ShouldVerify(iV))
+			if (ShouldVerify(iV) && !HandleOutput(pPrev, *r.m_pUtxoOut, pt))
+				return false;
+		}
+
+		for (const TxKernel* pPrev = NULL; r.m_pKernel; pPrev = r.m_pKernel, r.NextKernel())
+		{
+			if (ShouldAbort())
+				return false;
+
+			if (ShouldVerify(iV) && !HandleKernel(pPrev, *r.m_pKernel))
+				return false;
+		}
+
+		if (ShouldVerify(iV))
+			m_Sigma += ECC::Context::get().G * txb.m_Offset;
+
+		assert(!m_Height.IsEmpty());
+		return true;
+	}
+
+	bool TxBase::Context::SeekSlice(Block::BodyBase::RW& r, int iData, uint64_t& iEnd, uint64_t& nCount) const
+	{
+		uint64_t nEntries = r.get_IndexEntries(iData);
+		uint64_t i0 = nEntries * m_iVerifier / m_nVerifiers;
+		iEnd = nEntries * (m_iVerifier + 1) / m_nVerifiers;
+
+		if (m_iVerifier + 1 == m_nVerifiers)
+			nCount = uint64_t(-1); // till the end
+		else
+		{
+			nCount = (iEnd - i0) * Block::BodyBase::RW::s_IndexStep;
+			if (!nCount)
+				return false;
+		}
+
+		// The 1st slice starts naturally. The beginning of others is verified by the preceding slice, which must end exactly there
+		if (i0)
+			r.SeekIndex(iData, i0);
+
+		return true;
+	}
+
+	bool TxBase::Context::ValidateAndSummarizeSlice(const TxBase& txb, Block::BodyBase::RW& r)
+	{
+		// The data is not trusted. Inconsistencies (including the index mismatch) are reported by the reader via exceptions
+		try {
+			return ValidateAndSummarizeSliceInternal(txb, r);
+		} catch (const std::exception&) {
+			return false;
+		}
+	}
+
+	bool TxBase::Context::ValidateAndSummarizeSliceInternal(const TxBase& txb, Block::BodyBase::RW& r)
+	{
+		typedef Block::BodyBase::RW RW;
+
+		if (m_Height.IsEmpty() || !r.IsIndexed())
+			return false;
+
+		assert(m_iVerifier < m_nVerifiers);
+		bool bLast = (m_iVerifier + 1 == m_nVerifiers);
+		uint64_t iEnd, nCount;
+
+		ECC::Point::Native pt;
+
+		// Inputs
+		m_Sigma = -m_Sigma;
+		r.Reset();
+
+		if (SeekSlice(r, RW::Type::ui, iEnd, nCount))
+		{
+			// skip the outputs that can't collide with the inputs of this slice
+			if (m_bVerifyOrder && r.m_pUtxoIn && r.m_pUtxoIn->m_Maturity)
+				r.NextUtxoOutFF(r.m_pUtxoIn->m_Maturity, r.m_pUtxoIn->m_Commitment);
+
+			const Input* pPrev = NULL;
+			for (; nCount && r.m_pUtxoIn; nCount--, pPrev = r.m_pUtxoIn, r.NextUtxoIn())
 			{
-				if (m_bVerifyOrder && pPrev && (*pPrev > *r.m_pUtxoOut))
+				if (ShouldAbort())
 					return false;
 
-				if (!r.m_pUtxoOut->IsValid(pt))
+				if (!HandleInput(pPrev, r, pt))
 					return false;
+			}
 
-				m_Sigma += pt;
-
-				if (r.m_pUtxoOut->m_Coinbase)
-				{
-					if (!m_bBlockMode)
-						return false; // regular transactions should not produce coinbase outputs, only the miner should do this.
+			if (!bLast)
+			{
+				// must end exactly where the next slice starts
+				if (nCount || !r.IsAtIndex(RW::Type::ui, iEnd))
+					return false;
 
-					assert(r.m_pUtxoOut->m_pPublic); // must have already been checked
-					m_Coinbase += uintBigFrom(r.m_pUtxoOut->m_pPublic->m_Value);
-				}
+				if (m_bVerifyOrder && pPrev && (*pPrev > *r.m_pUtxoIn))
+					return false;
 			}
 		}
 
-		for (const TxKernel* pPrev = NULL; r.m_pKernel; pPrev = r.m_pKernel, r.NextKernel())
-		{
-			if (ShouldAbort())
-				return false;
+		m_Sigma = -m_Sigma;
 
-			if (ShouldVerify(iV))
+		// Outputs
+		r.Reset();
+
+		if (SeekSlice(r, RW::Type::uo, iEnd, nCount))
+		{
+			const Output* pPrev = NULL;
+			for (; nCount && r.m_pUtxoOut; nCount--, pPrev = r.m_pUtxoOut, r.NextUtxoOut())
 			{
-				if (m_bVerifyOrder && pPrev && (*pPrev > *r.m_pKernel))
+				if (ShouldAbort())
 					return false;
 
-				if (!r.m_pKernel->IsValid(m_Fee, m_Sigma))
+				if (!HandleOutput(pPrev, *r.m_pUtxoOut, pt))
 					return false;
+			}
 
-				if (!HandleElementHeight(r.m_pKernel->m_Height))
+			if (!bLast)
+			{
+				if (nCount || !r.IsAtIndex(RW::Type::uo, iEnd))
+					return false;
+
+				if (m_bVerifyOrder && pPrev && (*pPrev > *r.m_pUtxoOut))
 					return false;
 			}
 		}
 
-		if (ShouldVerify(iV))
+		// Kernels. The 'kx' thresholds are validated only by the sequential read, hence no seek. Each verifier reads all the kernels,
+		// and verifies its share
+		uint32_t iV = m_iVerifier;
+		for (const TxKernel* pPrev = NULL; r.m_pKernel; pPrev = r.m_pKernel, r.NextKernel())
+		{
+			if (ShouldAbort())
+				return false;
+
+			if (ShouldVerify(iV) && !HandleKernel(pPrev, *r.m_pKernel))
+				return false;
+		}
+
+		if (!m_iVerifier)
 			m_Sigma += ECC::Context::get().G * txb.m_Offset;
 
 		assert(!m_Height.IsEmpty());
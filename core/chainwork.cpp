@@ -192,7 +192,7 @@ namespace beam
 	{
 		size_t iState, iHash;
 		return
-			IsValidInternal(iState, iHash, m_LowerBound, pTip) &&
+			IsValidInternal(iState, iHash, m_LowerBound, pTip, true) &&
 			(m_vArbitraryStates.size() + m_Heading.m_vElements.size() == iState) &&
 			(m_Proof.m_vData.size() == iHash);
 	}
@@ -202,10 +202,10 @@ namespace beam
 		std::copy(src.cbegin(), src.cbegin() + dst.size(), dst.begin());
 	}
 
-	bool Block::ChainWorkProof::Crop(const ChainWorkProof& src)
+	bool Block::ChainWorkProof::Crop(const ChainWorkProof& src, bool bVerifyPoW /* = true */)
 	{
 		size_t iState, iHash;
-		if (!src.IsValidInternal(iState, iHash, m_LowerBound, NULL))
+		if (!src.IsValidInternal(iState, iHash, m_LowerBound, NULL, bVerifyPoW))
 			return false;
 
 		bool bInPlace = (&src == this);
@@ -258,7 +258,7 @@ namespace beam
 		return Crop(*this);
 	}
 
-	bool Block::ChainWorkProof::IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, Block::SystemState::Full* pTip) const
+	bool Block::ChainWorkProof::IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, Block::SystemState::Full* pTip, bool bVerifyPoW) const
 	{
 		if (m_Heading.m_vElements.empty())
 			return false;
@@ -269,7 +269,7 @@ namespace beam
 
 		for (size_t i = m_Heading.m_vElements.size() - 1; ; )
 		{
-			if (!(s.IsValid()))
+			if (!(bVerifyPoW ? s.IsValid() : s.IsSane()))
 				return false;
 
 			if (!i--)
@@ -283,7 +283,7 @@ namespace beam
 		for (size_t i = 0; i < m_vArbitraryStates.size(); i++)
 		{
 			const Block::SystemState::Full& s2 = m_vArbitraryStates[i];
-			if (!(s2.IsValid()))
+			if (!(bVerifyPoW ? s2.IsValid() : s2.IsSane()))
 				return false;
 		}
 
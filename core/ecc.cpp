@@ -465,6 +465,60 @@ namespace ECC {
 		v.m_Y = (secp256k1_fe_is_odd(&ge.y) != 0);
 	}
 
+	void Point::Native::ExportBatch(Point* pRes, const Native* pPts, uint32_t nCount)
+	{
+		// Montgomery trick: a single field inversion per chunk instead of one per point
+		const uint32_t nChunk = 64;
+
+		struct Scratch
+		{
+			secp256k1_fe m_pAcc[nChunk]; // product of all the preceding z's
+			secp256k1_fe m_Inv;
+			secp256k1_ge m_Ge;
+		};
+
+		NoLeak<Scratch> scratch;
+		Scratch& sc = scratch.V;
+
+		for (uint32_t i0 = 0; i0 < nCount; i0 += nChunk)
+		{
+			uint32_t n = std::min(nCount - i0, nChunk);
+			const Native* pSrc = pPts + i0;
+			Point* pDst = pRes + i0;
+
+			secp256k1_fe_set_int(&sc.m_Inv, 1);
+
+			for (uint32_t i = 0; i < n; i++)
+			{
+				sc.m_pAcc[i] = sc.m_Inv;
+				if (!(pSrc[i] == Zero))
+					secp256k1_fe_mul(&sc.m_Inv, &sc.m_Inv, &pSrc[i].z);
+			}
+
+			secp256k1_fe_inv(&sc.m_Inv, &sc.m_Inv);
+
+			for (uint32_t i = n; i--; )
+			{
+				if (pSrc[i] == Zero)
+				{
+					ZeroObject(pDst[i]);
+					continue;
+				}
+
+				// m_Inv is the inverse of z[0] * ... * z[i]
+				secp256k1_fe_mul(&sc.m_pAcc[i], &sc.m_pAcc[i], &sc.m_Inv);
+				secp256k1_fe_mul(&sc.m_Inv, &sc.m_Inv, &pSrc[i].z);
+
+				secp256k1_ge_set_gej_zinv(&sc.m_Ge, &pSrc[i], &sc.m_pAcc[i]);
+
+				secp256k1_fe_normalize(&sc.m_Ge.x);
+				secp256k1_fe_normalize(&sc.m_Ge.y);
+
+				ExportEx(pDst[i], sc.m_Ge);
+			}
+		}
+	}
+
 	Point::Native& Point::Native::operator = (Zero_)
 	{
 		secp256k1_gej_set_infinity(this);
@@ -821,6 +875,23 @@ namespace ECC {
 		m_K = k;
 	}
 
+	const Point::Native& MultiMac::Casual::get_Odd(unsigned int nOdd)
+	{
+		assert(1 & nOdd);
+		unsigned int nElem = (nOdd >> 1) + 1;
+		assert(nElem < Fast::nCount);
+
+		for (; m_nPrepared < nElem; m_nPrepared++)
+		{
+			if (1 == m_nPrepared)
+				m_pPt[0] = m_pPt[1] * Two;
+
+			m_pPt[m_nPrepared + 1] = m_pPt[m_nPrepared] + m_pPt[0];
+		}
+
+		return m_pPt[nElem];
+	}
+
 	void MultiMac::Reset()
 	{
 		m_Casual = 0;
@@ -866,8 +937,283 @@ namespace ECC {
 		}
 	}
 
+	int MultiMac::s_PippengerMinCasual = 128; // the crossover is around 64..256, see the benchmark
+
+	unsigned int GetBitsAt(const Scalar::Native& k, unsigned int iPos, unsigned int nBitsWnd)
+	{
+		const Scalar::Native::uint* p = k.get().d;
+		const unsigned int nBitsPerWord = sizeof(*p) << 3;
+		const unsigned int nWords = nBits / nBitsPerWord;
+
+		unsigned int iWord = iPos / nBitsPerWord;
+		unsigned int iBitInWord = iPos % nBitsPerWord;
+
+		Scalar::Native::uint n = p[iWord] >> iBitInWord;
+		if ((iBitInWord + nBitsWnd > nBitsPerWord) && (iWord + 1 < nWords))
+			n |= p[iWord + 1] << (nBitsPerWord - iBitInWord);
+
+		return static_cast<unsigned int>(n) & ((1U << nBitsWnd) - 1);
+	}
+
+	unsigned int MultiMac::get_PippengerWndBits(unsigned int nCount)
+	{
+		// Per window: nCount additions into the buckets, then 2 additions per bucket to sum them up.
+		const unsigned int nMaxWnd = 14; // 16K buckets, 2MB
+		unsigned int nWndBest = 1;
+		uint64_t nCostBest = uint64_t(-1);
+
+		for (unsigned int nWnd = 1; nWnd <= nMaxWnd; nWnd++)
+		{
+			uint64_t nCost = uint64_t((nBits + nWnd - 1) / nWnd) * (nCount + (2U << nWnd));
+			if (nCost < nCostBest)
+			{
+				nCostBest = nCost;
+				nWndBest = nWnd;
+			}
+		}
+
+		return nWndBest;
+	}
+
+	void MultiMac::CalculatePippenger(Point::Native& res) const
+	{
+		const unsigned int nWnd = get_PippengerWndBits(m_Casual);
+		std::vector<Point::Native> vBuckets((1U << nWnd) - 1); // for the digit values 1...
+
+		res = Zero;
+
+		for (unsigned int iPos = (nBits + nWnd - 1) / nWnd * nWnd; iPos; )
+		{
+			iPos -= nWnd;
+
+			if (!(res == Zero))
+				for (unsigned int i = 0; i < nWnd; i++)
+					res = res * Two;
+
+			for (size_t i = 0; i < vBuckets.size(); i++)
+				vBuckets[i] = Zero;
+
+			for (int iEntry = 0; iEntry < m_Casual; iEntry++)
+			{
+				const Casual& x = m_pCasual[iEntry];
+				unsigned int nVal = GetBitsAt(x.m_K, iPos, nWnd);
+				if (nVal)
+					vBuckets[nVal - 1] += x.m_pPt[1];
+			}
+
+			// Sum(i * Bucket[i]), via running sums from the top
+			Point::Native ptRunning(Zero), ptSum(Zero);
+			for (size_t i = vBuckets.size(); i--; )
+			{
+				ptRunning += vBuckets[i];
+				ptSum += ptRunning;
+			}
+
+			res += ptSum;
+		}
+	}
+
+	/////////////////////
+	// Endomorphism
+	//
+	// lambda*(x,y) = (beta*x,y). The split formula and constants are from secp256k1 (secp256k1_scalar_split_lambda), which is built without USE_ENDOMORPHISM here.
+	bool MultiMac::s_bEndomorphism = true;
+
+	const unsigned int nBitsHalf = 128;
+
+	void SplitLambda(Scalar::Native& k1, Scalar::Native& k2, const Scalar::Native& k)
+	{
+		static const secp256k1_scalar minus_lambda = SECP256K1_SCALAR_CONST(
+			0xAC9C52B3UL, 0x3FA3CF1FUL, 0x5AD9E3FDUL, 0x77ED9BA4UL,
+			0xA880B9FCUL, 0x8EC739C2UL, 0xE0CFC810UL, 0xB51283CFUL
+		);
+		static const secp256k1_scalar minus_b1 = SECP256K1_SCALAR_CONST(
+			0x00000000UL, 0x00000000UL, 0x00000000UL, 0x00000000UL,
+			0xE4437ED6UL, 0x010E8828UL, 0x6F547FA9UL, 0x0ABFE4C3UL
+		);
+		static const secp256k1_scalar minus_b2 = SECP256K1_SCALAR_CONST(
+			0xFFFFFFFFUL, 0xFFFFFFFFUL, 0xFFFFFFFFUL, 0xFFFFFFFEUL,
+			0x8A280AC5UL, 0x0774346DUL, 0xD765CDA8UL, 0x3DB1562CUL
+		);
+		static const secp256k1_scalar g1 = SECP256K1_SCALAR_CONST(
+			0x00000000UL, 0x00000000UL, 0x00000000UL, 0x00003086UL,
+			0xD221A7D4UL, 0x6BCDE86CUL, 0x90E49284UL, 0xEB153DABUL
+		);
+		static const secp256k1_scalar g2 = SECP256K1_SCALAR_CONST(
+			0x00000000UL, 0x00000000UL, 0x00000000UL, 0x0000E443UL,
+			0x7ED6010EUL, 0x88286F54UL, 0x7FA90ABFUL, 0xE4C42212UL
+		);
+
+		secp256k1_scalar c1, c2;
+		secp256k1_scalar_mul_shift_var(&c1, &k.get(), &g1, 272);
+		secp256k1_scalar_mul_shift_var(&c2, &k.get(), &g2, 272);
+		secp256k1_scalar_mul(&c1, &c1, &minus_b1);
+		secp256k1_scalar_mul(&c2, &c2, &minus_b2);
+		secp256k1_scalar_add(&k2.get_Raw(), &c1, &c2);
+		secp256k1_scalar_mul(&k1.get_Raw(), &k2.get(), &minus_lambda);
+		secp256k1_scalar_add(&k1.get_Raw(), &k1.get(), &k.get());
+	}
+
+	const secp256k1_fe& get_Beta()
+	{
+		static const secp256k1_fe beta = SECP256K1_FE_CONST(
+			0x7ae96a2bul, 0x657c0710ul, 0x6e64479eul, 0xac3434e9ul,
+			0x9cf04975ul, 0x12f58995ul, 0xc1396c28ul, 0x719501eeul
+		);
+		return beta;
+	}
+
+	struct MultiMacHalf
+	{
+		Scalar::Native m_K; // absolute value
+		MultiMac::FastAux m_Aux;
+		bool m_bNeg;
+
+		void Set(const Scalar::Native& k)
+		{
+			m_bNeg = (0 != secp256k1_scalar_is_high(&k.get()));
+			if (m_bNeg)
+				m_K = -k;
+			else
+				m_K = k;
+
+#ifndef NDEBUG
+			const Scalar::Native::uint* p = m_K.get().d;
+			for (size_t i = _countof(m_K.get().d) / 2; i < _countof(m_K.get().d); i++)
+				assert(!p[i]); // must fit half of the bits
+#endif // NDEBUG
+		}
+
+		void Add(Point::Native& res, const Point::Native& pt, bool bLambda) const
+		{
+			if (!(bLambda || m_bNeg))
+			{
+				res += pt;
+				return;
+			}
+
+			Point::Native pt2 = pt;
+			secp256k1_gej& gej = pt2.get_Raw();
+
+			if (bLambda)
+			{
+				secp256k1_fe_normalize_weak(&gej.x);
+				secp256k1_fe_mul(&gej.x, &gej.x, &get_Beta());
+			}
+
+			if (m_bNeg)
+				secp256k1_gej_neg(&gej, &gej);
+
+			res += pt2;
+		}
+
+		void Add(Point::Native& res, const CompactPoint& pt, bool bLambda) const
+		{
+#ifdef ECC_COMPACT_GEN
+			secp256k1_ge ge;
+			secp256k1_ge_from_storage(&ge, &pt);
+
+			if (bLambda)
+				secp256k1_fe_mul(&ge.x, &ge.x, &get_Beta());
+			if (m_bNeg)
+				secp256k1_ge_neg(&ge, &ge);
+
+			secp256k1_gej_add_ge_var(&res.get_Raw(), &res.get_Raw(), &ge, NULL);
+#else // ECC_COMPACT_GEN
+			Add(res, (const Point::Native&) pt, bLambda);
+#endif // ECC_COMPACT_GEN
+		}
+	};
+
+	void MultiMac::CalculateEndomorphism(Point::Native& res) const
+	{
+		// halves of the scalars: [2*i] for the point, [2*i+1] for its lambda-image
+		std::vector<MultiMacHalf> vCasual(m_Casual * 2), vPrepared(m_Prepared * 2);
+
+		unsigned int pTblCasual[nBitsHalf];
+		unsigned int pTblPrepared[nBitsHalf];
+		ZeroObject(pTblCasual);
+		ZeroObject(pTblPrepared);
+
+		Scalar::Native k1, k2;
+
+		for (unsigned int i = 0; i < vCasual.size(); i += 2)
+		{
+			SplitLambda(k1, k2, m_pCasual[i >> 1].m_K);
+			vCasual[i].Set(k1);
+			vCasual[i + 1].Set(k2);
+
+			for (unsigned int j = i; j < i + 2; j++)
+				vCasual[j].m_Aux.Schedule(vCasual[j].m_K, nBitsHalf, Casual::Fast::nMaxOdd, pTblCasual, j + 1);
+		}
+
+		for (unsigned int i = 0; i < vPrepared.size(); i += 2)
+		{
+			SplitLambda(k1, k2, m_pKPrep[i >> 1]);
+			vPrepared[i].Set(k1);
+			vPrepared[i + 1].Set(k2);
+
+			for (unsigned int j = i; j < i + 2; j++)
+				vPrepared[j].m_Aux.Schedule(vPrepared[j].m_K, nBitsHalf, Prepared::Fast::nMaxOdd, pTblPrepared, j + 1);
+		}
+
+		res = Zero;
+
+		for (unsigned int iBit = nBitsHalf; iBit--; )
+		{
+			if (!(res == Zero))
+				res = res * Two;
+
+			while (pTblCasual[iBit])
+			{
+				unsigned int iEntry = pTblCasual[iBit];
+				MultiMacHalf& x = vCasual[iEntry - 1];
+				pTblCasual[iBit] = x.m_Aux.m_nNextItem;
+
+				Casual& c = m_pCasual[(iEntry - 1) >> 1];
+				x.Add(res, c.get_Odd(x.m_Aux.m_nOdd), !(1 & iEntry));
+
+				x.m_Aux.Schedule(x.m_K, iBit, Casual::Fast::nMaxOdd, pTblCasual, iEntry);
+			}
+
+			while (pTblPrepared[iBit])
+			{
+				unsigned int iEntry = pTblPrepared[iBit];
+				MultiMacHalf& x = vPrepared[iEntry - 1];
+				pTblPrepared[iBit] = x.m_Aux.m_nNextItem;
+
+				assert(1 & x.m_Aux.m_nOdd);
+				unsigned int nElem = (x.m_Aux.m_nOdd >> 1);
+				assert(nElem < Prepared::Fast::nCount);
+
+				x.Add(res, m_ppPrepared[(iEntry - 1) >> 1]->m_Fast.m_pPt[nElem], !(1 & iEntry));
+
+				x.m_Aux.Schedule(x.m_K, iBit, Prepared::Fast::nMaxOdd, pTblPrepared, iEntry);
+			}
+		}
+	}
+
 	void MultiMac::Calculate(Point::Native& res) const
 	{
+		if ((Mode::Fast == g_Mode) && (m_Casual >= s_PippengerMinCasual))
+		{
+			Point::Native resCasual;
+			CalculatePippenger(resCasual);
+
+			MultiMac mm = *this; // the rest as usual
+			mm.m_Casual = 0;
+			mm.Calculate(res);
+
+			res += resCasual;
+			return;
+		}
+
+		if ((Mode::Fast == g_Mode) && s_bEndomorphism)
+		{
+			CalculateEndomorphism(res);
+			return;
+		}
+
 		const unsigned int nBitsPerWord = sizeof(Scalar::Native::uint) << 3;
 
 		static_assert(!(nBitsPerWord % Casual::Secure::nBits), "");
@@ -917,19 +1263,7 @@ namespace ECC {
 					Casual& x = m_pCasual[iEntry - 1];
 					pTblCasual[iBit] = x.m_Aux.m_nNextItem;
 
-					assert(1 & x.m_Aux.m_nOdd);
-					unsigned int nElem = (x.m_Aux.m_nOdd >> 1) + 1;
-					assert(nElem < Casual::Fast::nCount);
-
-					for (; x.m_nPrepared < nElem; x.m_nPrepared++)
-					{
-						if (1 == x.m_nPrepared)
-							x.m_pPt[0] = x.m_pPt[1] * Two;
-
-						x.m_pPt[x.m_nPrepared + 1] = x.m_pPt[x.m_nPrepared] + x.m_pPt[0];
-					}
-
-					res += x.m_pPt[nElem];
+					res += x.get_Odd(x.m_Aux.m_nOdd);
 
 					x.m_Aux.Schedule(x.m_K, iBit, Casual::Fast::nMaxOdd, pTblCasual, iEntry);
 				}
@@ -1056,6 +1390,23 @@ namespace ECC {
 
 	/////////////////////
 	// Context
+#ifdef BEAM_ECC_CONTEXT_PRECOMPUTED
+
+	// generated at build time by ecc_context_gen, lives in the read-only data section (pages are shared among processes)
+	alignas(64) extern const unsigned char g_pContextPrecomputed[sizeof(Context)];
+
+	const Context& Context::get()
+	{
+		return *reinterpret_cast<const Context*>(g_pContextPrecomputed);
+	}
+
+	void InitializeContext()
+	{
+		// nothing to do
+	}
+
+#else // BEAM_ECC_CONTEXT_PRECOMPUTED
+
 	alignas(64) char g_pContextBuf[sizeof(Context)];
 
 	// Currently - auto-init in global obj c'tor
@@ -1073,8 +1424,17 @@ namespace ECC {
 
 	void InitializeContext()
 	{
-		Context& ctx = *reinterpret_cast<Context*>(g_pContextBuf);
+		Context::Derive(*reinterpret_cast<Context*>(g_pContextBuf));
 
+#ifndef NDEBUG
+		g_bContextInitialized = true;
+#endif // NDEBUG
+	}
+
+#endif // BEAM_ECC_CONTEXT_PRECOMPUTED
+
+	void Context::Derive(Context& ctx)
+	{
 		Mode::Scope scope(Mode::Fast);
 
 		Oracle oracle;
@@ -1164,10 +1524,6 @@ namespace ECC {
 		hpRes
 			<< uint32_t(2) // increment this each time we change signature formula (rangeproof and etc.)
 			>> ctx.m_hvChecksum;
-
-#ifndef NDEBUG
-		g_bContextInitialized = true;
-#endif // NDEBUG
 	}
 
 	/////////////////////
@@ -1302,11 +1658,15 @@ namespace ECC {
 	const Hash::Value& NonceGenerator::get_Okm()
 	{
 		if (m_bFirstTime)
+		{
 			// Extract
-			m_HMac >> m_Prk;
+			NoLeak<Hash::Value> prk;
+			m_HMac >> prk.V;
+			m_HMacPrk.Reset(prk.V.m_pData, prk.V.nBytes);
+		}
 
 		// Expand
-		m_HMac.Reset(m_Prk.m_pData, m_Prk.nBytes);
+		m_HMac = m_HMacPrk;
 
 		if (m_bFirstTime)
 			m_bFirstTime = false;
@@ -1345,12 +1705,19 @@ namespace ECC {
 	HKdf::Generator::Generator()
 	{
 		m_Secret.V = Zero;
+		Prepare();
+	}
+
+	void HKdf::Generator::Prepare()
+	{
+		static const char szSalt[] = "beam-Key";
+		m_Mac.Reset(szSalt, sizeof(szSalt));
+		m_Mac.Write(m_Secret.V.m_pData, m_Secret.V.nBytes);
 	}
 
 	void HKdf::Generator::Generate(Scalar::Native& out, const Hash::Value& hv) const
 	{
-		NonceGenerator("beam-Key")
-			<< m_Secret.V
+		NonceGenerator(m_Mac)
 			<< hv
 			>> out;
 	}
@@ -1371,6 +1738,7 @@ namespace ECC {
 		NonceGenerator nonceGen2 = nonceGen1;
 
 		nonceGen1.SetContext("gen") >> m_Generator.m_Secret.V;
+		m_Generator.Prepare();
 		nonceGen2.SetContext("coF") >> m_kCoFactor;
 	}
 
@@ -1459,19 +1827,26 @@ namespace ECC {
 	bool HKdf::Import(const Packed& v)
 	{
 		m_Generator.m_Secret.V = v.m_Secret;
+		m_Generator.Prepare();
 		return !m_kCoFactor.Import(v.m_kCoFactor);
 	}
 
 	void HKdfPub::Export(Packed& v) const
 	{
 		v.m_Secret = m_Generator.m_Secret.V;
-		v.m_PkG = m_PkG;
-		v.m_PkJ = m_PkJ;
+
+		Point::Native pPk[2] = { m_PkG, m_PkJ };
+		Point pRes[2];
+		Point::Native::ExportBatch(pRes, pPk, _countof(pPk));
+
+		v.m_PkG = pRes[0];
+		v.m_PkJ = pRes[1];
 	}
 
 	bool HKdfPub::Import(const Packed& v)
 	{
 		m_Generator.m_Secret.V = v.m_Secret;
+		m_Generator.Prepare();
 		return
 			m_PkG.ImportNnz(v.m_PkG) &&
 			m_PkJ.ImportNnz(v.m_PkJ);
@@ -406,7 +406,7 @@ namespace ECC
 		private:
 			struct ChallengeSetBase;
 			struct ChallengeSet;
-			static void CalcA(Point&, const Scalar::Native& alpha, Amount v);
+			static void CalcA(Point::Native&, const Scalar::Native& alpha, Amount v);
 		};
 
 		struct Public
@@ -17,6 +17,18 @@
 
 namespace ECC {
 
+	// the points are sent to the oracle in pairs, export both with a single field inversion
+	void ExportPair(Point& res0, Point& res1, const Point::Native& pt0, const Point::Native& pt1)
+	{
+		Point::Native pPt[2] = { pt0, pt1 };
+		Point pRes[2];
+
+		Point::Native::ExportBatch(pRes, pPt, _countof(pPt));
+
+		res0 = pRes[0];
+		res1 = pRes[1];
+	}
+
 	/////////////////////
 	// InnerProduct
 
@@ -417,7 +429,7 @@ namespace ECC {
 
 		oracle << dotAB >> c.m_Cs.m_DotMultiplier;
 
-		Point::Native comm;
+		Point::Native pComm[2];
 
 		for (c.m_iCycle = 0; c.m_iCycle < nCycles; c.m_iCycle++)
 		{
@@ -429,11 +441,13 @@ namespace ECC {
 			for (int j = 0; j < 2; j++)
 			{
 				c.ExtractLR(j);
+				c.m_Mm.Calculate(pComm[j]);
+			}
+
+			Point::Native::ExportBatch(m_pLR[c.m_iCycle], pComm, _countof(pComm));
 
-				c.m_Mm.Calculate(comm);
-				m_pLR[c.m_iCycle][j] = comm;
+			for (int j = 0; j < 2; j++)
 				oracle << m_pLR[c.m_iCycle][j];
-			}
 
 			c.Condense();
 
@@ -594,10 +608,18 @@ namespace ECC {
 		:public NonceGenerator
 	{
 		NonceGeneratorBp(const uintBig& seed)
-			:NonceGenerator("bulletproof")
+			:NonceGenerator(get_Salted())
 		{
 			*this << seed;
 		}
+
+		static const Hash::Mac& get_Salted()
+		{
+			// the salt is constant, prepare its HMAC key setup once
+			static const char szSalt[] = "bulletproof";
+			static const Hash::Mac s_Mac(szSalt, sizeof(szSalt));
+			return s_Mac;
+		}
 	};
 
 	/////////////////////
@@ -674,7 +696,8 @@ namespace ECC {
 
 		alpha += ro;
 
-		CalcA(m_Part1.m_A, alpha, cp.m_Kidv.m_Value);
+		Point::Native ptA;
+		CalcA(ptA, alpha, cp.m_Kidv.m_Value);
 
 		// S = G*ro + vec(sL)*vec(G) + vec(sR)*vec(H)
 		nonceGen >> ro;
@@ -697,7 +720,7 @@ namespace ECC {
 		Point::Native comm;
 		mm.Calculate(comm);
 
-		m_Part1.m_S = comm;
+		ExportPair(m_Part1.m_A, m_Part1.m_S, ptA, comm);
 
 		//if (Phase::Step1 == ePhase)
 		//	return; // stop after A,S calculated
@@ -788,8 +811,7 @@ namespace ECC {
 				comm2 += p;
 			}
 
-			m_Part2.m_T1 = comm;
-			m_Part2.m_T2 = comm2;
+			ExportPair(m_Part2.m_T1, m_Part2.m_T2, comm, comm2);
 		}
 
 		cs.Init(m_Part2, oracle); // get challenge 
@@ -870,9 +892,9 @@ namespace ECC {
 		return true;
 	}
 
-	void RangeProof::Confidential::CalcA(Point& res, const Scalar::Native& alpha, Amount v)
+	void RangeProof::Confidential::CalcA(Point::Native& comm, const Scalar::Native& alpha, Amount v)
 	{
-		Point::Native comm = Context::get().G * alpha;
+		comm = Context::get().G * alpha;
 
 		{
 			NoLeak<secp256k1_ge> ge;
@@ -889,8 +911,6 @@ namespace ECC {
 				Generator::ToPt(comm, ge.V, ge_s.V, false);
 			}
 		}
-
-		res = comm;
 	}
 
 	bool RangeProof::Confidential::Recover(Oracle& oracle, CreatorParams& cp) const
@@ -929,8 +949,11 @@ namespace ECC {
 		// Calculate m_Part1.m_A, which depends on alpha and the value.
 
 		alpha_minus_params += params; // just alpha
+		Point::Native comm;
+		CalcA(comm, alpha_minus_params, cp.m_Kidv.m_Value);
+
 		Point ptA;
-		CalcA(ptA, alpha_minus_params, cp.m_Kidv.m_Value);
+		ptA = comm;
 
 		return ptA == m_Part1.m_A; // the probability of false positive should be negligible
 	}
@@ -973,16 +996,13 @@ namespace ECC {
 		Point::Native ptT1, ptT2;
 		msig.AddInfo1(ptT1, ptT2);
 
-		Point::Native pt;
-		if (!pt.Import(p2.m_T1))
+		Point::Native pt, pt2;
+		if (!pt.Import(p2.m_T1) || !pt2.Import(p2.m_T2))
 			return false;
-		pt += ptT1;
-		p2.m_T1 = pt;
 
-		if (!pt.Import(p2.m_T2))
-			return false;
-		pt += ptT2;
-		p2.m_T2 = pt;
+		pt += ptT1;
+		pt2 += ptT2;
+		ExportPair(p2.m_T1, p2.m_T2, pt, pt2);
 
 		return true;
 	}
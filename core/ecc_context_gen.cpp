@@ -0,0 +1,73 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Build-time tool. Derives the ECC context (generator tables) and writes it as a const data translation unit,
+// which is then compiled into the core library instead of deriving the context at startup.
+
+#include "ecc_native.h"
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		std::cerr << "Usage: ecc_context_gen <output file>" << std::endl;
+		return 1;
+	}
+
+	// the buffer must be zeroed, so that the padding (if any) is deterministic
+	const size_t nBytes = sizeof(ECC::Context);
+	std::unique_ptr<unsigned char[]> pBuf(new unsigned char[nBytes]());
+
+	ECC::Context::Derive(*reinterpret_cast<ECC::Context*>(pBuf.get()));
+
+	std::ofstream os(argv[1], std::ios_base::out | std::ios_base::trunc);
+	if (!os)
+	{
+		std::cerr << "Can't open " << argv[1] << std::endl;
+		return 1;
+	}
+
+	// emitted as raw bytes (the same way the runtime-initialized context lives in a char buffer), to avoid type-punning of other types
+	os
+		<< "// Generated by ecc_context_gen. Do not edit.\n\n"
+		<< "#include \"ecc_native.h\"\n\n"
+		<< "namespace ECC\n{\n"
+		<< "\talignas(64) extern const unsigned char g_pContextPrecomputed[" << nBytes << "] = {\n";
+
+	for (size_t i = 0; i < nBytes; i++)
+	{
+		if (!(i % 32))
+			os << "\t\t";
+
+		os << static_cast<unsigned int>(pBuf[i]) << ',';
+		os << (((i % 32) == 31) ? '\n' : ' ');
+	}
+
+	os
+		<< "\n\t};\n\n"
+		<< "\tstatic_assert(sizeof(g_pContextPrecomputed) == sizeof(Context), \"context layout changed\");\n"
+		<< "}\n";
+
+	os.close();
+	if (!os)
+	{
+		std::cerr << "Write failed" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -144,6 +144,7 @@ namespace ECC
 		bool Export(Point&) const; // if the point is zero - returns false and zeroes the result
 
 		static void ExportEx(Point&, const secp256k1_ge&);
+		static void ExportBatch(Point*, const Native*, uint32_t nCount); // same as Export for each point, but with a single field inversion
 	};
 
 #ifdef NDEBUG
@@ -203,6 +204,8 @@ namespace ECC
 
 			void Init(const Point::Native&);
 			void Init(const Point::Native&, const Scalar::Native&);
+
+			const Point::Native& get_Odd(unsigned int nOdd); // fast mode, the odd multiples are calculated on-demand
 		};
 
 		struct Prepared
@@ -239,10 +242,23 @@ namespace ECC
 		int m_Casual;
 		int m_Prepared;
 
+		// In fast mode, if there are at least that many casual points, they're evaluated by the bucket (Pippenger) method, which scales sub-linearly.
+		// For smaller counts the above per-point odd multiples (Straus) are faster.
+		static int s_PippengerMinCasual;
+
+		// In fast mode all the scalars are split via the curve endomorphism: k = k1 + k2*lambda, where lambda*(x,y) = (beta*x,y), and k1,k2 are ~128 bits.
+		// The doubling chain is halved, whereas the odd multiples tables are shared by both halves. On by default.
+		static bool s_bEndomorphism;
+
 		MultiMac() { Reset(); }
 
 		void Reset();
 		void Calculate(Point::Native&) const;
+
+	private:
+		void CalculatePippenger(Point::Native&) const; // casual only
+		static unsigned int get_PippengerWndBits(unsigned int nCount);
+		void CalculateEndomorphism(Point::Native&) const;
 	};
 
 	template <int nMaxCasual, int nMaxPrepared>
@@ -466,8 +482,8 @@ namespace ECC
 	{
 		// RFC-5869
 		Hash::Mac m_HMac;
+		Hash::Mac m_HMacPrk; // keyed by the PRK, the initial state of each expand step
 
-		Hash::Value m_Prk;
 		Hash::Value m_Okm;
 		beam::uintBig_t<1> m_Counter; // wraps-around, it's fine
 		bool m_bFirstTime;
@@ -484,6 +500,13 @@ namespace ECC
 			Reset();
 		}
 
+		// starts from the prepared state: the salt (and possibly the beginning of the ikm) already absorbed
+		NonceGenerator(const Hash::Mac& hmac)
+			:m_HMac(hmac)
+		{
+			Reset();
+		}
+
 		~NonceGenerator() { SecureErase(*this); }
 
 		beam::Blob m_Context;
@@ -517,6 +540,8 @@ namespace ECC
 			Generator();
 			// according to rfc5869
 			NoLeak<uintBig> m_Secret;
+			Hash::Mac m_Mac; // salt and secret absorbed, saves the HMAC key setup for each derivation. Must be updated via Prepare()
+			void Prepare();
 			void Generate(Scalar::Native&, const Hash::Value&) const;
 
 		} m_Generator;
@@ -587,6 +612,9 @@ namespace ECC
 	{
 		static const Context& get();
 
+		// deterministic, doesn't depend on the current context. The target memory is expected to be zero-initialized
+		static void Derive(Context&);
+
 		Generator::Obscured						G;
 		Generator::Obscured						H_Big;
 		Generator::Simple<sizeof(Amount) << 3>	H;
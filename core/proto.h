@@ -56,6 +56,24 @@ namespace proto {
     macro(ByteBuffer, Perishable) \
     macro(ByteBuffer, Eternal)
 
+#define BeamNodeMsg_GetBodyCompact(macro) \
+    macro(Block::SystemState::ID, ID)
+
+#define BeamNodeMsg_BodyCompact(macro) \
+    macro(ByteBuffer, Prefilled) /* BodyBase, all the inputs, and those outputs and kernels not referenced by short IDs */ \
+    macro(std::vector<uint64_t>, Outputs) /* short IDs, 0 means prefilled */ \
+    macro(std::vector<uint64_t>, Kernels) \
+    macro(ECC::Hash::Value, Checksum) /* of the original Perishable and Eternal */
+
+#define BeamNodeMsg_GetBodyMissing(macro) \
+    macro(Block::SystemState::ID, ID) \
+    macro(std::vector<uint32_t>, Outputs) /* indices */ \
+    macro(std::vector<uint32_t>, Kernels)
+
+#define BeamNodeMsg_BodyMissing(macro) \
+    macro(ByteBuffer, Perishable) \
+    macro(ByteBuffer, Eternal)
+
 #define BeamNodeMsg_GetProofState(macro) \
     macro(Height, Height)
 
@@ -114,6 +132,12 @@ namespace proto {
 #define BeamNodeMsg_GetTransaction(macro) \
     macro(Transaction::KeyType, ID)
 
+#define BeamNodeMsg_HaveTransactions(macro) \
+    macro(std::vector<Transaction::KeyType>, IDs)
+
+#define BeamNodeMsg_GetTransactions(macro) \
+    macro(std::vector<Transaction::KeyType>, IDs)
+
 #define BeamNodeMsg_Bye(macro) \
     macro(uint8_t, Reason)
 
@@ -175,6 +199,19 @@ namespace proto {
     macro(ByteBuffer, Portion) \
     macro(uint64_t, SizeTotal)
 
+#define BeamNodeMsg_MacroblockGetRange(macro) \
+    macro(Block::SystemState::ID, ID) \
+    macro(uint8_t, Data) \
+    macro(uint64_t, Offset) \
+    macro(uint32_t, Size) /* max portion size, the server may return less */
+
+#define BeamNodeMsg_MacroblockRange(macro) \
+    macro(Block::SystemState::ID, ID) \
+    macro(uint8_t, Data) \
+    macro(uint64_t, Offset) /* as requested */ \
+    macro(uint64_t, SizeData) /* of the whole data file */ \
+    macro(ByteBuffer, Portion)
+
 #define BeamNodeMsg_GetUtxoEvents(macro) \
     macro(Height, HeightMin)
 
@@ -227,6 +264,12 @@ namespace proto {
     macro(0x23, ProofCommonState) \
     macro(0x24, GetProofKernel2) \
     macro(0x25, ProofKernel2) \
+    macro(0x26, GetBodyCompact) \
+    macro(0x27, BodyCompact) \
+    macro(0x28, GetBodyMissing) \
+    macro(0x29, BodyMissing) \
+    macro(0x2a, MacroblockGetRange) \
+    macro(0x2b, MacroblockRange) \
     /* onwer-relevant */ \
     macro(0x2c, GetUtxoEvents) \
     macro(0x2d, UtxoEvents) \
@@ -236,6 +279,8 @@ namespace proto {
     macro(0x30, NewTransaction) \
     macro(0x31, HaveTransaction) \
     macro(0x32, GetTransaction) \
+    macro(0x33, HaveTransactions) \
+    macro(0x34, GetTransactions) \
     /* bbs */ \
     macro(0x38, BbsMsg) \
     macro(0x39, BbsHaveMsg) \
@@ -250,6 +295,9 @@ namespace proto {
         static const uint8_t Bbs                    = 0x2; // I'm spreading bbs messages
         static const uint8_t SendPeers                = 0x4; // Please send me periodically peers recommendations
         static const uint8_t MiningFinalization        = 0x8; // I want to finalize block construction for my owned node
+        static const uint8_t CompactBlocks            = 0x10; // I can serve compact blocks (short IDs of the elements that may be in your tx pool)
+        static const uint8_t TxInvBatches            = 0x20; // Please send tx inventory (Have/Get) in batches
+        static const uint8_t MacroblockRanges        = 0x40; // I can serve macroblock byte ranges (MacroblockGetRange)
     };
 
     struct IDType
@@ -260,6 +308,7 @@ namespace proto {
     };
 
     static const uint32_t g_HdrPackMaxSize = 128;
+    static const uint32_t g_TxInvMaxSize = 1024; // tx IDs per HaveTransactions/GetTransactions
 
     struct UtxoEvent
     {
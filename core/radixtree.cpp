@@ -300,6 +300,114 @@ void RadixTree::Delete(CursorBase& cu)
 	}
 }
 
+RadixTree::Leaf* RadixTree::Builder::Append(const uint8_t* pKey, uint16_t nBits)
+{
+	uint16_t nBytes = (nBits + 7) >> 3;
+	uint16_t nBit = 0; // where the key diverges from the previous one
+
+	if (m_vPath.empty())
+	{
+		if (m_Tree.m_pRoot)
+			throw std::runtime_error("tree not empty");
+
+		m_vPath.reserve(nBits + 1);
+	}
+	else
+	{
+		const uint8_t* pPrev = m_Tree.GetLeafKey(Cast::Up<Leaf>(*m_vPath.back().m_p));
+
+		uint16_t iByte = 0;
+		for ( ; (iByte < nBytes) && (pKey[iByte] == pPrev[iByte]); iByte++)
+			;
+
+		if (iByte == nBytes)
+			throw std::runtime_error("incorrect order");
+
+		nBit = iByte << 3;
+		for (uint8_t x = pKey[iByte] ^ pPrev[iByte]; !(0x80 & x); x <<= 1)
+			nBit++;
+
+		if ((nBit >= nBits) || !(pKey[iByte] & (0x80 >> (7 & nBit))))
+			throw std::runtime_error("incorrect order");
+
+		// the node that covers this bit. The deeper ones are complete
+		for ( ; m_vPath.back().m_nBit0 > nBit; m_vPath.pop_back())
+			OnComplete(*m_vPath.back().m_p);
+	}
+
+	Leaf* pN = m_Tree.CreateLeaf();
+
+	// Guard the allocated leaf, in case the joint allocation throws
+	struct Guard
+	{
+		Leaf* m_pLeaf;
+		RadixTree* m_pTree;
+
+		~Guard() {
+			if (m_pLeaf)
+				m_pTree->DeleteLeaf(m_pLeaf);
+		}
+	} g;
+
+	g.m_pTree = &m_Tree;
+	g.m_pLeaf = pN;
+
+	memcpy(m_Tree.GetLeafKey(*pN), pKey, nBytes);
+
+	if (m_vPath.empty())
+	{
+		m_Tree.m_pRoot = pN;
+		pN->m_Bits = nBits;
+	}
+	else
+	{
+		Entry& e = m_vPath.back();
+		Node* p = e.m_p;
+
+		uint16_t dn = nBit - e.m_nBit0;
+		assert(dn < p->get_Bits()); // can't be the joint bit, since the path goes via the greater children
+
+		// split
+		Joint* pJ = m_Tree.CreateJoint();
+		pJ->m_pKeyPtr = m_Tree.get_NodeKey(*p);
+		pJ->m_Bits = dn;
+
+		p->m_Bits -= dn + 1;
+		pN->m_Bits = nBits - (nBit + 1);
+
+		pJ->m_ppC[0] = p;
+		pJ->m_ppC[1] = pN;
+
+		if (m_vPath.size() > 1)
+		{
+			Joint& x = Cast::Up<Joint>(*m_vPath[m_vPath.size() - 2].m_p);
+			assert(x.m_ppC[1] == p);
+			x.m_ppC[1] = pJ;
+		}
+		else
+			m_Tree.m_pRoot = pJ;
+
+		e.m_p = pJ;
+		nBit++;
+
+		OnComplete(*p);
+	}
+
+	pN->m_Bits |= Node::s_Leaf;
+	g.m_pLeaf = NULL; // dismissed
+
+	m_vPath.emplace_back();
+	m_vPath.back().m_p = pN;
+	m_vPath.back().m_nBit0 = nBit;
+
+	return pN;
+}
+
+void RadixTree::Builder::Finalize()
+{
+	for ( ; !m_vPath.empty(); m_vPath.pop_back())
+		OnComplete(*m_vPath.back().m_p);
+}
 
 bool RadixTree::Traverse(const Node& n, ITraveler& t) const
 {
@@ -479,6 +587,15 @@ const Merkle::Hash& RadixHashTree::get_Hash(Node& n, Merkle::Hash& hv)
 	return x.m_Hash;
 }
 
+void RadixHashTree::Builder::OnComplete(Node& n)
+{
+	if (!(Node::s_Leaf & n.m_Bits)) // leaf hashes are not cached anyway
+	{
+		Merkle::Hash hv;
+		Cast::Up<RadixHashTree>(m_Tree).get_Hash(n, hv);
+	}
+}
+
 void RadixHashTree::get_Proof(Merkle::Proof& proof, const CursorBase& cu)
 {
 	uint16_t n = cu.get_Depth();
@@ -562,29 +679,80 @@ void UtxoTree::LoadIntenral(ISerializer& s)
 	uint32_t n = 0;
 	s.Process(n);
 
-	Key pKey[2];
+	Builder bld(*this); // must be in ascending order
 
 	for (uint32_t i = 0; i < n; i++)
 	{
-		Key& key = pKey[1 & i];
-		const Key& keyPrev = pKey[!(1 & i)];
-
+		Key key;
 		s.Process(key);
 
-		if (i)
-		{
-			// must be in ascending order
-			if (keyPrev.cmp(key) >= 0)
-				throw std::runtime_error("incorrect order");
-		}
-
-		Cursor cu;
-		bool bCreate = true;
-		MyLeaf* p = Find(cu, key, bCreate);
+		MyLeaf* p = bld.Append(key);
 
 		p->m_Value.m_Count = 0;
 		s.Process(p->m_Value);
 	}
+
+	bld.Finalize();
+}
+
+bool UtxoTree::AddSorted(const Key* pKeys, size_t nCount)
+{
+	if (!nCount)
+		return true;
+
+	struct Traveler
+		:public ITraveler
+	{
+		Builder* m_pBld;
+		const Key* m_pKeys;
+		size_t m_nCount;
+
+		bool AddDups(MyLeaf& x)
+		{
+			for ( ; m_nCount && (*m_pKeys == x.m_Key); m_pKeys++, m_nCount--)
+				if (!++x.m_Value.m_Count)
+					return false; // overflow
+			return true;
+		}
+
+		bool AddNew(const Key* pBound)
+		{
+			while (m_nCount && (!pBound || (*m_pKeys < *pBound)))
+			{
+				MyLeaf* p = m_pBld->Append(*m_pKeys);
+				p->m_Value.m_Count = 0;
+				if (!AddDups(*p))
+					return false;
+			}
+			return true;
+		}
+
+		virtual bool OnLeaf(const Leaf& x) override
+		{
+			const MyLeaf& v = Cast::Up<MyLeaf>(x);
+			if (!AddNew(&v.m_Key))
+				return false;
+
+			MyLeaf* p = m_pBld->Append(v.m_Key);
+			p->m_Value = v.m_Value;
+			return AddDups(*p);
+		}
+	};
+
+	UtxoTree t;
+	Builder bld(t);
+
+	Traveler tr;
+	tr.m_pBld = &bld;
+	tr.m_pKeys = pKeys;
+	tr.m_nCount = nCount;
+
+	if (!Traverse(tr) || !tr.AddNew(NULL))
+		return false;
+
+	bld.Finalize();
+	Swap(t);
+	return true;
 }
 
 int UtxoTree::Key::cmp(const Key& k) const
@@ -100,6 +100,29 @@ public:
 
 	void Delete(CursorBase& cu);
 
+	// Bulk load. Keys must come in strictly ascending order, each one is attached to the rightmost path without the descent from the root, O(n) overall.
+	// The tree must be empty initially, and should not be modified otherwise until the builder is finalized.
+	class Builder
+	{
+		struct Entry
+		{
+			Node* m_p;
+			uint16_t m_nBit0; // the 1st key bit covered by the node
+		};
+
+		std::vector<Entry> m_vPath; // the rightmost path, from the root
+
+	protected:
+		RadixTree& m_Tree;
+		virtual void OnComplete(Node&) {} // the node and its subtree won't change anymore
+
+	public:
+		Builder(RadixTree& t) :m_Tree(t) {}
+
+		Leaf* Append(const uint8_t* pKey, uint16_t nBits);
+		void Finalize();
+	};
+
 	struct ITraveler
 	{
 		CursorBase* m_pCu; // set it to a valid cursor instance to get the cursor of the element during traverse.
@@ -121,6 +144,9 @@ public:
 
 	size_t Count() const; // implemented via the whole tree traversing, shouldn't use frequently.
 
+protected:
+	void Swap(RadixTree& t) { std::swap(m_pRoot, t.m_pRoot); } // trees must be of the same type
+
 private:
 	Node* m_pRoot;
 
@@ -144,6 +170,16 @@ public:
 	void get_Hash(Merkle::Hash&);
 	void get_Proof(Merkle::Proof&, const CursorBase&);
 
+	// computes the hashes of the completed subtrees on-the-fly
+	class Builder
+		:public RadixTree::Builder
+	{
+	protected:
+		virtual void OnComplete(Node&) override;
+	public:
+		Builder(RadixHashTree& t) :RadixTree::Builder(t) {}
+	};
+
 protected:
 	// RadixTree
 	virtual Joint* CreateJoint() override { return new MyJoint; }
@@ -233,6 +269,22 @@ public:
 		return Cast::Up<MyLeaf>(RadixTree::Find(cu, key.m_pArr, key.s_Bits, bCreate));
 	}
 
+	class Builder
+		:public RadixHashTree::Builder
+	{
+	public:
+		Builder(UtxoTree& t) :RadixHashTree::Builder(t) {}
+
+		MyLeaf* Append(const Key& key) // the count is not initialized
+		{
+			return Cast::Up<MyLeaf>(RadixHashTree::Builder::Append(key.m_pArr, Key::s_Bits));
+		}
+	};
+
+	// Adds the keys in bulk, the tree is rebuilt by merging them with the existing elements. The keys must be sorted, duplicates are counted.
+	// Returns false on the count overflow, in which case the tree is unchanged.
+	bool AddSorted(const Key*, size_t nCount);
+
 	~UtxoTree() { Clear(); }
 
     template<typename Archive>
@@ -71,79 +71,25 @@ namespace beam
 		}
 	};
 
-	class Treasury::ThreadPool
+	struct Treasury::Verifier
+		:public ThreadPool::Context
 	{
-		std::vector<std::thread> m_vThreads;
-	public:
+		volatile bool m_bValid;
+		Verifier() :m_bValid(true) {}
 
-		struct Context
-		{
-			virtual void Do(size_t iTask) = 0;
-
-			void DoRange(size_t i0, size_t i1)
-			{
-				for (; i0 < i1; i0++)
-					Do(i0);
-			}
-
-			void DoAll(size_t nTasks)
-			{
-				ThreadPool tp(*this, nTasks);
-			}
-		};
-
-		struct Verifier
-			:public Context
-		{
-			volatile bool m_bValid;
-			Verifier() :m_bValid(true) {}
-
-			virtual void Do(size_t iTask) override
-			{
-				typedef InnerProduct::BatchContextEx<100> MyBatch;
-
-				std::unique_ptr<MyBatch> p(new MyBatch);
-				p->m_bEnableBatch = true;
-				MyBatch::Scope scope(*p);
-
-				if (!Verify(iTask) || !p->Flush())
-					m_bValid = false; // sync isn't required
-			}
-
-			virtual bool Verify(size_t iTask) = 0;
-
-		};
-
-		ThreadPool(Context& ctx, size_t nTasks)
+		virtual void Do(size_t iTask) override
 		{
-			size_t numCores = std::thread::hardware_concurrency();
-			if (!numCores)
-				numCores = 1; //?
-			if (numCores > nTasks)
-				numCores = nTasks;
-
-			m_vThreads.resize(numCores);
-			size_t iTask0 = 0;
-
-			for (size_t i = 0; i < m_vThreads.size(); i++)
-			{
-				size_t iTask1 = nTasks * (i + 1) / numCores;
-				assert(iTask1 > iTask0); // otherwise it means that redundant threads were created
+			typedef InnerProduct::BatchContextEx<100> MyBatch;
 
-				m_vThreads[i] = std::thread(&Context::DoRange, &ctx, iTask0, iTask1);
+			std::unique_ptr<MyBatch> p(new MyBatch);
+			p->m_bEnableBatch = true;
+			MyBatch::Scope scope(*p);
 
-				iTask0 = iTask1;
-			}
-
-			assert(iTask0 == nTasks);
+			if (!Verify(iTask) || !p->Flush())
+				m_bValid = false; // sync isn't required
 		}
 
-		~ThreadPool()
-		{
-			for (size_t i = 0; i < m_vThreads.size(); i++)
-				if (m_vThreads[i].joinable())
-					m_vThreads[i].join();
-		}
+		virtual bool Verify(size_t iTask) = 0;
 	};
 
 	void Treasury::Request::Group::AddSubsidy(AmountBig::Type& res) const
@@ -166,26 +112,70 @@ namespace beam
 		proto::Sk2Pk(pid, sk);
 	}
 
-	void Treasury::Response::Group::Create(const Request::Group& g, Key::IKdf& kdf, uint64_t& nIndex)
+	// Collects the outputs of all the groups, so that all the proofs are created at once (in parallel).
+	// Key indexes are assigned in the same order as if the groups were created one by one.
+	struct Treasury::Response::Group::Creator
 	{
-		m_vCoins.resize(g.m_vCoins.size());
+		std::vector<Output*> m_vOutputs;
+		std::vector<Key::IDV> m_vKidv;
+		std::vector<Scalar::Native> m_vSk;
+		std::vector<size_t> m_vOutput0; // per group
+		std::vector<uint64_t> m_vKrnIdx; // per group
 
-		Scalar::Native sk, offset = Zero;
+		void Add(Group& x, const Request::Group& g, uint64_t& nIndex)
+		{
+			x.m_vCoins.resize(g.m_vCoins.size());
+			m_vOutput0.push_back(m_vOutputs.size());
 
-		for (size_t iC = 0; iC < m_vCoins.size(); iC++)
+			for (size_t iC = 0; iC < x.m_vCoins.size(); iC++)
+			{
+				const Request::Group::Coin& c0 = g.m_vCoins[iC];
+				Coin& c = x.m_vCoins[iC];
+
+				c.m_pOutput.reset(new Output);
+				c.m_pOutput->m_Incubation = c0.m_Incubation;
+
+				Key::IDV kidv(Zero);
+				kidv.m_Idx = nIndex++;
+				kidv.m_Type = FOURCC_FROM(Tres);
+				kidv.m_Value = c0.m_Value;
+
+				m_vOutputs.push_back(c.m_pOutput.get());
+				m_vKidv.push_back(kidv);
+			}
+
+			m_vKrnIdx.push_back(nIndex++);
+		}
+
+		void CreateOutputs(Key::IKdf& kdf)
 		{
-			const Request::Group::Coin& c0 = g.m_vCoins[iC];
-			Coin& c = m_vCoins[iC];
+			m_vSk.resize(m_vOutputs.size());
+			if (!m_vOutputs.empty())
+				Output::CreateMany(&m_vOutputs.front(), &m_vSk.front(), &m_vKidv.front(), m_vOutputs.size(), kdf, kdf);
+		}
 
-			c.m_pOutput.reset(new Output);
-			c.m_pOutput->m_Incubation = c0.m_Incubation;
+		void Finalize(Group& x, size_t iGroup, Key::IKdf& kdf) const;
+	};
 
-			Key::IDV kidv(Zero);
-			kidv.m_Idx = nIndex++;
-			kidv.m_Type = FOURCC_FROM(Tres);
-			kidv.m_Value = c0.m_Value;
+	void Treasury::Response::Group::Create(const Request::Group& g, Key::IKdf& kdf, uint64_t& nIndex)
+	{
+		Creator c;
+		c.Add(*this, g, nIndex);
+		c.CreateOutputs(kdf);
+		c.Finalize(*this, 0, kdf);
+	}
+
+	void Treasury::Response::Group::Creator::Finalize(Group& x, size_t iGroup, Key::IKdf& kdf) const
+	{
+		Scalar::Native sk, offset = Zero;
+
+		for (size_t iC = 0; iC < x.m_vCoins.size(); iC++)
+		{
+			Coin& c = x.m_vCoins[iC];
+			size_t iOutput = m_vOutput0[iGroup] + iC;
+			assert(c.m_pOutput.get() == m_vOutputs[iOutput]);
 
-			c.m_pOutput->Create(sk, kdf, kidv, kdf);
+			sk = m_vSk[iOutput];
 			offset += sk;
 
 			Hash::Value hv;
@@ -193,15 +183,14 @@ namespace beam
 			c.m_Sig.Sign(hv, sk);
 		}
 
-		kdf.DeriveKey(sk, Key::ID(nIndex++, FOURCC_FROM(KeR3)));
+		kdf.DeriveKey(sk, Key::ID(m_vKrnIdx[iGroup], FOURCC_FROM(KeR3)));
 
-		m_pKernel.reset(new TxKernel);
-		m_pKernel->Sign(sk);
+		x.m_pKernel.reset(new TxKernel);
+		x.m_pKernel->Sign(sk);
 		offset += sk;
 
 		offset = -offset;
-		m_Base.m_Offset = offset;
-
+		x.m_Base.m_Offset = offset;
 	}
 
 	bool Treasury::Response::Group::IsValid(const Request::Group& g) const
@@ -277,41 +266,36 @@ namespace beam
 
 		m_vGroups.resize(r.m_vGroups.size());
 
+		// groups are usually small (often a single coin), create the outputs of all the groups at once
+		Group::Creator c;
+
+		for (size_t iG = 0; iG < m_vGroups.size(); iG++)
+			c.Add(m_vGroups[iG], r.m_vGroups[iG], nIndex);
+
+		c.CreateOutputs(kdf);
+
+		// the coin signatures and the kernels are independent per group
 		struct Context
 			:public ThreadPool::Context
 		{
-			const Request& m_Req;
+			const Group::Creator& m_Creator;
 			Response& m_Resp;
 			Key::IKdf& m_Kdf;
-			uint64_t m_Index0;
 
-			Context(const Request& req, Response& resp, Key::IKdf& kdf, uint64_t nIndex)
-				:m_Req(req)
+			Context(const Group::Creator& c, Response& resp, Key::IKdf& kdf)
+				:m_Creator(c)
 				,m_Resp(resp)
 				,m_Kdf(kdf)
-				,m_Index0(nIndex)
 			{}
 
-			uint64_t get_IndexAt(size_t iG) const
-			{
-				uint64_t nIndex = m_Index0;
-				for (size_t i = 0; i < iG; i++)
-					nIndex += m_Req.m_vGroups[i].m_vCoins.size() + 1;
-
-				return nIndex;
-			}
-
 			virtual void Do(size_t iTask) override
 			{
-				uint64_t nIndex = get_IndexAt(iTask);
-				m_Resp.m_vGroups[iTask].Create(m_Req.m_vGroups[iTask], m_Kdf, nIndex);
-				assert(get_IndexAt(iTask + 1) == nIndex);
+				m_Creator.Finalize(m_Resp.m_vGroups[iTask], iTask, m_Kdf);
 			}
 
-		} ctx(r, *this, kdf, nIndex);
+		} ctx(c, *this, kdf);
 
 		ctx.DoAll(m_vGroups.size());
-		nIndex = ctx.get_IndexAt(m_vGroups.size());
 
 		Hash::Value hv;
 		HashOutputs(hv);
@@ -327,7 +311,7 @@ namespace beam
 			return false;
 
 		struct Context
-			:public ThreadPool::Verifier
+			:public Verifier
 		{
 			const Request& m_Req;
 			const Response& m_Resp;
@@ -394,14 +378,23 @@ namespace beam
 	}
 
 	bool Treasury::Data::Group::IsValid() const
+	{
+		TxBase::Context ctx;
+		return
+			ValidatePart(ctx) &&
+			IsValidTotal(ctx);
+	}
+
+	bool Treasury::Data::Group::ValidatePart(TxBase::Context& ctx) const
 	{
 		Mode::Scope scope(Mode::Fast);
 
-		TxBase::Context ctx;
 		ZeroObject(ctx.m_Height); // current height is zero
-		if (!ctx.ValidateAndSummarize(m_Data, m_Data.get_Reader()))
-			return false;
+		return ctx.ValidateAndSummarize(m_Data, m_Data.get_Reader());
+	}
 
+	bool Treasury::Data::Group::IsValidTotal(TxBase::Context& ctx) const
+	{
 		if (!(ctx.m_Fee == Zero))
 			return false; // doesn't make sense for treasury
 
@@ -413,22 +406,53 @@ namespace beam
 
 	bool Treasury::Data::IsValid() const
 	{
-		// finalize
+		// There are few groups, but each is large. Split each group between all the threads, each part uses its own batch,
+		// then merge the parts of each group.
+		uint32_t nParts = std::thread::hardware_concurrency();
+		if (!nParts)
+			nParts = 1;
+
 		struct Context
-			:public ThreadPool::Verifier
+			:public Verifier
 		{
 			const Data& m_Data;
-			Context(const Data& d) :m_Data(d) {}
+			uint32_t m_nParts;
+			std::vector<TxBase::Context> m_vCtx;
+
+			Context(const Data& d, uint32_t nParts)
+				:m_Data(d)
+				,m_nParts(nParts)
+				,m_vCtx(d.m_vGroups.size() * nParts)
+			{
+			}
 
 			virtual bool Verify(size_t iTask) override
 			{
-				return m_Data.m_vGroups[iTask].IsValid();
+				TxBase::Context& ctx = m_vCtx[iTask];
+				ctx.m_nVerifiers = m_nParts;
+				ctx.m_iVerifier = static_cast<uint32_t>(iTask % m_nParts);
+
+				return m_Data.m_vGroups[iTask / m_nParts].ValidatePart(ctx);
 			}
 
-		} ctx(*this);
+		} ctx(*this, nParts);
 
-		ctx.DoAll(m_vGroups.size());
-		return ctx.m_bValid;
+		ctx.DoAll(ctx.m_vCtx.size());
+		if (!ctx.m_bValid)
+			return false;
+
+		for (size_t iG = 0; iG < m_vGroups.size(); iG++)
+		{
+			TxBase::Context& ctx0 = ctx.m_vCtx[iG * nParts];
+			for (uint32_t i = 1; i < nParts; i++)
+				if (!ctx0.Merge(ctx.m_vCtx[iG * nParts + i]))
+					return false;
+
+			if (!m_vGroups[iG].IsValidTotal(ctx0))
+				return false;
+		}
+
+		return true;
 	}
 
 	void Treasury::Build(Data& d) const
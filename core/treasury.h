@@ -99,6 +99,7 @@ namespace beam
 				}
 
 				struct Reader;
+				struct Creator;
 
 				bool IsValid(const Request::Group&) const;
 				void Create(const Request::Group&, Key::IKdf&, uint64_t& nIndex);
@@ -157,6 +158,11 @@ namespace beam
 
 				bool IsValid() const;
 
+				// Partial validation, for parallel processing. Each verifier (ctx.m_nVerifiers, ctx.m_iVerifier) handles its share of the elements.
+				// The merged result is finalized by IsValidTotal()
+				bool ValidatePart(TxBase::Context&) const;
+				bool IsValidTotal(TxBase::Context&) const;
+
 				template <typename Archive>
 				void serialize(Archive& ar)
 				{
@@ -199,7 +205,7 @@ namespace beam
 			ar & m_Entries;
 		}
 
-		class ThreadPool;
+		struct Verifier;
 	};
 
 }
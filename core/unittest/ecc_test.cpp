@@ -21,6 +21,12 @@
 #include "../aes.h"
 #include "../proto.h"
 
+#ifdef ECC_BENCH
+#	include <thread>
+#	include <fstream>
+#	include "nlohmann/json.hpp"
+#endif // ECC_BENCH
+
 #if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
 #pragma GCC diagnostic ignored "-Wunused-result"
 #endif
@@ -389,6 +395,143 @@ void TestPoints()
 	p1 = -p1;
 	p1 += p0;
 	verify_test(p1 == Zero);
+
+	// batch export, must be the same as individual. Non-normalized (z != 1) points, some zeroes, a couple of chunks
+	const uint32_t nBatch = 150;
+	std::vector<Point::Native> vPts(nBatch);
+	std::vector<Point> vRes(nBatch);
+
+	for (uint32_t i = 0; i < nBatch; i++)
+	{
+		if (i % 37)
+		{
+			SetRandom(s0);
+			vPts[i] = Context::get().G * s0;
+			vPts[i] += p0;
+		}
+		else
+			vPts[i] = Zero;
+	}
+
+	Point::Native::ExportBatch(&vRes.front(), &vPts.front(), nBatch);
+
+	for (uint32_t i = 0; i < nBatch; i++)
+	{
+		p_ = vPts[i];
+		verify_test(p_ == vRes[i]);
+	}
+}
+
+void TestMultiMac()
+{
+	Mode::Scope scope(Mode::Fast);
+
+	const int nCasual = 300;
+	const int nPrepared = 5;
+
+	typedef MultiMac_WithBufs<nCasual, nPrepared> MyMultiMac;
+	std::unique_ptr<MyMultiMac> pMm(new MyMultiMac);
+
+	Scalar::Native s0 = 1U;
+	Point::Native g = Context::get().G * s0;
+
+	for (int i = 0; i < nCasual; i++)
+	{
+		Scalar::Native k;
+		switch (i % 50)
+		{
+		case 0: k = Zero; break;
+		case 1: k = 1U; break;
+		case 2: k = 1U; k = -k; break; // max scalar
+		default: SetRandom(k);
+		}
+
+		Scalar::Native s;
+		SetRandom(s);
+		Point::Native pt = g * s;
+
+		pMm->m_pCasual[i].Init(pt, k);
+		pMm->m_Casual++;
+	}
+
+	for (int i = 0; i < nPrepared; i++)
+	{
+		pMm->m_ppPrepared[i] = &Context::get().m_Ipp.m_pGen_[0][i];
+		SetRandom(pMm->m_pKPrep[i]);
+		pMm->m_Prepared++;
+	}
+
+	int nMinCasual = MultiMac::s_PippengerMinCasual;
+	bool bEndomorphism = MultiMac::s_bEndomorphism;
+
+	// all the methods must agree, for all the counts
+	for (int n = 1; n <= nCasual; n = n * 3 + 1)
+	{
+		pMm->m_Casual = n;
+		Point p0, p1;
+		Point::Native res;
+
+		MultiMac::s_bEndomorphism = false;
+		MultiMac::s_PippengerMinCasual = n + 1; // Straus
+		pMm->Calculate(res);
+		res.Export(p0);
+
+		MultiMac::s_bEndomorphism = true;
+		pMm->Calculate(res);
+		res.Export(p1);
+		verify_test(p0 == p1);
+
+		MultiMac::s_PippengerMinCasual = n; // Pippenger
+		pMm->Calculate(res);
+		res.Export(p1);
+		verify_test(p0 == p1);
+	}
+
+	MultiMac::s_PippengerMinCasual = nMinCasual;
+
+	// endomorphism vs plain, single point, random and edge scalars
+	for (int i = 0; i < 300; i++)
+	{
+		Scalar::Native k;
+		switch (i)
+		{
+		case 0: k = Zero; break;
+		case 1: k = 1U; break;
+		case 2: k = 1U; k = -k; break;
+		default: SetRandom(k);
+		}
+
+		Point p0, p1;
+		Point::Native res;
+
+		MultiMac::s_bEndomorphism = false;
+		res = g * k;
+		res.Export(p0);
+
+		MultiMac::s_bEndomorphism = true;
+		res = g * k;
+		res.Export(p1);
+		verify_test(p0 == p1);
+
+		res = Context::get().G * k; // prepared, compare with the casual
+		res.Export(p1);
+		verify_test(p0 == p1);
+	}
+
+	MultiMac::s_bEndomorphism = bEndomorphism;
+}
+
+void TestContext()
+{
+	// the context in use may be precomputed at build time. Must be identical to the runtime derivation
+	const size_t nWords = (sizeof(Context) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	std::unique_ptr<uint64_t[]> pBuf(new uint64_t[nWords]());
+
+	Context& ctx = *reinterpret_cast<Context*>(pBuf.get());
+	Context::Derive(ctx);
+
+	verify_test(ctx.m_hvChecksum == Context::get().m_hvChecksum);
+	verify_test(!memcmp(&ctx, &Context::get(), sizeof(Context)));
 }
 
 void TestSigning()
@@ -1096,6 +1239,44 @@ void TestKdf()
 	seed.Inc();
 	skdf2.Generate(seed);
 	verify_test(!skdf2.IsSame(skdf));
+
+	// the prepared HMAC states must not affect the result. Compare against the plain RFC-5869 computation
+	{
+		NonceGenerator ng("test-salt");
+		ng << seed;
+
+		Hash::Value prk, okm;
+		Hash::Mac hmac("test-salt", sizeof("test-salt"));
+		hmac.Write(seed.m_pData, seed.nBytes);
+		hmac >> prk;
+
+		for (uint8_t i = 1; i <= 3; i++)
+		{
+			Hash::Mac hmac2(prk.m_pData, prk.nBytes);
+			if (i > 1)
+				hmac2.Write(okm.m_pData, okm.nBytes);
+			hmac2.Write(&i, sizeof(i));
+			hmac2 >> okm;
+
+			verify_test(ng.get_Okm() == okm);
+		}
+	}
+
+	{
+		HKdf::Packed p;
+		skdf.Export(p);
+
+		Hash::Value hv;
+		Hash::Processor() << "test_kdf" >> hv;
+
+		Scalar::Native sk0, sk1;
+		skdf.DerivePKey(sk0, hv);
+		NonceGenerator("beam-Key") << p.m_Secret << hv >> sk1;
+		verify_test(Scalar(sk0) == Scalar(sk1));
+
+		pkdf2.DerivePKey(sk0, hv);
+		verify_test(Scalar(sk0) == Scalar(sk1));
+	}
 }
 
 void TestBbs()
@@ -1245,6 +1426,59 @@ void TestFourCC()
 	TEST_FOURCC(h)
 }
 
+void TestCreateMany()
+{
+	HKdf kdf;
+	uintBig seed;
+	SetRandom(seed);
+	kdf.Generate(seed);
+
+	const uint32_t nCount = 5;
+
+	Key::IDV pKidv[nCount];
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		pKidv[i] = Key::IDV(100 + i, i + 1, Key::Type::Regular);
+	}
+
+	// must be the same regardless to the number of threads, and the same as created individually.
+	// Except the rangeproofs themselves, those are randomized anyway (tau1, tau2 blinding)
+	beam::Output pOut[3][nCount];
+	Scalar::Native pSk[3][nCount];
+
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		pOut[0][i].m_Incubation = i;
+		pOut[0][i].Create(pSk[0][i], kdf, pKidv[i], kdf);
+	}
+
+	for (uint32_t j = 1; j < 3; j++)
+	{
+		beam::Output* ppOut[nCount];
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			pOut[j][i].m_Incubation = i;
+			ppOut[i] = pOut[j] + i;
+		}
+
+		beam::Output::CreateMany(ppOut, pSk[j], pKidv, nCount, kdf, kdf, (1 == j) ? 1 : 3);
+
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			verify_test(pSk[j][i] == pSk[0][i]);
+			verify_test(pOut[j][i].m_Commitment == pOut[0][i].m_Commitment);
+			verify_test(pOut[j][i].m_Incubation == pOut[0][i].m_Incubation);
+
+			Point::Native comm;
+			verify_test(pOut[j][i].IsValid(comm));
+
+			Key::IDV kidv;
+			verify_test(pOut[j][i].Recover(kdf, kidv));
+			verify_test(kidv == pKidv[i]);
+		}
+	}
+}
+
 void TestTreasury()
 {
 	beam::Treasury::Parameters pars;
@@ -1324,6 +1558,18 @@ void TestTreasury()
 	verify_test(data.m_sCustomMsg == msg);
 	verify_test(data.IsValid());
 
+	for (size_t iG = 0; iG < data.m_vGroups.size(); iG++)
+		verify_test(data.m_vGroups[iG].IsValid());
+
+	// the groups are verified in parts, make sure the merged result is still checked
+	data.m_vGroups.back().m_Value += beam::uintBigFrom(beam::Amount(1));
+	verify_test(!data.IsValid());
+
+	data.m_vGroups.clear();
+	der1.reset(ser1.buffer().first, ser1.buffer().second);
+	der1 & data;
+	verify_test(data.IsValid());
+
 	for (uint32_t i = 0; i < nPeers; i++)
 	{
 		std::vector<beam::Treasury::Data::Coin> vCoins;
@@ -1338,6 +1584,8 @@ void TestAll()
 	TestHash();
 	TestScalars();
 	TestPoints();
+	TestMultiMac();
+	TestContext();
 	TestSigning();
 	TestCommitments();
 	TestRangeProof(false);
@@ -1350,9 +1598,56 @@ void TestAll()
 	TestDifficulty();
 	TestRandom();
 	TestFourCC();
+	TestCreateMany();
 	TestTreasury();
 }
 
+#ifdef ECC_BENCH
+
+struct BenchmarkConfig
+{
+	double m_Duration_s; // per kernel
+	uint64_t m_Iterations; // if specified - each kernel runs the specified number of operations, instead of the duration
+	uint32_t m_Threads; // for multi-threaded kernels. 0 = all the cores
+	bool m_bQuiet;
+
+	struct Result
+	{
+		std::string m_sName;
+		double m_us; // per operation
+	};
+
+	std::vector<Result> m_vResults;
+
+	BenchmarkConfig()
+		:m_Duration_s(1.)
+		,m_Iterations(0)
+		,m_Threads(0)
+		,m_bQuiet(false)
+	{
+	}
+
+	uint32_t get_Threads() const
+	{
+		if (m_Threads)
+			return m_Threads;
+
+		uint32_t n = std::thread::hardware_concurrency();
+		return n ? n : 1;
+	}
+
+} g_Bench;
+
+template <typename TFunc>
+void RunBenchThreads(uint32_t nThreads, const TFunc& func)
+{
+	std::vector<std::thread> vThreads(nThreads);
+	for (uint32_t i = 0; i < nThreads; i++)
+		vThreads[i] = std::thread(func, i);
+
+	for (uint32_t i = 0; i < nThreads; i++)
+		vThreads[i].join();
+}
 
 struct BenchmarkMeter
 {
@@ -1404,19 +1699,61 @@ struct BenchmarkMeter
 		m_Cycles += N;
 
 		double dt_s = double(get_Time() - m_Start) / double(m_Freq);
-		if (dt_s >= 1.)
+		if (g_Bench.m_Iterations ? (m_Cycles >= g_Bench.m_Iterations) : (dt_s >= g_Bench.m_Duration_s))
 		{
-			printf("%-24s: %.2f us\n", m_sz, dt_s * 1e6 / double(m_Cycles));
+			BenchmarkConfig::Result res;
+			res.m_sName = m_sz;
+			res.m_us = dt_s * 1e6 / double(m_Cycles);
+			g_Bench.m_vResults.push_back(res);
+
+			if (!g_Bench.m_bQuiet)
+				printf("%-24s: %.2f us\n", m_sz, res.m_us);
 			return false;
 		}
 
-		if (dt_s < 0.5)
-			N <<= 1;
+		if (g_Bench.m_Iterations)
+		{
+			uint64_t nLeft = g_Bench.m_Iterations - m_Cycles;
+			if (N > nLeft)
+				N = static_cast<uint32_t>(nLeft);
+		}
+		else
+			if (dt_s < g_Bench.m_Duration_s * 0.5)
+				N <<= 1;
 
 		return true;
 	}
 };
 
+template <uint32_t nBatch>
+void RunBatchVerify(const RangeProof::Confidential& bp, const Point::Native& comm)
+{
+	char sz[0x40];
+	snprintf(sz, sizeof(sz), "BulletProof.Verify x%u", nBatch);
+
+	BenchmarkMeter bm(sz);
+	bm.N = nBatch;
+
+	typedef InnerProduct::BatchContextEx<nBatch> MyBatch;
+	std::unique_ptr<MyBatch> p(new MyBatch);
+	p->m_bEnableBatch = true;
+
+	InnerProduct::BatchContext::Scope scope(*p);
+
+	do
+	{
+		for (uint32_t i = 0; i < bm.N; )
+		{
+			Oracle oracle;
+			bp.IsValid(comm, oracle);
+
+			if (!(++i % nBatch) || (i == bm.N))
+				verify_test(p->Flush());
+		}
+
+	} while (bm.ShouldContinue());
+}
+
 void RunBenchmark()
 {
 	Scalar::Native k1, k2;
@@ -1598,6 +1935,22 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	{
+		// per 64 points, compare with point.Export x64
+		Point::Native pPts[64];
+		Point pRes[_countof(pPts)];
+		for (uint32_t i = 0; i < _countof(pPts); i++)
+			pPts[i] = p0 * Two;
+
+		BenchmarkMeter bm("point.ExportBatch-64");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				Point::Native::ExportBatch(pRes, pPts, _countof(pPts));
+
+		} while (bm.ShouldContinue());
+	}
+
 	{
 		BenchmarkMeter bm("point.Import");
 		do
@@ -1666,6 +2019,24 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	{
+		std::vector<uint8_t> vBuf(0x100000);
+		GenerateRandom(&vBuf.front(), static_cast<uint32_t>(vBuf.size()));
+
+		BenchmarkMeter bm("Hash.1MB");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Hash::Processor()
+					<< beam::Blob(&vBuf.front(), static_cast<uint32_t>(vBuf.size()))
+					>> hv;
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
 	Hash::Processor() << "abcd" >> hv;
 
 	Signature sig;
@@ -1763,34 +2134,214 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
-	{
-		BenchmarkMeter bm("BulletProof.Verify x100");
+	RunBatchVerify<10>(bp, comm);
+	RunBatchVerify<100>(bp, comm);
+	RunBatchVerify<1000>(bp, comm);
 
+	{
+		// throughput of batch verification on all the threads, per proof
 		const uint32_t nBatch = 100;
-		bm.N = 10 * nBatch;
+		const uint32_t nThreads = g_Bench.get_Threads();
 
-		typedef InnerProduct::BatchContextEx<100> MyBatch;
-		std::unique_ptr<MyBatch> p(new MyBatch);
-		p->m_bEnableBatch = true;
-
-		InnerProduct::BatchContext::Scope scope(*p);
+		char sz[0x40];
+		snprintf(sz, sizeof(sz), "BulletProof.Verify x%u MT-%u", nBatch, nThreads);
 
+		BenchmarkMeter bm(sz);
+		bm.N = nBatch * nThreads;
 		do
 		{
-			for (uint32_t i = 0; i < bm.N; i += nBatch)
+			RunBenchThreads(nThreads, [&](uint32_t iThread)
 			{
-				for (uint32_t n = 0; n < nBatch; n++)
+				typedef InnerProduct::BatchContextEx<nBatch> MyBatch;
+				std::unique_ptr<MyBatch> p(new MyBatch);
+				p->m_bEnableBatch = true;
+
+				InnerProduct::BatchContext::Scope scope(*p);
+
+				uint32_t i0 = static_cast<uint32_t>(uint64_t(bm.N) * iThread / nThreads);
+				uint32_t i1 = static_cast<uint32_t>(uint64_t(bm.N) * (iThread + 1) / nThreads);
+
+				for (uint32_t i = i0; i < i1; )
 				{
 					Oracle oracle;
 					bp.IsValid(comm, oracle);
+
+					if (!(++i % nBatch) || (i == i1))
+						verify_test(p->Flush());
 				}
+			});
 
-				verify_test(p->Flush());
+		} while (bm.ShouldContinue());
+	}
+
+	{
+		// parallel creation of many outputs, per output
+		const uint32_t nThreads = g_Bench.get_Threads();
+
+		HKdf kdf;
+		uintBig seed;
+		SetRandom(seed);
+		kdf.Generate(seed);
+
+		char sz[0x40];
+		snprintf(sz, sizeof(sz), "Output.CreateMany MT-%u", nThreads);
+
+		BenchmarkMeter bm(sz);
+		bm.N = nThreads;
+		do
+		{
+			std::vector<beam::Output> vOuts(bm.N);
+			std::vector<beam::Output*> vPtrs(bm.N);
+			std::vector<Scalar::Native> vSk(bm.N);
+			std::vector<Key::IDV> vKidv(bm.N);
+
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				vPtrs[i] = &vOuts[i];
+				vKidv[i] = Key::IDV(100, i, Key::Type::Regular);
 			}
 
+			if (bm.N)
+				beam::Output::CreateMany(&vPtrs.front(), &vSk.front(), &vKidv.front(), bm.N, kdf, kdf, nThreads);
+
 		} while (bm.ShouldContinue());
 	}
 
+	{
+		// negative match: scanning a synthetic block of foreign outputs against a viewer key, per output.
+		// Only the commitment (which seeds the derivation) varies, the proof is the same.
+		const uint32_t nBlock = 100000;
+
+		HKdf kdfOwner, kdfForeign;
+		uintBig seed;
+		SetRandom(seed);
+		kdfOwner.Generate(seed);
+		SetRandom(seed);
+		kdfForeign.Generate(seed);
+
+		HKdfPub pkdf;
+		pkdf.GenerateFrom(kdfOwner);
+
+		beam::Output outp;
+		Scalar::Native sk;
+		outp.Create(sk, kdfForeign, Key::IDV(100, 1, Key::Type::Regular), kdfForeign);
+
+		std::vector<Point> vComm(nBlock);
+		for (uint32_t i = 0; i < nBlock; i++)
+		{
+			SetRandom(vComm[i].m_X);
+			vComm[i].m_Y = 0;
+		}
+
+		BenchmarkMeter bm("Output.Recover(foreign) x100k");
+		bm.N = nBlock;
+
+		uint32_t iComm = 0;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				outp.m_Commitment = vComm[iComm];
+				if (++iComm == nBlock)
+					iComm = 0;
+
+				Key::IDV kidv;
+				verify_test(!outp.Recover(pkdf, kidv));
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	{
+		// same, without the endomorphism
+		bool bEndomorphism = MultiMac::s_bEndomorphism;
+		MultiMac::s_bEndomorphism = false;
+
+		{
+			BenchmarkMeter bm("point.Multiply.Avg.NoEndo");
+			do
+			{
+				SetRandom(k1);
+				for (uint32_t i = 0; i < bm.N; i++)
+					p0 = p1 * k1;
+
+			} while (bm.ShouldContinue());
+		}
+
+		{
+			BenchmarkMeter bm("signature.Verify.NoEndo");
+			do
+			{
+				for (uint32_t i = 0; i < bm.N; i++)
+					sig.IsValid(hv, p1);
+
+			} while (bm.ShouldContinue());
+		}
+
+		{
+			BenchmarkMeter bm("BulletProof.Verify.NoEndo");
+			bm.N = 10;
+			do
+			{
+				for (uint32_t i = 0; i < bm.N; i++)
+				{
+					Oracle oracle;
+					bp.IsValid(comm, oracle);
+				}
+
+			} while (bm.ShouldContinue());
+		}
+
+		MultiMac::s_bEndomorphism = bEndomorphism;
+	}
+
+	{
+		// MultiMac casual points, per-point cost of both methods
+		const int nMaxCasual = 4096;
+		typedef MultiMac_WithBufs<nMaxCasual, 1> MyMultiMac;
+		std::unique_ptr<MyMultiMac> pMm(new MyMultiMac);
+
+		Mode::Scope scope(Mode::Fast);
+		Scalar::Native s0 = 1U;
+		Point::Native g = Context::get().G * s0;
+
+		int nMinCasual = MultiMac::s_PippengerMinCasual;
+
+		for (int n = 16; n <= nMaxCasual; n <<= 2)
+		{
+			for (; pMm->m_Casual < n; pMm->m_Casual++)
+			{
+				Scalar::Native k;
+				SetRandom(k);
+				pMm->m_pCasual[pMm->m_Casual].Init(g * k, k);
+			}
+
+			for (int iMethod = 0; iMethod < 2; iMethod++)
+			{
+				MultiMac::s_PippengerMinCasual = iMethod ? n : (n + 1);
+
+				char sz[0x40];
+				snprintf(sz, sizeof(sz), "MultiMac.%s x%d", iMethod ? "Pippenger" : "Straus", n);
+
+				BenchmarkMeter bm(sz);
+				bm.N = 1;
+				do
+				{
+					for (uint32_t i = 0; i < bm.N; i++)
+					{
+						Point::Native res;
+						for (int j = 0; j < n; j++)
+							pMm->m_pCasual[j].m_nPrepared = 1; // Straus caches odd multiples, reset them
+						pMm->Calculate(res);
+					}
+
+				} while (bm.ShouldContinue());
+			}
+		}
+
+		MultiMac::s_PippengerMinCasual = nMinCasual;
+	}
+
 	{
 		AES::Encoder enc;
 		enc.Init(hv.m_pData);
@@ -1812,6 +2363,23 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	{
+		// No solution at hand (solving takes about a minute), so the indices are random and the verification
+		// fails at the 1st collision check. Still, this includes the hashing of all the indices, which dominates.
+		beam::Block::PoW pow;
+		pow.m_Difficulty = 0;
+		GenerateRandom(&pow.m_Indices.front(), static_cast<uint32_t>(pow.m_Indices.size()));
+		SetRandomOrd(pow.m_Nonce);
+
+		BenchmarkMeter bm("Equihash.Verify(reject)");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				verify_test(!pow.IsValid(hv.m_pData, hv.nBytes));
+
+		} while (bm.ShouldContinue());
+	}
+
 	{
 		uint8_t pBuf[0x400];
 
@@ -1851,16 +2419,158 @@ void RunBenchmark()
 }
 
 
+void SaveBenchmark(std::ostream& os)
+{
+	nlohmann::json jRes = nlohmann::json::object();
+	for (const BenchmarkConfig::Result& res : g_Bench.m_vResults)
+		jRes[res.m_sName] = res.m_us;
+
+	nlohmann::json j;
+	j["config"]["duration"] = g_Bench.m_Duration_s;
+	j["config"]["iterations"] = g_Bench.m_Iterations;
+	j["config"]["threads"] = g_Bench.get_Threads();
+	j["results_us"] = jRes;
+
+	os << j.dump(4) << std::endl;
+}
+
+// returns the number of regressions, i.e. kernels slower than the baseline by more than the tolerance
+uint32_t CompareBenchmark(const nlohmann::json& jBase, double dTolerance)
+{
+	const nlohmann::json& jRes = jBase["results_us"];
+	uint32_t nRegressions = 0;
+
+	printf("%-32s %12s %12s %8s\n", "kernel", "baseline,us", "current,us", "delta");
+
+	for (const BenchmarkConfig::Result& res : g_Bench.m_vResults)
+	{
+		auto it = jRes.find(res.m_sName);
+		if (jRes.end() == it)
+		{
+			printf("%-32s %12s %12.2f\n", res.m_sName.c_str(), "-", res.m_us);
+			continue;
+		}
+
+		double us0 = it->get<double>();
+		double dDelta = (us0 > 0) ? (res.m_us / us0 - 1.) : 0.;
+
+		bool bRegression = (dDelta > dTolerance);
+		if (bRegression)
+			nRegressions++;
+
+		printf("%-32s %12.2f %12.2f %+7.1f%%%s\n", res.m_sName.c_str(), us0, res.m_us, dDelta * 100., bRegression ? " <-- regression" : "");
+	}
+
+	return nRegressions;
+}
+
+#endif // ECC_BENCH
+
 } // namespace ECC
 
+#ifdef ECC_BENCH
+
+int main(int argc, char* argv[])
+{
+	const char* szJson = nullptr;
+	const char* szBaseline = nullptr;
+	double dTolerance = 0.1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string sArg = argv[i];
+		const char* szVal = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+		if (szVal && ("--duration" == sArg))
+			ECC::g_Bench.m_Duration_s = atof(szVal);
+		else if (szVal && ("--iterations" == sArg))
+			ECC::g_Bench.m_Iterations = strtoull(szVal, nullptr, 10);
+		else if (szVal && ("--threads" == sArg))
+			ECC::g_Bench.m_Threads = atoi(szVal);
+		else if (szVal && ("--json" == sArg))
+			szJson = szVal;
+		else if (szVal && ("--baseline" == sArg))
+			szBaseline = szVal;
+		else if (szVal && ("--tolerance" == sArg))
+			dTolerance = atof(szVal) / 100.;
+		else
+		{
+			printf(
+				"Usage: ecc_bench [options]\n"
+				"  --duration <sec>     time per kernel (default 1)\n"
+				"  --iterations <n>     fixed number of operations per kernel, overrides the duration\n"
+				"  --threads <n>        threads for the multi-threaded kernels (default all the cores)\n"
+				"  --json <file|->      save the results as json ('-' for stdout)\n"
+				"  --baseline <file>    compare with the previously saved results\n"
+				"  --tolerance <pct>    allowed slowdown vs baseline (default 10)\n");
+			return 1;
+		}
+
+		i++;
+	}
+
+	nlohmann::json jBase;
+	if (szBaseline)
+	{
+		std::ifstream is(szBaseline);
+		if (!is)
+		{
+			printf("Can't open %s\n", szBaseline);
+			return 1;
+		}
+
+		try {
+			is >> jBase;
+		} catch (const std::exception& e) {
+			printf("Baseline parse error: %s\n", e.what());
+			return 1;
+		}
+	}
+
+	bool bJsonStdout = szJson && !strcmp(szJson, "-");
+	ECC::g_Bench.m_bQuiet = bJsonStdout;
+
+	g_psecp256k1 = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+
+	ECC::RunBenchmark();
+
+	secp256k1_context_destroy(g_psecp256k1);
+
+	if (szJson)
+	{
+		if (bJsonStdout)
+			ECC::SaveBenchmark(std::cout);
+		else
+		{
+			std::ofstream os(szJson);
+			ECC::SaveBenchmark(os);
+			if (!os)
+			{
+				printf("Can't write %s\n", szJson);
+				return 1;
+			}
+		}
+	}
+
+	int nRet = g_TestsFailed ? -1 : 0;
+
+	if (szBaseline && ECC::CompareBenchmark(jBase, dTolerance))
+		nRet = 2;
+
+	return nRet;
+}
+
+#else // ECC_BENCH
+
 int main()
 {
 	g_psecp256k1 = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
 
 	ECC::TestAll();
-	ECC::RunBenchmark();
 
 	secp256k1_context_destroy(g_psecp256k1);
 
     return g_TestsFailed ? -1 : 0;
 }
+
+#endif // ECC_BENCH
@@ -326,6 +326,75 @@ namespace beam
 		t.get_Hash(hv2);
 		verify_test(hv2 == hv1);
 
+		// bulk build, from the sorted keys
+		{
+			std::vector<uint32_t> vIdx(vKeys.size());
+			for (uint32_t i = 0; i < vIdx.size(); i++)
+				vIdx[i] = i;
+
+			std::sort(vIdx.begin(), vIdx.end(), [&vKeys](uint32_t a, uint32_t b) { return vKeys[a] < vKeys[b]; });
+
+			UtxoTree t3;
+			UtxoTree::Builder bld(t3);
+
+			for (uint32_t i = 0; i < vIdx.size(); i++)
+				bld.Append(vKeys[vIdx[i]])->m_Value.m_Count = vIdx[i];
+
+			// repeated key must be rejected
+			bool bThrown = false;
+			try {
+				bld.Append(vKeys[vIdx.back()]);
+			} catch (const std::exception&) {
+				bThrown = true;
+			}
+			verify_test(bThrown);
+
+			bld.Finalize();
+
+			t3.get_Hash(hv2);
+			verify_test(hv2 == hv1);
+			verify_test(vKeys.size() == t3.Count());
+		}
+
+		// bulk merge, vs element-wise insertion
+		{
+			std::vector<UtxoTree::Key> v0(vKeys.begin(), vKeys.begin() + vKeys.size() / 2);
+			std::vector<UtxoTree::Key> v1(vKeys.begin() + vKeys.size() / 3, vKeys.end()); // overlaps
+			std::sort(v0.begin(), v0.end());
+			std::sort(v1.begin(), v1.end());
+
+			UtxoTree t3, t4;
+			verify_test(t3.AddSorted(&v0.front(), v0.size()));
+			verify_test(t3.AddSorted(&v1.front(), v1.size()));
+
+			for (int iPass = 0; iPass < 2; iPass++)
+			{
+				const std::vector<UtxoTree::Key>& v = iPass ? v1 : v0;
+				for (size_t i = 0; i < v.size(); i++)
+				{
+					UtxoTree::Cursor cu;
+					bool bCreate = true;
+					UtxoTree::MyLeaf* p = t4.Find(cu, v[i], bCreate);
+					p->m_Value.m_Count = bCreate ? 1 : (p->m_Value.m_Count + 1);
+				}
+			}
+
+			t3.get_Hash(hv2);
+			t4.get_Hash(hvMid);
+			verify_test(hv2 == hvMid);
+			verify_test(t3.Count() == t4.Count());
+
+			// count overflow: all or nothing
+			UtxoTree::Cursor cu;
+			bool bCreate = false;
+			t3.Find(cu, v1.back(), bCreate)->m_Value.m_Count = static_cast<Input::Count>(-1);
+			t3.get_Hash(hv2);
+
+			verify_test(!t3.AddSorted(&v1.front(), v1.size()));
+			t3.get_Hash(hvMid);
+			verify_test(hv2 == hvMid);
+		}
+
 		// narrow traverse
 		struct Traveler
 			:public RadixTree::ITraveler
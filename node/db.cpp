@@ -1242,6 +1242,12 @@ void NodeDB::EnumStatesAt(WalkerState& x, Height h)
 	x.m_Rs.put(0, h);
 }
 
+void NodeDB::EnumActive(WalkerState& x)
+{
+	x.m_Rs.Reset(Query::EnumActive, "SELECT " TblStates_Height ",rowid FROM " TblStates " WHERE " TblStates_Flags "& ? != 0 ORDER BY " TblStates_Height);
+	x.m_Rs.put(0, StateFlags::Active);
+}
+
 void NodeDB::EnumAncestors(WalkerState& x, const StateID& sid)
 {
 	x.m_Rs.Reset(Query::EnumAncestors, "SELECT " TblStates_Height ",rowid FROM " TblStates " WHERE " TblStates_Height "=? AND " TblStates_RowPrev "=? ORDER BY " TblStates_Hash);
@@ -84,6 +84,7 @@ public:
 			EnumFunctionalTips,
 			EnumAtHeight,
 			EnumAncestors,
+			EnumActive,
 			StateGetPrev,
 			Unactivate,
 			UnactivateAll,
@@ -251,6 +252,7 @@ public:
 
 	void EnumStatesAt(WalkerState&, Height);
 	void EnumAncestors(WalkerState&, const StateID&);
+	void EnumActive(WalkerState&); // height lowest to highest
 	bool get_Prev(StateID&);
 	bool get_Prev(uint64_t&);
 
@@ -32,7 +32,8 @@ bool Node::SyncStatus::operator == (const SyncStatus& x) const
 {
 	return
 		(m_Done == x.m_Done) &&
-		(m_Total == x.m_Total);
+		(m_Total == x.m_Total) &&
+		(m_HdrsPerSec == x.m_HdrsPerSec);
 }
 
 void Node::RefreshCongestions()
@@ -43,7 +44,7 @@ void Node::RefreshCongestions()
     for (TaskSet::iterator it = m_setTasks.begin(); m_setTasks.end() != it; it++)
         it->m_hTarget = MaxHeight;
 
-    m_Processor.EnumCongestions(m_Cfg.m_MaxConcurrentBlocksRequest);
+    m_Processor.EnumCongestions(get_BlocksBacklog());
 
     for (TaskList::iterator it = m_lstTasksUnassigned.begin(); m_lstTasksUnassigned.end() != it; )
     {
@@ -124,16 +125,173 @@ void Node::UpdateSyncStatusRaw()
 	}
 
 	m_SyncStatus.m_Total = std::max(m_SyncStatus.m_Total, m_SyncStatus.m_Done);
+
+	if (m_SyncStatus.m_Done == m_SyncStatus.m_Total)
+		m_SyncStatus.m_HdrsPerSec = 0;
+}
+
+void Node::OnHdrsAccepted(uint32_t nCount)
+{
+	m_HdrRate.m_Count += nCount;
+
+	uint32_t t_ms = GetTime_ms();
+	uint32_t dt_ms = t_ms - m_HdrRate.m_Start_ms;
+
+	if (dt_ms >= 1000)
+	{
+		m_SyncStatus.m_HdrsPerSec = static_cast<uint32_t>(uint64_t(m_HdrRate.m_Count) * 1000 / dt_ms);
+
+		m_HdrRate.m_Start_ms = t_ms;
+		m_HdrRate.m_Count = 0;
+	}
 }
 
 void Node::DeleteUnassignedTask(Task& t)
 {
     assert(!t.m_pOwner && !t.m_bPack);
     m_lstTasksUnassigned.erase(TaskList::s_iterator_to(t));
-    m_setTasks.erase(TaskSet::s_iterator_to(t));
+    if (!t.m_bDuplicate)
+        m_setTasks.erase(TaskSet::s_iterator_to(t));
     delete &t;
 }
 
+uint32_t Node::get_BlocksBacklog()
+{
+    // total capacity of the peers, so that the fast ones aren't starved by the fixed limit
+    uint32_t nBacklog = 0;
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+        if (it->ShouldAssignTasks())
+            nBacklog += it->get_BlocksWindow();
+
+    return std::max(nBacklog, m_Cfg.m_BlockDownload.m_WindowInit);
+}
+
+void Node::SetDownloadTimer()
+{
+    if (m_bDownloadPending)
+        return;
+
+    if (!m_pDownloadTimer)
+        m_pDownloadTimer = io::Timer::create(io::Reactor::get_Current());
+
+    m_pDownloadTimer->start(m_Cfg.m_BlockDownload.m_CheckPeriod_ms, false, [this]() { OnDownloadTimer(); });
+    m_bDownloadPending = true;
+}
+
+void Node::OnDownloadTimer()
+{
+    m_bDownloadPending = false;
+
+    if (!m_pSync)
+    {
+        // the block the processor needs next. Normally there's only one, unless there are competing branches
+        Task tKey;
+        tKey.m_Key.first.m_Height = m_Processor.m_Cursor.m_ID.m_Height + 1;
+        tKey.m_Key.first.m_Hash = Zero;
+        tKey.m_Key.second = false;
+
+        for (TaskSet::iterator it = m_setTasks.lower_bound(tKey); m_setTasks.end() != it; )
+        {
+            Task& t = *it++;
+            if (t.m_Key.first.m_Height != tKey.m_Key.first.m_Height)
+                break;
+
+            if (t.m_Key.second && t.m_pOwner && !t.m_bPack && (MaxHeight != t.m_hTarget))
+                ReRequestStraggler(t);
+        }
+    }
+
+    uint32_t t_ms = GetTime_ms();
+    if (t_ms - m_DownloadStatsLast_ms >= m_Cfg.m_BlockDownload.m_StatsPeriod_ms)
+    {
+        m_DownloadStatsLast_ms = t_ms;
+        LogDownloadStats();
+    }
+
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+        if (it->get_BlocksInFlight())
+        {
+            SetDownloadTimer();
+            break;
+        }
+}
+
+bool Node::ReRequestStraggler(Task& t)
+{
+    Peer& p = *t.m_pOwner;
+    const Config::BlockDownload& cfg = m_Cfg.m_BlockDownload;
+
+    uint32_t dt_ms = GetTime_ms() - t.m_Sent_ms;
+    if ((dt_ms < cfg.m_StragglerMin_ms) || (dt_ms / std::max(cfg.m_StragglerFactor, 1U) < p.get_ExpectedDelivery_ms(t)))
+        return false;
+
+    std::vector<Peer*> vPeers;
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+    {
+        Peer& p2 = *it;
+        if ((&p2 != &p) && p2.ShouldAssignTasks() && (p2.get_BlocksInFlight() < p2.get_BlocksWindow()))
+            vPeers.push_back(&p2);
+    }
+
+    if (vPeers.empty())
+        return false;
+
+    std::sort(vPeers.begin(), vPeers.end(), [](const Peer* a, const Peer* b) { return a->m_Download.m_Bps > b->m_Download.m_Bps; });
+
+    // The straggler's response is still expected in order. Leave a duplicate in place of the task.
+    Task* pDup = new Task;
+    pDup->m_Key = t.m_Key;
+    pDup->m_bPack = false;
+    pDup->m_bDuplicate = true;
+    pDup->m_bIdleSent = t.m_bIdleSent;
+    pDup->m_hTarget = MaxHeight;
+    pDup->m_pOwner = &p;
+    pDup->m_Sent_ms = t.m_Sent_ms;
+    pDup->m_pCompact = std::move(t.m_pCompact);
+
+    p.m_lstTasks.insert(TaskList::s_iterator_to(t), *pDup);
+    p.m_lstTasks.erase(TaskList::s_iterator_to(t));
+    t.m_pOwner = NULL;
+    m_lstTasksUnassigned.push_back(t);
+
+    for (size_t i = 0; i < vPeers.size(); i++)
+    {
+        if (TryAssignTask(t, *vPeers[i]))
+        {
+            LOG_INFO() << "Block " << t.m_Key.first << " re-requested from " << vPeers[i]->m_RemoteAddr << ", " << p.m_RemoteAddr << " is too slow";
+            p.OnStraggler();
+            return true;
+        }
+    }
+
+    // no one else can take it
+    m_lstTasksUnassigned.erase(TaskList::s_iterator_to(t));
+    p.m_lstTasks.insert(TaskList::s_iterator_to(*pDup), t);
+    p.m_lstTasks.erase(TaskList::s_iterator_to(*pDup));
+    t.m_pOwner = &p;
+    t.m_pCompact = std::move(pDup->m_pCompact);
+    delete pDup;
+
+    return false;
+}
+
+void Node::LogDownloadStats()
+{
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+    {
+        const Peer& p = *it;
+        const Peer::Download& d = p.m_Download;
+        if (!d.m_Blocks)
+            continue;
+
+        LOG_INFO() << "Peer " << p.m_RemoteAddr << " blocks=" << d.m_Blocks << ", KB=" << (d.m_Bytes >> 10)
+            << ", KB/s=" << (d.m_Bps >> 10) << ", RTT=" << d.m_Rtt_ms << " ms, Window=" << p.get_BlocksWindow()
+            << ", InFlight=" << p.get_BlocksInFlight() << ", Stragglers=" << d.m_Stragglers;
+    }
+
+    LOG_INFO() << "Blocks downloaded=" << m_DownloadStats.m_Blocks << ", KB=" << (m_DownloadStats.m_Bytes >> 10) << ", Re-requested=" << m_DownloadStats.m_Stragglers;
+}
+
 uint32_t Node::WantedTx::get_Timeout_ms()
 {
     return get_ParentObj().m_Cfg.m_Timeout.m_GetTx_ms;
@@ -141,14 +299,11 @@ uint32_t Node::WantedTx::get_Timeout_ms()
 
 void Node::WantedTx::OnExpired(const KeyType& key)
 {
-    proto::GetTransaction msg;
-    msg.m_ID = key;
-
     for (PeerList::iterator it = get_ParentObj().m_lstPeers.begin(); get_ParentObj().m_lstPeers.end() != it; it++)
     {
         Peer& peer = *it;
         if (peer.m_LoginFlags & proto::LoginFlags::SpreadingTransactions)
-            peer.Send(msg);
+            peer.RequestTx(key);
     }
 }
 
@@ -322,10 +477,7 @@ bool Node::TryAssignTask(Task& t, Peer& p)
         return false;
 
     // check if the peer currently transfers a block
-    uint32_t nBlocks = 0;
-    for (TaskList::iterator it = p.m_lstTasks.begin(); p.m_lstTasks.end() != it; it++)
-        if (it->m_Key.second)
-            nBlocks++;
+    uint32_t nBlocks = p.get_BlocksInFlight();
 
     // assign
     uint32_t nPackSize = 0;
@@ -345,12 +497,22 @@ bool Node::TryAssignTask(Task& t, Peer& p)
 
     if (t.m_Key.second)
     {
-        if (nBlocks >= m_Cfg.m_MaxConcurrentBlocksRequest)
+        if (nBlocks >= p.get_BlocksWindow())
             return false;
 
-        proto::GetBody msg;
-        msg.m_ID = t.m_Key.first;
-        p.Send(msg);
+        if (t.m_Key.first.m_Height && !nPackSize && !m_TxPool.m_setTxs.empty() && (proto::LoginFlags::CompactBlocks & p.m_LoginFlags))
+        {
+            // close to the tip, most of the block is probably in our tx pool
+            proto::GetBodyCompact msg;
+            msg.m_ID = t.m_Key.first;
+            p.Send(msg);
+        }
+        else
+        {
+            proto::GetBody msg;
+            msg.m_ID = t.m_Key.first;
+            p.Send(msg);
+        }
     }
     else
     {
@@ -379,6 +541,8 @@ bool Node::TryAssignTask(Task& t, Peer& p)
 
     assert(!t.m_pOwner);
     t.m_pOwner = &p;
+    t.m_Sent_ms = GetTime_ms();
+    t.m_bIdleSent = bEmpty;
 
     m_lstTasksUnassigned.erase(TaskList::s_iterator_to(t));
     p.m_lstTasks.push_back(t);
@@ -386,9 +550,120 @@ bool Node::TryAssignTask(Task& t, Peer& p)
     if (bEmpty)
         p.SetTimerWrtFirstTask();
 
+    if (t.m_Key.second)
+        SetDownloadTimer();
+
     return true;
 }
 
+uint32_t Node::Peer::get_BlocksInFlight() const
+{
+    uint32_t nBlocks = 0;
+    for (TaskList::const_iterator it = m_lstTasks.begin(); m_lstTasks.end() != it; it++)
+        if (it->m_Key.second)
+            nBlocks++;
+
+    return nBlocks;
+}
+
+uint32_t Node::Peer::get_BlocksWindow() const
+{
+    const Download& d = m_Download;
+    uint32_t nWindow = d.m_Window;
+
+    if (d.m_Rtt_ms && d.m_Bps && d.m_Blocks)
+    {
+        // no point to keep in flight much more than the bandwidth-delay product
+        uint64_t nBlockSize = std::max<uint64_t>(d.m_Bytes / d.m_Blocks, 1);
+        uint64_t nBdp = uint64_t(d.m_Bps) * d.m_Rtt_ms / 1000;
+        uint64_t nLimit = 2 * nBdp / nBlockSize + 2;
+
+        if (nWindow > nLimit)
+            nWindow = static_cast<uint32_t>(nLimit);
+    }
+
+    return std::max(nWindow, 1U);
+}
+
+uint32_t Node::Peer::get_ExpectedDelivery_ms(const Task& t) const
+{
+    const Download& d = m_Download;
+    if (!d.m_Bps || !d.m_Blocks)
+        return 0; // unknown
+
+    // round trip, plus transfer of this block and those queued before it, at the observed rate
+    uint64_t nBlocks = 1;
+    for (TaskList::const_iterator it = m_lstTasks.begin(); (m_lstTasks.end() != it) && (&*it != &t); it++)
+        if (it->m_Key.second)
+            nBlocks++;
+
+    uint64_t nTransfer_ms = nBlocks * (d.m_Bytes / d.m_Blocks) * 1000 / d.m_Bps;
+    return static_cast<uint32_t>(std::min<uint64_t>(d.m_Rtt_ms + nTransfer_ms, uint32_t(-1)));
+}
+
+void Node::Peer::OnTaskResponse(const Task& t, uint32_t nSize)
+{
+    Download& d = m_Download;
+    uint32_t t_ms = GetTime_ms();
+
+    if (nSize)
+    {
+        // the pipeline was busy with this block since it was requested, or since the previous response
+        uint32_t dt_ms = std::max(std::min(t_ms - t.m_Sent_ms, t_ms - d.m_LastDone_ms), 1U);
+        uint32_t nBps = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(nSize) * 1000 / dt_ms, uint32_t(-1)));
+
+        d.m_Bps = d.m_Bps ? static_cast<uint32_t>((3ULL * d.m_Bps + nBps) / 4) : nBps;
+    }
+
+    if (t.m_bIdleSent)
+    {
+        uint32_t nRtt_ms = t_ms - t.m_Sent_ms;
+        if (nSize && d.m_Bps)
+        {
+            uint64_t nTransfer_ms = uint64_t(nSize) * 1000 / d.m_Bps;
+            nRtt_ms = (nRtt_ms > nTransfer_ms) ? static_cast<uint32_t>(nRtt_ms - nTransfer_ms) : 0;
+        }
+
+        nRtt_ms = std::max(nRtt_ms, 1U);
+        d.m_Rtt_ms = d.m_Rtt_ms ? static_cast<uint32_t>((7ULL * d.m_Rtt_ms + nRtt_ms) / 8) : nRtt_ms;
+    }
+
+    d.m_LastDone_ms = t_ms;
+}
+
+void Node::Peer::OnBlockDelivered(uint32_t nSize)
+{
+    Download& d = m_Download;
+    d.m_Blocks++;
+    d.m_Bytes += nSize;
+
+    m_This.m_DownloadStats.m_Blocks++;
+    m_This.m_DownloadStats.m_Bytes += nSize;
+
+    // slow start: +1 per delivered block, i.e. doubles per round trip. Then +1 per window.
+    if (d.m_Window < d.m_SsThresh)
+        d.m_Window++;
+    else
+        if (++d.m_Acked >= d.m_Window)
+        {
+            d.m_Acked = 0;
+            d.m_Window++;
+        }
+
+    d.m_Window = std::min(d.m_Window, m_This.m_Cfg.m_BlockDownload.m_WindowMax);
+}
+
+void Node::Peer::OnStraggler()
+{
+    Download& d = m_Download;
+    d.m_SsThresh = std::max(d.m_Window / 2, 1U);
+    d.m_Window = d.m_SsThresh;
+    d.m_Acked = 0;
+    d.m_Stragglers++;
+
+    m_This.m_DownloadStats.m_Stragglers++;
+}
+
 void Node::Peer::SetTimerWrtFirstTask()
 {
     if (m_lstTasks.empty())
@@ -412,7 +687,10 @@ void Node::Processor::RequestData(const Block::SystemState::ID& id, bool bBlock,
         pTask->m_Key = tKey.m_Key;
         pTask->m_hTarget = hTarget;
         pTask->m_bPack = false;
+        pTask->m_bDuplicate = false;
+        pTask->m_bIdleSent = false;
         pTask->m_pOwner = NULL;
+        pTask->m_Sent_ms = 0;
 
         get_ParentObj().m_setTasks.insert(*pTask);
         get_ParentObj().m_lstTasksUnassigned.push_back(*pTask);
@@ -464,12 +742,24 @@ void Node::Processor::FlushInsanePeers()
 void Node::Processor::OnNewState()
 {
     m_Cwp.Reset();
+    m_mapCwpCropped.clear();
 
     if (m_Cursor.m_Sid.m_Height < Rules::HeightGenesis)
         return;
 
     LOG_INFO() << "My Tip: " << m_Cursor.m_ID << ", Work = " << Difficulty::ToFloat(m_Cursor.m_Full.m_ChainWork);
 
+    // the block txs are about to be evicted from the pool, that's the last chance to refer to them
+    m_pCompactTip.reset();
+    if (!get_ParentObj().m_TxPool.m_setTxs.empty())
+    {
+        m_pCompactTip.reset(new CompactTip);
+        m_pCompactTip->m_ID = m_Cursor.m_ID;
+
+        if (!get_ParentObj().BuildCompact(m_pCompactTip->m_Msg, m_Cursor.m_ID))
+            m_pCompactTip.reset();
+    }
+
     //get_ParentObj().m_TxPool.DeleteOutOfBound(m_Cursor.m_Sid.m_Height + 1);
     get_ParentObj().m_Processor.DeleteOutdated(get_ParentObj().m_TxPool); // Better to delete all irrelevant txs explicitly, even if the node is supposed to mine
     // because in practice mining could be OFF (for instance, if miner key isn't defined, and owner wallet is offline).
@@ -510,19 +800,25 @@ void Node::Processor::OnRolledBack()
     get_ParentObj().m_Compressor.OnRolledBack();
 }
 
+Node::Processor::Verifier::MyBatch& Node::Processor::Verifier::PrepareBatch()
+{
+    if (m_pBc)
+        m_pBc->Reset();
+    else
+    {
+        m_pBc.reset(new Verifier::MyBatch);
+        m_pBc->m_bEnableBatch = true;
+    }
+
+    return *m_pBc;
+}
+
 bool Node::Processor::Verifier::ValidateAndSummarize(TxBase::Context& ctx, const TxBase& txb, TxBase::IReader&& r)
 {
     uint32_t nThreads = get_ParentObj().get_ParentObj().m_Cfg.m_VerificationThreads;
     if (!nThreads)
     {
-        if (m_pBc)
-            m_pBc->Reset();
-        else
-        {
-            m_pBc.reset(new Verifier::MyBatch);
-            m_pBc->m_bEnableBatch = true;
-        }
-        Verifier::MyBatch::Scope scope(*m_pBc);
+        Verifier::MyBatch::Scope scope(PrepareBatch());
 
         return
             ctx.ValidateAndSummarize(txb, std::move(r)) &&
@@ -531,6 +827,93 @@ bool Node::Processor::Verifier::ValidateAndSummarize(TxBase::Context& ctx, const
 
     std::unique_lock<std::mutex> scope(m_Mutex);
 
+    m_pHdrs = NULL;
+    m_ppOuts = NULL;
+    m_pTx = &txb;
+    m_pR = &r;
+    m_pRW = NULL;
+    m_pCtx = &ctx;
+
+    RunTask(scope);
+
+    return !m_bFail;
+}
+
+bool Node::Processor::Verifier::ValidateMacroblock(TxBase::Context& ctx, const TxBase& txb, Block::BodyBase::RW& rw)
+{
+    uint32_t nThreads = get_ParentObj().get_ParentObj().m_Cfg.m_VerificationThreads;
+    if (!nThreads)
+    {
+        Verifier::MyBatch::Scope scope(PrepareBatch());
+
+        return
+            ctx.ValidateAndSummarizeSlice(txb, rw) &&
+            m_pBc->Flush();
+    }
+
+    std::unique_lock<std::mutex> scope(m_Mutex);
+
+    m_pHdrs = NULL;
+    m_ppOuts = NULL;
+    m_pTx = &txb;
+    m_pR = &rw;
+    m_pRW = &rw;
+    m_pCtx = &ctx;
+
+    RunTask(scope);
+
+    m_pRW = NULL;
+    return !m_bFail;
+}
+
+void Node::Processor::Verifier::VerifyPoW(const Block::SystemState::Full* pHdrs, uint32_t nCount, uint8_t* pValid)
+{
+    uint32_t nThreads = get_ParentObj().get_ParentObj().m_Cfg.m_VerificationThreads;
+    if ((nThreads < 2) || (nCount < 2))
+    {
+        for (uint32_t i = 0; i < nCount; i++)
+            pValid[i] = pHdrs[i].IsValidPoW();
+        return;
+    }
+
+    std::unique_lock<std::mutex> scope(m_Mutex);
+
+    m_pHdrs = pHdrs;
+    m_pHdrValid = pValid;
+    m_nHdrs = nCount;
+    m_ppOuts = NULL;
+
+    RunTask(scope);
+
+    m_pHdrs = NULL;
+}
+
+void Node::Processor::Verifier::RecognizeOutputs(const Output* const* ppOut, uint32_t nCount, Key::IDV* pKidv, uint8_t* pFound)
+{
+    uint32_t nThreads = get_ParentObj().get_ParentObj().m_Cfg.m_VerificationThreads;
+    if ((nThreads < 2) || (nCount < 2))
+    {
+        get_ParentObj().NodeProcessor::RecognizeOutputs(ppOut, nCount, pKidv, pFound);
+        return;
+    }
+
+    std::unique_lock<std::mutex> scope(m_Mutex);
+
+    m_pHdrs = NULL;
+    m_ppOuts = ppOut;
+    m_pOutKidv = pKidv;
+    m_pOutFound = pFound;
+    m_nOuts = nCount;
+
+    RunTask(scope);
+
+    m_ppOuts = NULL;
+}
+
+void Node::Processor::Verifier::RunTask(std::unique_lock<std::mutex>& scope)
+{
+    uint32_t nThreads = get_ParentObj().get_ParentObj().m_Cfg.m_VerificationThreads;
+
     if (m_vThreads.empty())
     {
         m_iTask = 1;
@@ -541,9 +924,6 @@ bool Node::Processor::Verifier::ValidateAndSummarize(TxBase::Context& ctx, const
     }
 
     m_iTask ^= 2;
-    m_pTx = &txb;
-    m_pR = &r;
-    m_pCtx = &ctx;
     m_bFail = false;
     m_Remaining = nThreads;
 
@@ -551,8 +931,6 @@ bool Node::Processor::Verifier::ValidateAndSummarize(TxBase::Context& ctx, const
 
     while (m_Remaining)
         m_TaskFinished.wait(scope);
-
-    return !m_bFail;
 }
 
 bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr)
@@ -569,6 +947,33 @@ bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&
         ctx.IsValidBlock(block);
 }
 
+bool Node::Processor::VerifyMacroBlock(const Block::BodyBase& block, Block::BodyBase::RW& rw, const HeightRange& hr)
+{
+    if (!rw.IsIndexed())
+        return VerifyBlock(block, std::move(rw), hr); // legacy format, each verifier reads all the data
+
+    if (hr.m_Min < Rules::HeightGenesis)
+        return false;
+
+    TxBase::Context ctx;
+    ctx.m_Height = hr;
+    ctx.m_bBlockMode = true;
+
+    return
+        m_Verifier.ValidateMacroblock(ctx, block, rw) &&
+        ctx.IsValidBlock(block);
+}
+
+void Node::Processor::VerifyPoW(const Block::SystemState::Full* pHdrs, uint32_t nCount, uint8_t* pValid)
+{
+    m_Verifier.VerifyPoW(pHdrs, nCount, pValid);
+}
+
+void Node::Processor::RecognizeOutputs(const Output* const* ppOut, uint32_t nCount, Key::IDV* pKidv, uint8_t* pFound)
+{
+    m_Verifier.RecognizeOutputs(ppOut, nCount, pKidv, pFound);
+}
+
 void Node::Processor::Verifier::Thread(uint32_t iVerifier)
 {
     uint32_t nThreads = get_ParentObj().get_ParentObj().m_Cfg.m_VerificationThreads;
@@ -591,6 +996,36 @@ void Node::Processor::Verifier::Thread(uint32_t iVerifier)
             iTask = m_iTask;
         }
 
+        if (m_pHdrs)
+        {
+            // Equihash is the bottleneck of the header sync, the headers are independent
+            for (uint32_t i = iVerifier; i < m_nHdrs; i += nThreads)
+                m_pHdrValid[i] = m_pHdrs[i].IsValidPoW();
+
+            std::unique_lock<std::mutex> scope2(m_Mutex);
+
+            verify(m_Remaining--);
+            if (!m_Remaining)
+                m_TaskFinished.notify_one();
+
+            continue;
+        }
+
+        if (m_ppOuts)
+        {
+            // rangeproof recovery for each viewer key, the outputs are independent. Each thread writes its own slots only
+            for (uint32_t i = iVerifier; i < m_nOuts; i += nThreads)
+                m_pOutFound[i] = get_ParentObj().RecognizeOutput(*m_ppOuts[i], m_pOutKidv[i]);
+
+            std::unique_lock<std::mutex> scope2(m_Mutex);
+
+            verify(m_Remaining--);
+            if (!m_Remaining)
+                m_TaskFinished.notify_one();
+
+            continue;
+        }
+
         p->Reset();
 
         assert(m_Remaining);
@@ -605,7 +1040,11 @@ void Node::Processor::Verifier::Thread(uint32_t iVerifier)
         TxBase::IReader::Ptr pR;
         m_pR->Clone(pR);
 
-        bool bValid = ctx.ValidateAndSummarize(*m_pTx, std::move(*pR)) && p->Flush();
+        bool bValid =
+            (m_pRW ?
+                ctx.ValidateAndSummarizeSlice(*m_pTx, Cast::Up<Block::BodyBase::RW>(*pR)) :
+                ctx.ValidateAndSummarize(*m_pTx, std::move(*pR))) &&
+            p->Flush();
 
         std::unique_lock<std::mutex> scope2(m_Mutex);
 
@@ -697,6 +1136,11 @@ Node::Peer* Node::AllocPeer(const beam::io::Address& addr)
     ZeroObject(pPeer->m_Tip);
     pPeer->m_RemoteAddr = addr;
     pPeer->m_LoginFlags = 0;
+    pPeer->m_SyncRequests = 0;
+
+    ZeroObject(pPeer->m_Download);
+    pPeer->m_Download.m_Window = std::max(m_Cfg.m_BlockDownload.m_WindowInit, 1U);
+    pPeer->m_Download.m_SsThresh = m_Cfg.m_BlockDownload.m_WindowMax;
 
     LOG_INFO() << "+Peer " << addr;
 
@@ -829,17 +1273,17 @@ void Node::InitMode()
 
     m_pSync->m_bDetecting = !m_pSync->m_Trg.m_Height;
 
+    m_pSync->m_SizeCompleted = 0;
+    m_pSync->m_SizeTotal = 0;
+
     if (m_pSync->m_Trg.m_Height)
     {
-        m_pSync->m_SizeCompleted = m_Compressor.get_SizeTotal(m_pSync->m_Trg.m_Height);
-        m_pSync->m_SizeTotal = m_pSync->m_SizeCompleted; // will change when peer responds
+        SyncLoad();
 
         LOG_INFO() << "Resuming sync up to " << m_pSync->m_Trg;
     }
     else
     {
-		m_pSync->m_SizeCompleted = 0;
-		m_pSync->m_SizeTotal = 0;
 
         LOG_INFO() << "Searching for the best peer...";
     }
@@ -914,6 +1358,7 @@ void Node::ImportMacroblock(Height h)
     Block::BodyBase::RW rw;
     m_Compressor.FmtPath(rw, h, NULL);
     rw.ROpen();
+    rw.CreateIndex(); // the downloaded data comes without the index
 
     if (!m_Processor.ImportMacroBlock(rw))
         throw std::runtime_error("import failed");
@@ -1048,7 +1493,10 @@ void Node::Peer::OnConnectedSecure()
     msgLogin.m_Flags =
         proto::LoginFlags::SpreadingTransactions | // indicate ability to receive and broadcast transactions
         proto::LoginFlags::Bbs | // indicate ability to receive and broadcast BBS messages
-        proto::LoginFlags::SendPeers; // request a another node to periodically send a list of recommended peers
+        proto::LoginFlags::SendPeers | // request a another node to periodically send a list of recommended peers
+        proto::LoginFlags::CompactBlocks | // indicate ability to serve compact blocks
+        proto::LoginFlags::TxInvBatches | // request batched tx inventory
+        proto::LoginFlags::MacroblockRanges; // indicate ability to serve macroblock ranges
 
     Send(msgLogin);
 
@@ -1245,6 +1693,8 @@ void Node::Peer::ReleaseTask(Task& t)
         t.m_bPack = false;
     }
 
+    t.m_pCompact.reset();
+
     m_lstTasks.erase(TaskList::s_iterator_to(t));
     m_This.m_lstTasksUnassigned.push_back(t);
 
@@ -1292,12 +1742,10 @@ void Node::Peer::DeleteSelf(bool bIsError, uint8_t nByeReason)
             m_This.m_PeerMan.OnRemoteError(*m_pInfo, ByeReason::Ban == nByeReason);
     }
 
-    if (m_This.m_pSync && (Flags::SyncPending & m_Flags))
+    if (m_This.m_pSync && m_SyncRequests)
     {
-        assert(m_This.m_pSync->m_RequestsPending);
-        m_Flags &= ~Flags::SyncPending;
         m_Flags |= Flags::DontSync;
-        m_This.m_pSync->m_RequestsPending--;
+        m_This.SyncRelease(*this);
 
         m_This.SyncCycle();
     }
@@ -1452,22 +1900,12 @@ void Node::Peer::OnMsg(proto::Macroblock&& msg)
 
     if (Flags::SyncPending & m_Flags)
     {
-        assert(m_This.m_pSync->m_RequestsPending);
+        assert(m_SyncRequests);
         m_Flags &= ~Flags::SyncPending;
-        m_This.m_pSync->m_RequestsPending--;
-
-        if (msg.m_ID == m_This.m_pSync->m_Trg)
-        {
-            LOG_INFO() << "Peer " << m_RemoteAddr << " DL Macroblock portion";
-            m_This.SyncCycle(*this, msg.m_Portion);
-        }
-        else
-        {
-            LOG_INFO() << "Peer incompatible";
+        m_SyncRequests--;
 
-            m_Flags |= Flags::DontSync;
-            m_This.SyncCycle();
-        }
+        if (!m_This.m_pSync->m_bDetecting)
+            m_This.SyncCycleLegacy(*this, msg);
     }
     else
     {
@@ -1519,6 +1957,7 @@ void Node::OnSyncTimer()
         m_pSync->m_bDetecting = false;
         m_pSync->m_RequestsPending = 0;
 
+        SyncLoad(); // there may be leftovers of the previous attempt
         SyncCycle();
     }
     else
@@ -1532,94 +1971,562 @@ void Node::OnSyncTimer()
 void Node::SyncCycle()
 {
     assert(m_pSync);
-    if (m_pSync->m_bDetecting || m_pSync->m_RequestsPending)
+    if (m_pSync->m_bDetecting)
         return;
 
     for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
-        if (SyncCycle(*it))
-            break;
+        SyncCycle(*it);
 }
 
 bool Node::SyncCycle(Peer& p)
 {
     assert(m_pSync);
-    if (m_pSync->m_bDetecting || m_pSync->m_RequestsPending)
+    if (m_pSync->m_bDetecting)
         return false;
 
-    assert(!(Peer::Flags::SyncPending & p.m_Flags));
     if (Peer::Flags::DontSync & p.m_Flags)
         return false;
 
     if (p.m_Tip.m_Height < m_pSync->m_Trg.m_Height/* + Rules::get().MaxRollbackHeight*/)
         return false;
 
-    proto::MacroblockGet msg;
-    msg.m_ID = m_pSync->m_Trg;
-    msg.m_Data = m_pSync->m_iData;
+    if (!(proto::LoginFlags::MacroblockRanges & p.m_LoginFlags))
+        return SyncCycleLegacy(p);
 
-    assert(m_pSync->m_iData < Block::Body::RW::Type::count);
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+    const uint32_t nRequestsMax = std::max(m_Cfg.m_Sync.m_RequestsPerPeer, 1U);
+    bool bSent = false;
 
-    Block::Body::RW rw;
-    m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+    for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+    {
+        FirstTimeSync::Data& d = m_pSync->m_pData[iData];
 
-    std::string sPath;
-    rw.GetPath(sPath, m_pSync->m_iData);
+        for (size_t iChunk = 0; iChunk < d.m_vChunks.size(); iChunk++)
+        {
+            if (p.m_SyncRequests >= nRequestsMax)
+                return bSent;
 
-    std::FStream fs;
-    if (fs.Open(sPath.c_str(), true))
-        msg.m_Offset = fs.get_Remaining();
+            FirstTimeSync::Chunk& c = d.m_vChunks[iChunk];
+            if (c.m_pOwner || d.IsComplete(iChunk, nChunkSize))
+                continue;
 
-    p.Send(msg);
-    p.m_Flags |= Peer::Flags::SyncPending;
-    m_pSync->m_RequestsPending++;
+            proto::MacroblockGetRange msg;
+            msg.m_ID = m_pSync->m_Trg;
+            msg.m_Data = iData;
+            msg.m_Offset = uint64_t(nChunkSize) * iChunk + c.m_Done;
+            msg.m_Size = d.get_ChunkSize(iChunk, nChunkSize) - c.m_Done;
 
-    LOG_INFO() << " Sending MacroblockGet/request to " << p.m_RemoteAddr << ". Idx=" << uint32_t(msg.m_Data) << ", Offset=" << msg.m_Offset;
+            p.Send(msg);
 
-    return true;
+            c.m_pOwner = &p;
+            p.m_SyncRequests++;
+            bSent = true;
+
+            LOG_INFO() << " Sending MacroblockGetRange to " << p.m_RemoteAddr << ". Idx=" << uint32_t(msg.m_Data) << ", Offset=" << msg.m_Offset << ", Size=" << msg.m_Size;
+        }
+    }
+
+    return bSent;
+}
+
+void Node::Peer::OnMsg(proto::MacroblockRange&& msg)
+{
+    if (!m_SyncRequests)
+        ThrowUnexpected();
+    m_SyncRequests--;
+
+    if (msg.m_Data >= Block::Body::RW::Type::count)
+        ThrowUnexpected();
+
+    if (!m_This.m_pSync || m_This.m_pSync->m_bDetecting)
+        return; // late response
+
+    if (!(Flags::ProvenWork & m_Flags))
+        ThrowUnexpected();
+
+    m_This.SyncCycle(*this, msg);
 }
 
-void Node::SyncCycle(Peer& p, const ByteBuffer& buf)
+void Node::SyncCycle(Peer& p, proto::MacroblockRange& msg)
 {
-    assert(m_pSync && !m_pSync->m_bDetecting && !m_pSync->m_RequestsPending);
-    assert(m_pSync->m_iData < Block::Body::RW::Type::count);
+    assert(m_pSync && !m_pSync->m_bDetecting);
+
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+    FirstTimeSync::Data& d = m_pSync->m_pData[msg.m_Data];
 
-    if (buf.empty())
+    size_t iChunk = static_cast<size_t>(msg.m_Offset / nChunkSize);
+    if ((iChunk >= d.m_vChunks.size()) || (d.m_vChunks[iChunk].m_pOwner != &p))
+        return; // released already
+
+    d.m_vChunks[iChunk].m_pOwner = NULL;
+
+    if (uint64_t(nChunkSize) * iChunk + d.m_vChunks[iChunk].m_Done != msg.m_Offset)
+        Peer::ThrowUnexpected();
+
+    bool bCompatible = (msg.m_ID == m_pSync->m_Trg);
+    if (bCompatible)
+    {
+        if (FirstTimeSync::Data::s_SizeUnknown == d.m_Size)
+            SyncSetSize(msg.m_SizeData, msg.m_Data);
+        else
+            bCompatible = (d.m_Size == msg.m_SizeData);
+    }
+
+    if (!bCompatible)
     {
-        LOG_INFO() << "Sync cycle complete for Idx=" << uint32_t(m_pSync->m_iData);
+        LOG_INFO() << "Peer " << p.m_RemoteAddr << " incompatible";
 
-        if (++m_pSync->m_iData == Block::Body::RW::Type::count)
+        p.m_Flags |= Peer::Flags::DontSync;
+        SyncRelease(p);
+        SyncCycle();
+        return;
+    }
+
+    uint32_t nSize = static_cast<uint32_t>(msg.m_Portion.size());
+
+    if (iChunk < d.m_vChunks.size())
+    {
+        FirstTimeSync::Chunk& c = d.m_vChunks[iChunk];
+        if (uint64_t(nChunkSize) * iChunk + c.m_Done == msg.m_Offset) // may be reset if the file size turned out to be inconsistent
         {
-            Height h = m_pSync->m_Trg.m_Height;
-            m_pSync = NULL;
+            if (nSize > d.get_ChunkSize(iChunk, nChunkSize) - c.m_Done)
+                Peer::ThrowUnexpected();
+
+            if (nSize)
+            {
+                SyncWrite(msg.m_Data, msg.m_Offset, msg.m_Portion, nSize);
+                c.m_Done += nSize;
+            }
+            else
+                if (!d.IsComplete(iChunk, nChunkSize))
+                {
+                    LOG_INFO() << "Peer " << p.m_RemoteAddr << " doesn't provide the data";
+
+                    p.m_Flags |= Peer::Flags::DontSync;
+                    SyncRelease(p);
+                }
+        }
+    }
+    else
+        if (nSize)
+            Peer::ThrowUnexpected();
 
-            LOG_INFO() << "Sync DL complete";
+    SyncOnData();
+}
 
-            ImportMacroblock(h);
-            RefreshCongestions();
+bool Node::SyncCycleLegacy(Peer& p)
+{
+    // Older peer, MacroblockGet only. Single request at a time, the portion size is up to the peer
+    if (Peer::Flags::SyncPending & p.m_Flags)
+        return false;
 
-            return;
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+
+    for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+    {
+        FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+
+        for (size_t iChunk = 0; iChunk < d.m_vChunks.size(); iChunk++)
+        {
+            FirstTimeSync::Chunk& c = d.m_vChunks[iChunk];
+            if (c.m_pOwner || d.IsComplete(iChunk, nChunkSize))
+                continue;
+
+            proto::MacroblockGet msg;
+            msg.m_ID = m_pSync->m_Trg;
+            msg.m_Data = iData;
+            msg.m_Offset = uint64_t(nChunkSize) * iChunk + c.m_Done;
+
+            p.Send(msg);
+
+            c.m_pOwner = &p;
+            p.m_SyncRequests++;
+            p.m_Flags |= Peer::Flags::SyncPending;
+
+            LOG_INFO() << " Sending MacroblockGet/request to " << p.m_RemoteAddr << ". Idx=" << uint32_t(msg.m_Data) << ", Offset=" << msg.m_Offset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Node::SyncCycleLegacy(Peer& p, proto::Macroblock& msg)
+{
+    assert(m_pSync && !m_pSync->m_bDetecting);
+
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+
+    // the response doesn't specify what it is, find the chunk requested from this peer
+    uint8_t iData = 0;
+    size_t iChunk = 0;
+    for (; iData < Block::Body::RW::Type::count; iData++)
+    {
+        const std::vector<FirstTimeSync::Chunk>& v = m_pSync->m_pData[iData].m_vChunks;
+        for (iChunk = 0; (iChunk < v.size()) && (&p != v[iChunk].m_pOwner); iChunk++)
+            ;
+
+        if (iChunk < v.size())
+            break;
+    }
+
+    if (Block::Body::RW::Type::count == iData)
+        return; // released already
+
+    FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+    FirstTimeSync::Chunk& c = d.m_vChunks[iChunk];
+    c.m_pOwner = NULL;
+
+    if (msg.m_ID != m_pSync->m_Trg)
+    {
+        LOG_INFO() << "Peer " << p.m_RemoteAddr << " incompatible";
+
+        p.m_Flags |= Peer::Flags::DontSync;
+        SyncRelease(p);
+        SyncCycle();
+        return;
+    }
+
+    uint64_t nOffset = uint64_t(nChunkSize) * iChunk + c.m_Done;
+
+    if (msg.m_Portion.empty())
+    {
+        if (FirstTimeSync::Data::s_SizeUnknown == d.m_Size)
+            SyncSetSize(nOffset, iData); // the end of the data. All the preceding chunks are complete
+        else
+        {
+            LOG_INFO() << "Peer " << p.m_RemoteAddr << " doesn't provide the data";
+
+            p.m_Flags |= Peer::Flags::DontSync;
+            SyncRelease(p);
         }
     }
     else
     {
+        // the rest of the portion (if any) belongs to other chunks, those may be requested from others
+        uint32_t nSize = static_cast<uint32_t>(std::min<size_t>(msg.m_Portion.size(), d.get_ChunkSize(iChunk, nChunkSize) - c.m_Done));
+
+        SyncWrite(iData, nOffset, msg.m_Portion, nSize);
+        c.m_Done += nSize;
+        m_DownloadStats.m_MacroblockBytesLegacy += nSize;
+
+        if ((FirstTimeSync::Data::s_SizeUnknown == d.m_Size) && d.IsComplete(iChunk, nChunkSize) && (iChunk + 1 == d.m_vChunks.size()))
+        {
+            // the size is still unknown, assume there's more
+            d.m_vChunks.emplace_back();
+            d.m_vChunks.back().m_Done = 0;
+            d.m_vChunks.back().m_pOwner = NULL;
+        }
+    }
+
+    SyncOnData();
+}
+
+void Node::SyncWrite(uint8_t iData, uint64_t nOffset, const ByteBuffer& buf, uint32_t nSize)
+{
+    assert(nSize && (nSize <= buf.size()));
+
+    Block::Body::RW rw;
+    m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+
+    std::string sPath;
+    rw.GetPath(sPath, iData);
+
+    std::FStream fs;
+    fs.OpenUpdate(sPath.c_str(), true);
+    fs.SeekWrite(nOffset);
+    fs.write(&buf.front(), nSize);
+
+    m_pSync->m_SizeCompleted += nSize;
+    m_DownloadStats.m_MacroblockBytes += nSize;
+}
+
+void Node::SyncOnData()
+{
+    SyncSave();
+
+    if (SyncIsComplete())
+    {
+        std::string sPath;
+        SyncGetStatePath(sPath);
+        DeleteFile(sPath.c_str());
+
+        Height h = m_pSync->m_Trg.m_Height;
+        m_pSync = NULL;
+
+        LOG_INFO() << "Sync DL complete";
+
+        ImportMacroblock(h);
+        RefreshCongestions();
+
+        return;
+    }
+
+    UpdateSyncStatus();
+    SyncCycle();
+}
+
+uint32_t Node::FirstTimeSync::Data::get_ChunkSize(size_t iChunk, uint32_t nChunkSize) const
+{
+    uint64_t nPos = uint64_t(nChunkSize) * iChunk;
+    if ((s_SizeUnknown == m_Size) || (m_Size - nPos >= nChunkSize))
+        return nChunkSize;
+
+    assert(m_Size > nPos);
+    return static_cast<uint32_t>(m_Size - nPos);
+}
+
+bool Node::FirstTimeSync::Data::IsComplete(size_t iChunk, uint32_t nChunkSize) const
+{
+    return m_vChunks[iChunk].m_Done == get_ChunkSize(iChunk, nChunkSize);
+}
+
+void Node::SyncInitData(uint64_t nSizePrefix, uint8_t iData)
+{
+    // the prefix is complete, the rest is unknown. The chunk with the end of the prefix is the one to request
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+    FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+
+    d.m_Size = FirstTimeSync::Data::s_SizeUnknown;
+    d.m_vChunks.resize(static_cast<size_t>(nSizePrefix / nChunkSize) + 1);
+
+    for (size_t i = 0; i < d.m_vChunks.size(); i++)
+    {
+        FirstTimeSync::Chunk& c = d.m_vChunks[i];
+        c.m_Done = nChunkSize;
+        c.m_pOwner = NULL;
+    }
+
+    d.m_vChunks.back().m_Done = static_cast<uint32_t>(nSizePrefix % nChunkSize);
+}
+
+void Node::SyncSetSize(uint64_t nSize, uint8_t iData)
+{
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+    FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+
+    assert((FirstTimeSync::Data::s_SizeUnknown == d.m_Size) && !d.m_vChunks.empty());
+    uint64_t nSizePrefix = uint64_t(nChunkSize) * (d.m_vChunks.size() - 1) + d.m_vChunks.back().m_Done;
+
+    if (nSizePrefix > nSize)
+    {
+        LOG_WARNING() << "Sync data Idx=" << uint32_t(iData) << " inconsistent, restarting";
+
         Block::Body::RW rw;
         m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
 
         std::string sPath;
-        rw.GetPath(sPath, m_pSync->m_iData);
+        rw.GetPath(sPath, iData);
 
         std::FStream fs;
-        fs.Open(sPath.c_str(), false, true, true);
+        fs.Open(sPath.c_str(), false, true); // truncate
+
+        m_pSync->m_SizeCompleted -= nSizePrefix;
+        SyncInitData(0, iData);
+    }
+
+    d.m_Size = nSize;
+    d.m_vChunks.resize(static_cast<size_t>((nSize + nChunkSize - 1) / nChunkSize));
+
+    // the new chunks are empty
+    for (size_t i = static_cast<size_t>(nSizePrefix / nChunkSize) + 1; i < d.m_vChunks.size(); i++)
+    {
+        FirstTimeSync::Chunk& c = d.m_vChunks[i];
+        c.m_Done = 0;
+        c.m_pOwner = NULL;
+    }
+
+    uint64_t nSizeTotal = 0;
+    for (uint8_t i = 0; i < Block::Body::RW::Type::count; i++)
+    {
+        if (FirstTimeSync::Data::s_SizeUnknown == m_pSync->m_pData[i].m_Size)
+            return;
+        nSizeTotal += m_pSync->m_pData[i].m_Size;
+    }
+
+    m_pSync->m_SizeTotal = nSizeTotal;
+}
+
+void Node::SyncRelease(Peer& p)
+{
+    assert(m_pSync);
+
+    for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+    {
+        std::vector<FirstTimeSync::Chunk>& v = m_pSync->m_pData[iData].m_vChunks;
+        for (size_t i = 0; i < v.size(); i++)
+            if (&p == v[i].m_pOwner)
+                v[i].m_pOwner = NULL;
+    }
+}
+
+bool Node::SyncIsComplete() const
+{
+    assert(m_pSync);
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+
+    for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+    {
+        const FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+        if (FirstTimeSync::Data::s_SizeUnknown == d.m_Size)
+            return false;
+
+        for (size_t i = 0; i < d.m_vChunks.size(); i++)
+            if (!d.IsComplete(i, nChunkSize))
+                return false;
+    }
+
+    return true;
+}
+
+void Node::SyncGetStatePath(std::string& sPath)
+{
+    assert(m_pSync);
+    m_Compressor.FmtPath(sPath, m_pSync->m_Trg.m_Height, NULL);
+    sPath += "_sync";
+}
+
+void Node::SyncSave()
+{
+    assert(m_pSync);
+
+    Serializer ser;
+    ser & m_Cfg.m_Sync.m_ChunkSize;
+
+    std::vector<uint32_t> vDone;
+    for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+    {
+        const FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+
+        vDone.resize(d.m_vChunks.size());
+        for (size_t i = 0; i < vDone.size(); i++)
+            vDone[i] = d.m_vChunks[i].m_Done;
+
+        ser & d.m_Size;
+        ser & vDone;
+    }
+
+    ByteBuffer buf;
+    ser.swap_buf(buf);
+
+    std::string sPath;
+    SyncGetStatePath(sPath);
+
+    std::FStream fs;
+    fs.Open(sPath.c_str(), false, true);
+    fs.write(&buf.front(), buf.size());
+}
+
+void Node::SyncLoad()
+{
+    assert(m_pSync);
+    const uint32_t nChunkSize = m_Cfg.m_Sync.m_ChunkSize;
+
+    std::string sPath;
+    SyncGetStatePath(sPath);
+
+    Block::Body::RW rw;
+    m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+
+    m_pSync->m_SizeCompleted = 0;
+
+    std::FStream fs;
+    if (fs.Open(sPath.c_str(), true))
+    {
+        bool bValid = false;
+
+        try {
+            ByteBuffer buf(static_cast<size_t>(fs.get_Remaining()));
+            if (!buf.empty())
+                fs.read(&buf.front(), buf.size());
+
+            Deserializer der;
+            der.reset(buf);
+
+            uint32_t nChunkSizeWas = 0;
+            der & nChunkSizeWas;
+            if (nChunkSizeWas != nChunkSize)
+                throw std::runtime_error("chunk size changed");
+
+            std::vector<uint32_t> vDone;
+            for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+            {
+                FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+                der & d.m_Size;
+                vDone.clear(); // an empty vector is not assigned
+                der & vDone;
+
+                bool bKnown = (FirstTimeSync::Data::s_SizeUnknown != d.m_Size);
+                if (bKnown ? (vDone.size() != (d.m_Size + nChunkSize - 1) / nChunkSize) : vDone.empty())
+                    throw std::runtime_error("layout mismatch");
+
+                d.m_vChunks.resize(vDone.size());
+                for (size_t i = 0; i < vDone.size(); i++)
+                {
+                    FirstTimeSync::Chunk& c = d.m_vChunks[i];
+                    c.m_Done = vDone[i];
+                    c.m_pOwner = NULL;
+
+                    if (c.m_Done > d.get_ChunkSize(i, nChunkSize))
+                        throw std::runtime_error("chunk overflow");
+
+                    m_pSync->m_SizeCompleted += c.m_Done;
+                }
+            }
+
+            bValid = true;
+
+        } catch (const std::exception& e) {
+            LOG_WARNING() << "Sync state " << e.what() << ", restarting";
+        }
+
+        if (!bValid)
+        {
+            // the data was written out of order, nothing can be reused
+            m_pSync->m_SizeCompleted = 0;
+
+            for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+            {
+                std::string sData;
+                rw.GetPath(sData, iData);
+
+                std::FStream fsData;
+                fsData.Open(sData.c_str(), false); // truncate
+
+                SyncInitData(0, iData);
+            }
+        }
+    }
+    else
+    {
+        // no state. Reuse the prefix of the data if written sequentially (by the previous version)
+        for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+        {
+            std::string sData;
+            rw.GetPath(sData, iData);
 
-        fs.write(&buf.at(0), buf.size());
-        m_pSync->m_SizeCompleted += buf.size();
+            std::FStream fsData;
+            uint64_t nSizePrefix = fsData.Open(sData.c_str(), true) ? fsData.get_Remaining() : 0;
 
-        LOG_INFO() << "Portion appended";
+            SyncInitData(nSizePrefix, iData);
+            m_pSync->m_SizeCompleted += nSizePrefix;
+        }
+    }
 
-        // Macroblock download progress should be reported here!
+    // the total is refined as the data sizes are learned
+    uint64_t nSizeTotal = 0;
+    for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
+    {
+        const FirstTimeSync::Data& d = m_pSync->m_pData[iData];
+        if (FirstTimeSync::Data::s_SizeUnknown == d.m_Size)
+        {
+            nSizeTotal = std::max(m_pSync->m_SizeTotal, m_pSync->m_SizeCompleted);
+            break;
+        }
+        nSizeTotal += d.m_Size;
     }
 
-    SyncCycle(p);
+    m_pSync->m_SizeTotal = nSizeTotal;
 }
 
 Node::Task& Node::Peer::get_FirstTask()
@@ -1631,12 +2538,26 @@ Node::Task& Node::Peer::get_FirstTask()
 
 void Node::Peer::OnFirstTaskDone()
 {
-    ReleaseTask(get_FirstTask());
+    Task& t = get_FirstTask();
+    if (!t.m_Key.second)
+        OnTaskResponse(t, 0); // headers are small, good enough for the round trip
+
+    ReleaseTask(t);
     SetTimerWrtFirstTask();
 
     TakeTasks(); // maybe can take more
 }
 
+void Node::Peer::RequeueFirstTask()
+{
+    // The response to the follow-up request will arrive after all the already pending ones
+    Task& t = get_FirstTask();
+    m_lstTasks.pop_front();
+    m_lstTasks.push_back(t);
+
+    SetTimerWrtFirstTask();
+}
+
 void Node::Peer::OnMsg(proto::DataMissing&&)
 {
     Task& t = get_FirstTask();
@@ -1676,164 +2597,504 @@ void Node::Peer::OnMsg(proto::Hdr&& msg)
     m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardHeader, true);
 
     NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnState(msg.m_Description, m_pInfo->m_ID.m_Key);
+    if (NodeProcessor::DataStatus::Accepted == eStatus)
+        m_This.OnHdrsAccepted(1);
+
+    OnFirstTaskDone(eStatus);
+}
+
+void Node::Peer::OnMsg(proto::GetHdrPack&& msg)
+{
+    proto::HdrPack msgOut;
+
+    if (msg.m_Count)
+    {
+        if (msg.m_Count > proto::g_HdrPackMaxSize)
+            ThrowUnexpected();
+
+        Processor& p = m_This.m_Processor;
+        if (p.IsActive(msg.m_Top))
+        {
+            // contiguous in memory
+            Height hMin = msg.m_Top.m_Height - std::min<Height>(msg.m_Count, msg.m_Top.m_Height - Rules::HeightGenesis + 1) + 1;
+            const Block::SystemState::Full* pS = p.get_Active(hMin);
+
+            msgOut.m_vElements.resize(static_cast<size_t>(msg.m_Top.m_Height - hMin + 1));
+            for (size_t i = 0; i < msgOut.m_vElements.size(); i++)
+                msgOut.m_vElements[msgOut.m_vElements.size() - 1 - i] = pS[i];
+
+            msgOut.m_Prefix = *pS;
+        }
+        else
+        {
+            NodeDB& db = p.get_DB();
+            uint64_t rowid = db.StateFindSafe(msg.m_Top);
+            if (rowid)
+            {
+                msgOut.m_vElements.reserve(msg.m_Count);
+
+                Block::SystemState::Full s;
+                for (uint32_t n = 0; ; )
+                {
+                    db.get_State(rowid, s);
+                    msgOut.m_vElements.push_back(s);
+
+                    if (++n == msg.m_Count)
+                        break;
+
+                    if (!db.get_Prev(rowid))
+                        break;
+                }
+
+                msgOut.m_Prefix = s;
+            }
+        }
+    }
+
+    if (msgOut.m_vElements.empty())
+        Send(proto::DataMissing(Zero));
+    else
+        Send(msgOut);
+}
+
+void Node::Peer::OnMsg(proto::HdrPack&& msg)
+{
+    Task& t = get_FirstTask();
+
+    if (t.m_Key.second || !t.m_bPack)
+        ThrowUnexpected();
+
+    if (msg.m_vElements.empty() || (msg.m_vElements.size() > proto::g_HdrPackMaxSize))
+        ThrowUnexpected();
+
+    // restore all the headers (from the lowest), verify their PoW in parallel, then feed them in order
+    std::vector<Block::SystemState::Full> vStates(msg.m_vElements.size());
+
+    Cast::Down<Block::SystemState::Sequence::Prefix>(vStates.front()) = msg.m_Prefix;
+    Cast::Down<Block::SystemState::Sequence::Element>(vStates.front()) = msg.m_vElements.back();
+
+    for (size_t i = 1; i < vStates.size(); i++)
+    {
+        Block::SystemState::Full& s = vStates[i];
+        s = vStates[i - 1];
+
+        s.NextPrefix();
+        Cast::Down<Block::SystemState::Sequence::Element>(s) = msg.m_vElements[vStates.size() - 1 - i];
+        s.m_ChainWork += s.m_PoW.m_Difficulty;
+    }
+
+    std::vector<uint8_t> vValid(vStates.size());
+    m_This.m_Processor.m_Verifier.VerifyPoW(&vStates.front(), static_cast<uint32_t>(vStates.size()), &vValid.front());
+
+    for (size_t i = 0; i < vStates.size(); i++)
+        if (!vValid[i])
+        {
+            // the whole pack is rejected, none of the headers is fed
+            LOG_WARNING() << vStates[i].m_Height << " header PoW invalid!";
+            ThrowUnexpected();
+        }
+
+    uint32_t nAccepted = 0;
+    bool bInvalid = false;
+
+    for (size_t i = 0; i < vStates.size(); i++)
+    {
+        NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnState(vStates[i], m_pInfo->m_ID.m_Key, true);
+        switch (eStatus)
+        {
+        case NodeProcessor::DataStatus::Invalid:
+            bInvalid = true;
+            break;
+
+        case NodeProcessor::DataStatus::Accepted:
+            nAccepted++;
+
+        default:
+            break; // suppress warning
+        }
+    }
+
+    // just to be pedantic
+    Block::SystemState::ID id;
+    vStates.back().get_ID(id);
+    if (id != t.m_Key.first)
+        bInvalid = true;
+
+    OnFirstTaskDone();
+
+    if (nAccepted)
+    {
+        assert((Flags::PiRcvd & m_Flags) && m_pInfo);
+        m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardHeader * nAccepted, true);
+        m_This.OnHdrsAccepted(nAccepted);
+
+        m_This.RefreshCongestions(); // may delete us
+    } else
+        if (bInvalid)
+            ThrowUnexpected();
+
+}
+
+void Node::Peer::OnMsg(proto::GetBody&& msg)
+{
+    if (msg.m_ID.m_Height)
+    {
+        uint64_t rowid = m_This.m_Processor.get_DB().StateFindSafe(msg.m_ID);
+        if (rowid)
+        {
+            proto::Body msgBody;
+            m_This.m_Processor.get_DB().GetStateBlock(rowid, &msgBody.m_Perishable, &msgBody.m_Eternal, NULL);
+
+            if (!msgBody.m_Perishable.empty())
+            {
+                Send(msgBody);
+                return;
+            }
+
+        }
+    }
+    else
+    {
+        if ((msg.m_ID.m_Hash == Zero) && m_This.m_Processor.m_Extra.m_TreasuryHandled)
+        {
+            proto::Body msgBody;
+            if (m_This.m_Processor.get_DB().ParamGet(NodeDB::ParamID::Treasury, NULL, NULL, &msgBody.m_Eternal))
+            {
+                Send(msgBody);
+                return;
+            }
+        }
+    }
+
+    proto::DataMissing msgMiss(Zero);
+    Send(msgMiss);
+}
+
+void Node::Peer::OnMsg(proto::Body&& msg)
+{
+    Task& t = get_FirstTask();
+
+    if (!t.m_Key.second || t.m_bPack || t.m_pCompact)
+        ThrowUnexpected();
+
+    OnBody(t, msg.m_Perishable, msg.m_Eternal);
+}
+
+void Node::Peer::OnBody(Task& t, const ByteBuffer& bbP, const ByteBuffer& bbE)
+{
+    assert((Flags::PiRcvd & m_Flags) && m_pInfo);
+    m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardBlock, true);
+
+    uint32_t nSize = static_cast<uint32_t>(bbP.size() + bbE.size());
+    OnTaskResponse(t, nSize);
+    OnBlockDelivered(nSize);
+
+    const Block::SystemState::ID& id = t.m_Key.first;
+    Height h = id.m_Height;
+
+    NodeProcessor::DataStatus::Enum eStatus = h ?
+        m_This.m_Processor.OnBlock(id, bbP, bbE, m_pInfo->m_ID.m_Key) :
+        m_This.m_Processor.OnTreasury(bbE);
+
     OnFirstTaskDone(eStatus);
+
+	if (!h)
+		m_This.InitMode(); // maybe fast-sync now
+}
+
+bool Node::LoadBody(const Block::SystemState::ID& id, ByteBuffer& bbP, ByteBuffer& bbE)
+{
+    if (!id.m_Height)
+        return false;
+
+    NodeDB& db = m_Processor.get_DB();
+    uint64_t rowid = db.StateFindSafe(id);
+    if (!rowid)
+        return false;
+
+    db.GetStateBlock(rowid, &bbP, &bbE, NULL);
+    return !bbP.empty();
+}
+
+void Node::Peer::OnMsg(proto::GetBodyCompact&& msg)
+{
+    const Processor::CompactTip* pTip = m_This.m_Processor.m_pCompactTip.get();
+    if (pTip && (pTip->m_ID == msg.m_ID))
+    {
+        Send(pTip->m_Msg);
+        return;
+    }
+
+    proto::BodyCompact msgOut;
+    if (m_This.BuildCompact(msgOut, msg.m_ID))
+        Send(msgOut);
+    else
+    {
+        proto::DataMissing msgMiss(Zero);
+        Send(msgMiss);
+    }
+}
+
+bool Node::BuildCompact(proto::BodyCompact& msgOut, const Block::SystemState::ID& id)
+{
+    ByteBuffer bbP, bbE;
+    if (!LoadBody(id, bbP, bbE))
+        return false;
+
+    ECC::Hash::Processor()
+        << Blob(bbP)
+        << Blob(bbE)
+        >> msgOut.m_Checksum;
+
+    Block::Body block;
+    NodeProcessor::ReadBody(block, bbP, bbE);
+
+    // Elements that are in our tx pool are probably in the peer's as well. Send short IDs for them, the rest is prefilled.
+    const TxPool::Fluff& txp = m_TxPool;
+    Merkle::Hash hv;
+
+    std::vector<Output::Ptr> vOutputs;
+    vOutputs.swap(block.m_vOutputs);
+    msgOut.m_Outputs.resize(vOutputs.size());
+
+    for (size_t i = 0; i < vOutputs.size(); i++)
+    {
+        TxPool::Fluff::get_PartID(hv, *vOutputs[i]);
+        uint64_t nShortID = TxPool::Fluff::get_ShortID(hv);
+
+        const TxPool::Fluff::Element::Part* pPart = txp.FindPart(nShortID);
+        if (pPart && (pPart->m_hv == hv))
+            msgOut.m_Outputs[i] = nShortID;
+        else
+            block.m_vOutputs.push_back(std::move(vOutputs[i]));
+    }
+
+    std::vector<TxKernel::Ptr> vKernels;
+    vKernels.swap(block.m_vKernels);
+    msgOut.m_Kernels.resize(vKernels.size());
+
+    for (size_t i = 0; i < vKernels.size(); i++)
+    {
+        vKernels[i]->get_ID(hv);
+        uint64_t nShortID = TxPool::Fluff::get_ShortID(hv);
+
+        const TxPool::Fluff::Element::Part* pPart = txp.FindPart(nShortID);
+        if (pPart && (pPart->m_hv == hv))
+            msgOut.m_Kernels[i] = nShortID;
+        else
+            block.m_vKernels.push_back(std::move(vKernels[i]));
+    }
+
+    Serializer ser;
+    ser & Cast::Down<Block::BodyBase>(block);
+    ser & Cast::Down<TxVectors::Perishable>(block);
+    ser & Cast::Down<TxVectors::Eternal>(block);
+    ser.swap_buf(msgOut.m_Prefilled);
+
+    return true;
 }
 
-void Node::Peer::OnMsg(proto::GetHdrPack&& msg)
+template <typename T>
+void Node::Peer::ExpandCompact(std::vector<std::unique_ptr<T> >& v, const std::vector<uint64_t>& vIDs, const T* (TxPool::Fluff::Element::Part::*pGet)() const, std::vector<uint32_t>& vMissing)
 {
-    proto::HdrPack msgOut;
+    std::vector<std::unique_ptr<T> > vPrefilled;
+    vPrefilled.swap(v);
+    v.resize(vIDs.size());
 
-    if (msg.m_Count)
+    size_t iPrefilled = 0;
+    for (uint32_t i = 0; i < vIDs.size(); i++)
     {
-        if (msg.m_Count > proto::g_HdrPackMaxSize)
-            ThrowUnexpected();
-
-        NodeDB& db = m_This.m_Processor.get_DB();
-        uint64_t rowid = db.StateFindSafe(msg.m_Top);
-        if (rowid)
+        if (vIDs[i])
         {
-            msgOut.m_vElements.reserve(msg.m_Count);
+            const TxPool::Fluff::Element::Part* pPart = m_This.m_TxPool.FindPart(vIDs[i]);
+            const T* pSrc = pPart ? (pPart->*pGet)() : NULL;
 
-            Block::SystemState::Full s;
-            for (uint32_t n = 0; ; )
+            if (pSrc)
             {
-                db.get_State(rowid, s);
-                msgOut.m_vElements.push_back(s);
-
-                if (++n == msg.m_Count)
-                    break;
-
-                if (!db.get_Prev(rowid))
-                    break;
+                v[i].reset(new T);
+                *v[i] = *pSrc;
             }
+            else
+                vMissing.push_back(i);
+        }
+        else
+        {
+            if (iPrefilled == vPrefilled.size())
+                ThrowUnexpected();
 
-            msgOut.m_Prefix = s;
+            v[i] = std::move(vPrefilled[iPrefilled++]);
         }
     }
 
-    if (msgOut.m_vElements.empty())
-        Send(proto::DataMissing(Zero));
-    else
-        Send(msgOut);
+    if (iPrefilled != vPrefilled.size())
+        ThrowUnexpected();
 }
 
-void Node::Peer::OnMsg(proto::HdrPack&& msg)
+template <typename T>
+void Node::Peer::FillMissing(std::vector<std::unique_ptr<T> >& v, std::vector<std::unique_ptr<T> >& vSrc)
 {
-    Task& t = get_FirstTask();
-
-    if (t.m_Key.second || !t.m_bPack)
-        ThrowUnexpected();
+    size_t iSrc = 0;
+    for (size_t i = 0; i < v.size(); i++)
+    {
+        if (v[i])
+            continue;
 
-    if (msg.m_vElements.empty() || (msg.m_vElements.size() > proto::g_HdrPackMaxSize))
-        ThrowUnexpected();
+        if (iSrc == vSrc.size())
+            ThrowUnexpected();
 
-    Block::SystemState::Full s;
-    Cast::Down<Block::SystemState::Sequence::Prefix>(s) = msg.m_Prefix;
-    Cast::Down<Block::SystemState::Sequence::Element>(s) = msg.m_vElements.back();
+        v[i] = std::move(vSrc[iSrc++]);
+    }
 
-    uint32_t nAccepted = 0;
-    bool bInvalid = false;
+    if (iSrc != vSrc.size())
+        ThrowUnexpected();
+}
 
-    for (size_t i = msg.m_vElements.size(); ; )
-    {
-        NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnState(s, m_pInfo->m_ID.m_Key);
-        switch (eStatus)
-        {
-        case NodeProcessor::DataStatus::Invalid:
-            bInvalid = true;
-            break;
+void Node::Peer::OnMsg(proto::BodyCompact&& msg)
+{
+    Task& t = get_FirstTask();
 
-        case NodeProcessor::DataStatus::Accepted:
-            nAccepted++;
+    if (!t.m_Key.second || t.m_bPack || t.m_pCompact || !t.m_Key.first.m_Height)
+        ThrowUnexpected();
 
-        default:
-            break; // suppress warning
-        }
+    t.m_pCompact.reset(new Task::Compact);
+    t.m_pCompact->m_Checksum = msg.m_Checksum;
 
-        if (! --i)
-            break;
+    Block::Body& block = t.m_pCompact->m_Body;
 
-        s.NextPrefix();
-        Cast::Down<Block::SystemState::Sequence::Element>(s) = msg.m_vElements[i - 1];
-        s.m_ChainWork += s.m_PoW.m_Difficulty;
-    }
+    Deserializer der;
+    der.reset(msg.m_Prefilled);
+    der & Cast::Down<Block::BodyBase>(block);
+    der & Cast::Down<TxVectors::Perishable>(block);
+    der & Cast::Down<TxVectors::Eternal>(block);
 
-    // just to be pedantic
-    Block::SystemState::ID id;
-    s.get_ID(id);
-    if (id != t.m_Key.first)
-        bInvalid = true;
+    proto::GetBodyMissing msgOut;
+    msgOut.m_ID = t.m_Key.first;
 
-    OnFirstTaskDone();
+    ExpandCompact(block.m_vOutputs, msg.m_Outputs, &TxPool::Fluff::Element::Part::get_Output, msgOut.m_Outputs);
+    ExpandCompact(block.m_vKernels, msg.m_Kernels, &TxPool::Fluff::Element::Part::get_Kernel, msgOut.m_Kernels);
 
-    if (nAccepted)
+    if (msgOut.m_Outputs.empty() && msgOut.m_Kernels.empty())
+        OnCompactComplete(t);
+    else
     {
-        assert((Flags::PiRcvd & m_Flags) && m_pInfo);
-        m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardHeader * nAccepted, true);
-
-        m_This.RefreshCongestions(); // may delete us
-    } else
-        if (bInvalid)
-            ThrowUnexpected();
+        LOG_INFO() << t.m_Key.first << " Compact block, missing outputs=" << msgOut.m_Outputs.size() << ", kernels=" << msgOut.m_Kernels.size();
+        m_This.m_DownloadStats.m_CompactMissing++;
 
+        Send(msgOut);
+        RequeueFirstTask();
+    }
 }
 
-void Node::Peer::OnMsg(proto::GetBody&& msg)
+void Node::Peer::OnMsg(proto::GetBodyMissing&& msg)
 {
-    if (msg.m_ID.m_Height)
+    ByteBuffer bbP, bbE;
+    if (!m_This.LoadBody(msg.m_ID, bbP, bbE))
     {
-        uint64_t rowid = m_This.m_Processor.get_DB().StateFindSafe(msg.m_ID);
-        if (rowid)
-        {
-            proto::Body msgBody;
-            m_This.m_Processor.get_DB().GetStateBlock(rowid, &msgBody.m_Perishable, &msgBody.m_Eternal, NULL);
+        proto::DataMissing msgMiss(Zero);
+        Send(msgMiss);
+        return;
+    }
 
-            if (!msgBody.m_Perishable.empty())
-            {
-                Send(msgBody);
-                return;
-            }
+    Block::Body block;
+    NodeProcessor::ReadBody(block, bbP, bbE);
 
-        }
+    TxVectors::Full txv;
+
+    for (size_t i = 0; i < msg.m_Outputs.size(); i++)
+    {
+        uint32_t iIdx = msg.m_Outputs[i];
+        if ((iIdx >= block.m_vOutputs.size()) || !block.m_vOutputs[iIdx])
+            ThrowUnexpected(); // out of bounds or duplicated
+
+        txv.m_vOutputs.push_back(std::move(block.m_vOutputs[iIdx]));
     }
-    else
+
+    for (size_t i = 0; i < msg.m_Kernels.size(); i++)
     {
-        if ((msg.m_ID.m_Hash == Zero) && m_This.m_Processor.m_Extra.m_TreasuryHandled)
-        {
-            proto::Body msgBody;
-            if (m_This.m_Processor.get_DB().ParamGet(NodeDB::ParamID::Treasury, NULL, NULL, &msgBody.m_Eternal))
-            {
-                Send(msgBody);
-                return;
-            }
-        }
+        uint32_t iIdx = msg.m_Kernels[i];
+        if ((iIdx >= block.m_vKernels.size()) || !block.m_vKernels[iIdx])
+            ThrowUnexpected();
+
+        txv.m_vKernels.push_back(std::move(block.m_vKernels[iIdx]));
     }
 
-    proto::DataMissing msgMiss(Zero);
-    Send(msgMiss);
+    proto::BodyMissing msgOut;
+
+    Serializer ser;
+    ser & Cast::Down<TxVectors::Perishable>(txv);
+    ser.swap_buf(msgOut.m_Perishable);
+
+    ser.reset();
+    ser & Cast::Down<TxVectors::Eternal>(txv);
+    ser.swap_buf(msgOut.m_Eternal);
+
+    Send(msgOut);
 }
 
-void Node::Peer::OnMsg(proto::Body&& msg)
+void Node::Peer::OnMsg(proto::BodyMissing&& msg)
 {
     Task& t = get_FirstTask();
 
-    if (!t.m_Key.second || t.m_bPack)
+    if (!t.m_pCompact)
         ThrowUnexpected();
 
-    assert((Flags::PiRcvd & m_Flags) && m_pInfo);
-    m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardBlock, true);
+    TxVectors::Full txv;
 
-    const Block::SystemState::ID& id = t.m_Key.first;
-    Height h = id.m_Height;
+    Deserializer der;
+    der.reset(msg.m_Perishable);
+    der & Cast::Down<TxVectors::Perishable>(txv);
 
-    NodeProcessor::DataStatus::Enum eStatus = h ?
-        m_This.m_Processor.OnBlock(id, msg.m_Perishable, msg.m_Eternal, m_pInfo->m_ID.m_Key) :
-        m_This.m_Processor.OnTreasury(msg.m_Eternal);
+    der.reset(msg.m_Eternal);
+    der & Cast::Down<TxVectors::Eternal>(txv);
 
-    OnFirstTaskDone(eStatus);
+    if (!txv.m_vInputs.empty())
+        ThrowUnexpected();
 
-	if (!h)
-		m_This.InitMode(); // maybe fast-sync now
+    Block::Body& block = t.m_pCompact->m_Body;
+    FillMissing(block.m_vOutputs, txv.m_vOutputs);
+    FillMissing(block.m_vKernels, txv.m_vKernels);
+
+    OnCompactComplete(t);
+}
+
+void Node::Peer::OnCompactComplete(Task& t)
+{
+    std::unique_ptr<Task::Compact> pCompact(std::move(t.m_pCompact));
+    Block::Body& block = pCompact->m_Body;
+
+    ByteBuffer bbP, bbE;
+
+    Serializer ser;
+    ser & Cast::Down<Block::BodyBase>(block);
+    ser & Cast::Down<TxVectors::Perishable>(block);
+    ser.swap_buf(bbP);
+
+    ser.reset();
+    ser & Cast::Down<TxVectors::Eternal>(block);
+    ser.swap_buf(bbE);
+
+    ECC::Hash::Value hv;
+    ECC::Hash::Processor()
+        << Blob(bbP)
+        << Blob(bbE)
+        >> hv;
+
+    if (hv != pCompact->m_Checksum)
+    {
+        // short ID collision, or the peer is lying. Fall back to the full body
+        LOG_WARNING() << t.m_Key.first << " Compact block reconstruction mismatch";
+        m_This.m_DownloadStats.m_CompactMismatch++;
+
+        proto::GetBody msg;
+        msg.m_ID = t.m_Key.first;
+        Send(msg);
+
+        RequeueFirstTask();
+        return;
+    }
+
+    m_This.m_DownloadStats.m_Compact++;
+    OnBody(t, bbP, bbE);
 }
 
 void Node::Peer::OnFirstTaskDone(NodeProcessor::DataStatus::Enum eStatus)
@@ -2259,9 +3520,6 @@ bool Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, const Peer* pPeer, TxPo
     if (!bValid)
         return false;
 
-    proto::HaveTransaction msgOut;
-    msgOut.m_ID = key.m_Key;
-
     for (PeerList::iterator it2 = m_lstPeers.begin(); m_lstPeers.end() != it2; it2++)
     {
         Peer& peer = *it2;
@@ -2270,7 +3528,7 @@ bool Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, const Peer* pPeer, TxPo
         if (!(peer.m_LoginFlags & proto::LoginFlags::SpreadingTransactions))
             continue;
 
-        peer.Send(msgOut);
+        peer.AnnounceTx(key.m_Key);
     }
 
     m_TxPool.AddValidTx(std::move(ptx), ctx, key.m_Key);
@@ -2303,12 +3561,32 @@ void Node::Peer::OnMsg(proto::Login&& msg)
 
     if (!(m_LoginFlags & proto::LoginFlags::SpreadingTransactions) && (msg.m_Flags & proto::LoginFlags::SpreadingTransactions))
     {
-        proto::HaveTransaction msgOut;
+        const TxPool::Fluff::TxSet& txs = m_This.m_TxPool.m_setTxs;
 
-        for (TxPool::Fluff::TxSet::iterator it = m_This.m_TxPool.m_setTxs.begin(); m_This.m_TxPool.m_setTxs.end() != it; it++)
+        if (msg.m_Flags & proto::LoginFlags::TxInvBatches)
         {
-            msgOut.m_ID = it->m_Key;
-            Send(msgOut);
+            proto::HaveTransactions msgOut;
+
+            for (TxPool::Fluff::TxSet::const_iterator it = txs.begin(); txs.end() != it; )
+            {
+                msgOut.m_IDs.push_back((it++)->m_Key);
+
+                if ((msgOut.m_IDs.size() == proto::g_TxInvMaxSize) || (txs.end() == it))
+                {
+                    Send(msgOut);
+                    msgOut.m_IDs.clear();
+                }
+            }
+        }
+        else
+        {
+            proto::HaveTransaction msgOut;
+
+            for (TxPool::Fluff::TxSet::const_iterator it = txs.begin(); txs.end() != it; it++)
+            {
+                msgOut.m_ID = it->m_Key;
+                Send(msgOut);
+            }
         }
     }
 
@@ -2351,9 +3629,25 @@ void Node::Peer::OnMsg(proto::Login&& msg)
 }
 
 void Node::Peer::OnMsg(proto::HaveTransaction&& msg)
+{
+    OnHaveTx(msg.m_ID);
+}
+
+void Node::Peer::OnMsg(proto::HaveTransactions&& msg)
+{
+    if (msg.m_IDs.size() > proto::g_TxInvMaxSize)
+        ThrowUnexpected();
+
+    for (size_t i = 0; i < msg.m_IDs.size(); i++)
+        OnHaveTx(msg.m_IDs[i]);
+
+    FlushTxInv(); // no need to delay the requests, they're already batched
+}
+
+void Node::Peer::OnHaveTx(const Transaction::KeyType& id)
 {
     TxPool::Fluff::Element::Tx key;
-    key.m_Key = msg.m_ID;
+    key.m_Key = id;
 
     TxPool::Fluff::TxSet::iterator it = m_This.m_TxPool.m_setTxs.find(key);
     if (m_This.m_TxPool.m_setTxs.end() != it)
@@ -2362,15 +3656,27 @@ void Node::Peer::OnMsg(proto::HaveTransaction&& msg)
     if (!m_This.m_Wtx.Add(key.m_Key))
         return; // already waiting for it
 
-    proto::GetTransaction msgOut;
-    msgOut.m_ID = msg.m_ID;
-    Send(msgOut);
+    RequestTx(id);
 }
 
 void Node::Peer::OnMsg(proto::GetTransaction&& msg)
+{
+    OnGetTx(msg.m_ID);
+}
+
+void Node::Peer::OnMsg(proto::GetTransactions&& msg)
+{
+    if (msg.m_IDs.size() > proto::g_TxInvMaxSize)
+        ThrowUnexpected();
+
+    for (size_t i = 0; i < msg.m_IDs.size(); i++)
+        OnGetTx(msg.m_IDs[i]);
+}
+
+void Node::Peer::OnGetTx(const Transaction::KeyType& id)
 {
     TxPool::Fluff::Element::Tx key;
-    key.m_Key = msg.m_ID;
+    key.m_Key = id;
 
     TxPool::Fluff::TxSet::iterator it = m_This.m_TxPool.m_setTxs.find(key);
     if (m_This.m_TxPool.m_setTxs.end() == it)
@@ -2379,6 +3685,77 @@ void Node::Peer::OnMsg(proto::GetTransaction&& msg)
     SendTx(it->get_ParentObj().m_pValue, true);
 }
 
+void Node::Peer::AnnounceTx(const Transaction::KeyType& id)
+{
+    if (proto::LoginFlags::TxInvBatches & m_LoginFlags)
+        QueueTxInv(m_vTxHave, id);
+    else
+    {
+        proto::HaveTransaction msg;
+        msg.m_ID = id;
+        Send(msg);
+    }
+}
+
+void Node::Peer::RequestTx(const Transaction::KeyType& id)
+{
+    if (proto::LoginFlags::TxInvBatches & m_LoginFlags)
+        QueueTxInv(m_vTxGet, id);
+    else
+    {
+        proto::GetTransaction msg;
+        msg.m_ID = id;
+        Send(msg);
+    }
+}
+
+void Node::Peer::QueueTxInv(std::vector<Transaction::KeyType>& v, const Transaction::KeyType& id)
+{
+    v.push_back(id);
+
+    if (v.size() >= proto::g_TxInvMaxSize)
+        FlushTxInv();
+    else
+        m_This.SetTxInvTimer();
+}
+
+void Node::Peer::FlushTxInv()
+{
+    if (!m_vTxHave.empty())
+    {
+        proto::HaveTransactions msg;
+        msg.m_IDs.swap(m_vTxHave);
+        Send(msg);
+    }
+
+    if (!m_vTxGet.empty())
+    {
+        proto::GetTransactions msg;
+        msg.m_IDs.swap(m_vTxGet);
+        Send(msg);
+    }
+}
+
+void Node::SetTxInvTimer()
+{
+    if (m_bTxInvPending)
+        return;
+
+    if (!m_pTxInvTimer)
+        m_pTxInvTimer = io::Timer::create(io::Reactor::get_Current());
+
+    m_pTxInvTimer->start(m_Cfg.m_Timeout.m_TxInvFlush_ms, false, [this]() { OnTxInvTimer(); });
+    m_bTxInvPending = true;
+}
+
+void Node::OnTxInvTimer()
+{
+    m_bTxInvPending = false;
+
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+        it->FlushTxInv();
+}
+
 void Node::Peer::SendTx(Transaction::Ptr& ptx, bool bFluff)
 {
     proto::NewTransaction msg;
@@ -2540,14 +3917,19 @@ bool Node::Processor::BuildCwp()
 
         virtual void get_StateAt(Block::SystemState::Full& s, const Difficulty::Raw& d) override
         {
-            uint64_t rowid = m_Proc.get_DB().FindStateWorkGreater(d);
-            m_Proc.get_DB().get_State(rowid, s);
+            const Block::SystemState::Full* pS = m_Proc.FindActiveWorkGreater(d);
+            if (pS)
+                s = *pS;
+            else
+            {
+                uint64_t rowid = m_Proc.get_DB().FindStateWorkGreater(d); // not expected, the DB is strict
+                m_Proc.get_DB().get_State(rowid, s);
+            }
         }
 
         virtual void get_Proof(Merkle::IProofBuilder& bld, Height h) override
         {
-            const NodeDB::StateID& sid = m_Proc.m_Cursor.m_Sid;
-            m_Proc.get_DB().get_Proof(bld, sid, h);
+            m_Proc.get_ActiveProof(bld, h);
         }
     };
 
@@ -2559,18 +3941,29 @@ bool Node::Processor::BuildCwp()
     return true;
 }
 
-void Node::Peer::OnMsg(proto::GetProofChainWork&& msg)
+const proto::ProofChainWork& Node::Processor::get_CwpCropped(const Difficulty::Raw& lowerBound)
 {
-    proto::ProofChainWork msgOut;
+    auto it = m_mapCwpCropped.find(lowerBound);
+    if (m_mapCwpCropped.end() != it)
+        return it->second;
 
-    Processor& p = m_This.m_Processor;
-    if (p.BuildCwp())
+    if (m_mapCwpCropped.size() >= s_CwpCroppedMax)
+        m_mapCwpCropped.clear(); // unlikely, clients usually ask for the same bounds
+
+    proto::ProofChainWork& msg = m_mapCwpCropped[lowerBound];
+
+    if (BuildCwp())
     {
-        msgOut.m_Proof.m_LowerBound = msg.m_LowerBound;
-        verify(msgOut.m_Proof.Crop(p.m_Cwp));
+        msg.m_Proof.m_LowerBound = lowerBound;
+        verify(msg.m_Proof.Crop(m_Cwp, false)); // our own proof, no need to re-verify the PoW
     }
 
-    Send(msgOut);
+    return msg;
+}
+
+void Node::Peer::OnMsg(proto::GetProofChainWork&& msg)
+{
+    Send(m_This.m_Processor.get_CwpCropped(msg.m_LowerBound));
 }
 
 void Node::Peer::OnMsg(proto::PeerInfoSelf&& msg)
@@ -2759,32 +4152,49 @@ void Node::Peer::OnMsg(proto::MacroblockGet&& msg)
                 if (id != msg.m_ID)
                     break;
 
-                // don't care if exc
-                Block::Body::RW rw;
-                m_This.m_Compressor.FmtPath(rw, ws.m_Sid.m_Height, NULL);
+                m_This.m_Compressor.get_Portion(msgOut.m_Portion, ws.m_Sid.m_Height, msg.m_Data, msg.m_Offset, m_This.m_Cfg.m_HistoryCompression.m_UploadPortion);
+            }
+			else
+				msgOut.m_SizeTotal = m_This.m_Compressor.get_SizeTotal(id.m_Height);
+
+            msgOut.m_ID = id;
+            break;
+        }
+    }
 
-                std::string sPath;
-                rw.GetPath(sPath, msg.m_Data);
+    Send(msgOut);
+}
 
-                std::FStream fs;
-                if (fs.Open(sPath.c_str(), true) && (fs.get_Remaining() > msg.m_Offset))
-                {
-                    uint64_t nDelta = fs.get_Remaining() - msg.m_Offset;
+void Node::Peer::OnMsg(proto::MacroblockGetRange&& msg)
+{
+    if (msg.m_Data >= Block::BodyBase::RW::Type::count)
+        ThrowUnexpected();
 
-                    uint32_t nPortion = m_This.m_Cfg.m_HistoryCompression.m_UploadPortion;
-                    if (nPortion > nDelta)
-                        nPortion = (uint32_t)nDelta;
+    proto::MacroblockRange msgOut;
+    ZeroObject(msgOut.m_ID);
+    msgOut.m_Data = msg.m_Data;
+    msgOut.m_Offset = msg.m_Offset;
+    msgOut.m_SizeData = 0;
+
+    uint32_t nPortion = std::min(msg.m_Size, m_This.m_Cfg.m_HistoryCompression.m_UploadPortion);
+    if (nPortion)
+    {
+        Processor& p = m_This.m_Processor;
+        NodeDB::WalkerState ws(p.get_DB());
+        for (p.get_DB().EnumMacroblocks(ws); ws.MoveNext(); )
+        {
+            if (msg.m_ID.m_Height < ws.m_Sid.m_Height)
+                continue;
 
-                    fs.Seek(msg.m_Offset);
+            Block::SystemState::ID id;
+            p.get_DB().get_StateID(ws.m_Sid, id);
 
-                    msgOut.m_Portion.resize(nPortion);
-                    fs.read(&msgOut.m_Portion.at(0), nPortion);
-                }
+            if (id == msg.m_ID)
+            {
+                msgOut.m_SizeData = m_This.m_Compressor.get_Portion(msgOut.m_Portion, ws.m_Sid.m_Height, msg.m_Data, msg.m_Offset, nPortion);
+                msgOut.m_ID = id;
             }
-			else
-				msgOut.m_SizeTotal = m_This.m_Compressor.get_SizeTotal(id.m_Height);
 
-            msgOut.m_ID = id;
             break;
         }
     }
@@ -16,6 +16,7 @@
 
 #include "processor.h"
 #include "utility/io/timer.h"
+#include "utility/io/buffer.h"
 #include "core/proto.h"
 #include "core/block_crypt.h"
 #include "core/peer_manager.h"
@@ -54,6 +55,7 @@ struct Node
 			uint32_t m_GetState_ms	= 1000 * 5;
 			uint32_t m_GetBlock_ms	= 1000 * 30;
 			uint32_t m_GetTx_ms		= 1000 * 5;
+			uint32_t m_TxInvFlush_ms = 50; // max delay of the batched tx inventory
 			uint32_t m_GetBbsMsg_ms	= 1000 * 10;
 			uint32_t m_MiningSoftRestart_ms = 100;
 			uint32_t m_TopPeersUpd_ms = 1000 * 60 * 10; // once in 10 minutes
@@ -64,7 +66,23 @@ struct Node
 			uint32_t m_BbsCleanupPeriod_ms = 3600 * 1000; // 1 hour
 		} m_Timeout;
 
-		uint32_t m_MaxConcurrentBlocksRequest = 5;
+		struct BlockDownload
+		{
+			// Per-peer window of the blocks in flight. Grows like TCP slow start while the peer keeps up,
+			// bounded by the observed bandwidth-delay product, halved when the peer turns out to be a straggler.
+			uint32_t m_WindowInit = 2;
+			uint32_t m_WindowMax = 16;
+
+			// The block the processor needs next is re-requested from a faster peer if it's late
+			// by this factor wrt the expected delivery time, but not earlier than m_StragglerMin_ms
+			uint32_t m_StragglerFactor = 4;
+			uint32_t m_StragglerMin_ms = 1000 * 3;
+
+			uint32_t m_CheckPeriod_ms = 1000;
+			uint32_t m_StatsPeriod_ms = 1000 * 30; // per-peer stats in the log
+
+		} m_BlockDownload;
+
 		uint32_t m_BbsIdealChannelPopulation = 100;
 		uint32_t m_MaxPoolTransactions = 100 * 1000;
 		uint32_t m_MiningThreads = 0; // by default disabled
@@ -82,6 +100,9 @@ struct Node
 			uint32_t m_Naggling = 32;			// combine up to 32 blocks in memory, before involving file system
 			uint32_t m_MaxBacklog = 7;
 
+			uint32_t m_MergeFanIn = 16; // ranges merged in a single k-way pass
+			uint32_t m_MergeThreads = 2; // independent merges running in parallel
+
 			uint32_t m_UploadPortion = 5 * 1024 * 1024; // set to 0 to disable upload
 
 		} m_HistoryCompression;
@@ -100,6 +121,10 @@ struct Node
 			uint32_t m_SrcPeers = 5;
 			uint32_t m_Timeout_ms = 10000;
 
+			// macroblock files are split into chunks, downloaded from all the suitable peers in parallel
+			uint32_t m_ChunkSize = 1024 * 1024;
+			uint32_t m_RequestsPerPeer = 4; // pipelined chunk requests
+
 			bool m_ForceResync = false;
 			bool m_NoFastSync = false;
 		} m_Sync;
@@ -145,6 +170,7 @@ struct Node
 	void ImportMacroblock(Height); // throws on err
 
 	NodeProcessor& get_Processor() { return m_Processor; } // for tests only!
+	TxPool::Fluff& get_TxPool() { return m_TxPool; } // for tests only!
 
 	struct SyncStatus
 	{
@@ -155,10 +181,25 @@ struct Node
 		Height m_Done;
 		Height m_Total;
 
+		uint32_t m_HdrsPerSec = 0; // headers received and verified, averaged over the last second or so. Reset when synced
+
 		bool operator == (const SyncStatus&) const;
 
 	} m_SyncStatus;
 
+	struct DownloadStats
+	{
+		uint64_t m_Blocks = 0; // received from the peers
+		uint64_t m_Bytes = 0;
+		uint32_t m_Stragglers = 0; // blocks re-requested from a faster peer
+		uint32_t m_Compact = 0; // blocks rebuilt from the compact form
+		uint32_t m_CompactMissing = 0; // needed the GetBodyMissing round trip
+		uint32_t m_CompactMismatch = 0; // rebuilt incorrectly, re-requested in full
+		uint64_t m_MacroblockBytes = 0; // macroblock data received during the sync
+		uint64_t m_MacroblockBytesLegacy = 0; // of them via MacroblockGet, from the peers that don't serve ranges
+
+	} m_DownloadStats;
+
 	bool m_UpdatedFromPeers = false;
 
 private:
@@ -172,10 +213,13 @@ private:
 		void OnNewState() override;
 		void OnRolledBack() override;
 		bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&) override;
+		bool VerifyMacroBlock(const Block::BodyBase&, Block::BodyBase::RW&, const HeightRange&) override;
+		void VerifyPoW(const Block::SystemState::Full*, uint32_t nCount, uint8_t* pValid) override;
 		void AdjustFossilEnd(Height&) override;
 		bool OpenMacroblock(Block::BodyBase::RW&, const NodeDB::StateID&) override;
 		void OnModified() override;
 		bool EnumViewerKeys(IKeyWalker&) override;
+		void RecognizeOutputs(const Output* const* ppOut, uint32_t nCount, Key::IDV* pKidv, uint8_t* pFound) override;
 
 		struct Verifier
 		{
@@ -183,8 +227,20 @@ private:
 
 			const TxBase* m_pTx;
 			TxBase::IReader* m_pR;
+			Block::BodyBase::RW* m_pRW; // range-partitioned mode
 			TxBase::Context* m_pCtx;
 
+			// alternatively - PoW of the headers
+			const Block::SystemState::Full* m_pHdrs;
+			uint8_t* m_pHdrValid;
+			uint32_t m_nHdrs;
+
+			// alternatively - recognition of the outputs by the viewer keys
+			const Output* const* m_ppOuts;
+			Key::IDV* m_pOutKidv;
+			uint8_t* m_pOutFound;
+			uint32_t m_nOuts;
+
 			bool m_bFail;
 			uint32_t m_iTask;
 			uint32_t m_Remaining;
@@ -197,6 +253,11 @@ private:
 			std::unique_ptr<MyBatch> m_pBc;
 
 			bool ValidateAndSummarize(TxBase::Context&, const TxBase&, TxBase::IReader&&);
+			bool ValidateMacroblock(TxBase::Context&, const TxBase&, Block::BodyBase::RW&);
+			MyBatch& PrepareBatch(); // single-threaded mode
+			void VerifyPoW(const Block::SystemState::Full*, uint32_t nCount, uint8_t* pValid);
+			void RecognizeOutputs(const Output* const* ppOut, uint32_t nCount, Key::IDV* pKidv, uint8_t* pFound);
+			void RunTask(std::unique_lock<std::mutex>&);
 			void Thread(uint32_t);
 
 			IMPLEMENT_GET_PARENT_OBJ(Processor, m_Verifier)
@@ -205,6 +266,19 @@ private:
 		Block::ChainWorkProof m_Cwp; // cached
 		bool BuildCwp();
 
+		// cropped proofs, ready to be sent. Flushed on the new tip
+		std::map<Difficulty::Raw, proto::ProofChainWork> m_mapCwpCropped;
+		static const size_t s_CwpCroppedMax = 32;
+		const proto::ProofChainWork& get_CwpCropped(const Difficulty::Raw& lowerBound);
+
+		struct CompactTip
+		{
+			Block::SystemState::ID m_ID;
+			proto::BodyCompact m_Msg;
+		};
+
+		std::unique_ptr<CompactTip> m_pCompactTip; // built before the tip txs are evicted from the pool
+
 		void GenerateProofStateStrict(Merkle::HardProof&, Height);
 
 		bool m_bFlushPending = false;
@@ -222,6 +296,9 @@ private:
 
 	TxPool::Fluff m_TxPool;
 
+	bool LoadBody(const Block::SystemState::ID&, ByteBuffer& bbP, ByteBuffer& bbE);
+	bool BuildCompact(proto::BodyCompact&, const Block::SystemState::ID&);
+
 	struct Peer;
 
 	struct Task
@@ -232,8 +309,19 @@ private:
 		Key m_Key;
 
 		bool m_bPack;
+		bool m_bDuplicate; // left with the straggler after the task was re-requested elsewhere. Not in m_setTasks
+		bool m_bIdleSent; // the peer had nothing else pending, the response time is the round trip
 		Height m_hTarget;
 		Peer* m_pOwner;
+		uint32_t m_Sent_ms;
+
+		struct Compact
+		{
+			Block::Body m_Body; // missing elements are NULL
+			ECC::Hash::Value m_Checksum;
+		};
+
+		std::unique_ptr<Compact> m_pCompact; // set while waiting for the missing elements of the compact block
 
 		bool operator < (const Task& t) const { return (m_Key < t.m_Key); }
 	};
@@ -261,8 +349,25 @@ private:
 
 		Block::SystemState::ID m_Trg;
 
-		uint32_t m_RequestsPending = 0;
-		uint8_t m_iData = 0;
+		uint32_t m_RequestsPending = 0; // detection responses
+
+		struct Chunk
+		{
+			uint32_t m_Done; // bytes received
+			Peer* m_pOwner; // requested from
+		};
+
+		struct Data
+		{
+			static const uint64_t s_SizeUnknown = uint64_t(-1);
+
+			uint64_t m_Size; // learned from the 1st response
+			std::vector<Chunk> m_vChunks; // known prefix is complete, the rest is assigned as the size is known
+
+			uint32_t get_ChunkSize(size_t iChunk, uint32_t nChunkSize) const;
+			bool IsComplete(size_t iChunk, uint32_t nChunkSize) const;
+
+		} m_pData[Block::Body::RW::Type::count];
 
 		uint64_t m_SizeTotal;
 		uint64_t m_SizeCompleted;
@@ -270,10 +375,29 @@ private:
 
 	void UpdateSyncStatus();
 	void UpdateSyncStatusRaw();
+
+	struct HdrRate
+	{
+		uint32_t m_Start_ms = 0;
+		uint32_t m_Count = 0;
+	} m_HdrRate;
+
+	void OnHdrsAccepted(uint32_t nCount);
 	void OnSyncTimer();
 	void SyncCycle();
 	bool SyncCycle(Peer&);
-	void SyncCycle(Peer&, const ByteBuffer&);
+	void SyncCycle(Peer&, proto::MacroblockRange&);
+	bool SyncCycleLegacy(Peer&);
+	void SyncCycleLegacy(Peer&, proto::Macroblock&);
+	void SyncWrite(uint8_t iData, uint64_t nOffset, const ByteBuffer&, uint32_t nSize);
+	void SyncOnData();
+	void SyncInitData(uint64_t nSizePrefix, uint8_t iData);
+	void SyncSetSize(uint64_t nSize, uint8_t iData);
+	void SyncRelease(Peer&);
+	bool SyncIsComplete() const;
+	void SyncGetStatePath(std::string&);
+	void SyncLoad();
+	void SyncSave();
 
 	std::unique_ptr<FirstTimeSync> m_pSync;
 
@@ -281,6 +405,15 @@ private:
 	bool TryAssignTask(Task&, Peer&);
 	void DeleteUnassignedTask(Task&);
 
+	uint32_t get_BlocksBacklog();
+	io::Timer::Ptr m_pDownloadTimer;
+	bool m_bDownloadPending = false;
+	uint32_t m_DownloadStatsLast_ms = 0;
+	void SetDownloadTimer();
+	void OnDownloadTimer();
+	bool ReRequestStraggler(Task&);
+	void LogDownloadStats();
+
 	void InitKeys();
 	void InitIDs();
 	void InitMode();
@@ -347,6 +480,11 @@ private:
 	bool OnTransactionFluff(Transaction::Ptr&&, const Peer*, Dandelion::Element*);
 
 	bool ValidateTx(Transaction::Context&, const Transaction&); // complete validation
+
+	io::Timer::Ptr m_pTxInvTimer;
+	bool m_bTxInvPending = false;
+	void SetTxInvTimer();
+	void OnTxInvTimer();
 	void LogTx(const Transaction&, bool bValid, const Transaction::KeyType&);
 
 	struct Bbs
@@ -432,7 +570,7 @@ private:
 			static const uint16_t Owner			= 0x004;
 			static const uint16_t ProvenWorkReq	= 0x008;
 			static const uint16_t ProvenWork	= 0x010;
-			static const uint16_t SyncPending	= 0x020;
+			static const uint16_t SyncPending	= 0x020; // legacy MacroblockGet
 			static const uint16_t DontSync		= 0x040;
 			static const uint16_t Finalizing	= 0x080;
 			static const uint16_t HasTreasury	= 0x100;
@@ -446,10 +584,28 @@ private:
 		uint8_t m_LoginFlags;
 
 		TaskList m_lstTasks;
+		uint32_t m_SyncRequests; // macroblock chunks requested
+
+		struct Download
+		{
+			uint32_t m_Window; // max blocks in flight
+			uint32_t m_SsThresh; // slow start threshold
+			uint32_t m_Acked; // blocks delivered since the last window increment, above the threshold
+			uint32_t m_Rtt_ms; // smoothed, 0 if unknown
+			uint32_t m_Bps; // smoothed, 0 if unknown
+			uint32_t m_LastDone_ms;
+			uint64_t m_Blocks;
+			uint64_t m_Bytes;
+			uint32_t m_Stragglers;
+		} m_Download;
+
 		std::set<Task::Key> m_setRejected; // data that shouldn't be requested from this peer. Reset after reconnection or on receiving NewTip
 
 		Bbs::Subscription::PeerSet m_Subscriptions;
 
+		std::vector<Transaction::KeyType> m_vTxHave; // batched inventory, not sent yet
+		std::vector<Transaction::KeyType> m_vTxGet;
+
 		io::Timer::Ptr m_pTimer;
 		io::Timer::Ptr m_pTimerPeers;
 
@@ -470,12 +626,33 @@ private:
 		void DeleteSelf(bool bIsError, uint8_t nByeReason);
 
 		bool ShouldAssignTasks();
+		uint32_t get_BlocksWindow() const;
+		uint32_t get_BlocksInFlight() const;
+		uint32_t get_ExpectedDelivery_ms(const Task&) const;
+		void OnTaskResponse(const Task&, uint32_t nSize);
+		void OnBlockDelivered(uint32_t nSize);
+		void OnStraggler();
 		bool ShouldFinalizeMining();
 		Task& get_FirstTask();
 		void OnFirstTaskDone();
 		void OnFirstTaskDone(NodeProcessor::DataStatus::Enum);
+		void RequeueFirstTask(); // after a follow-up request is sent
+
+		void OnBody(Task&, const ByteBuffer& bbP, const ByteBuffer& bbE);
+		void OnCompactComplete(Task&);
+
+		template <typename T>
+		void ExpandCompact(std::vector<std::unique_ptr<T> >&, const std::vector<uint64_t>& vIDs, const T* (TxPool::Fluff::Element::Part::*)() const, std::vector<uint32_t>& vMissing);
+		template <typename T>
+		static void FillMissing(std::vector<std::unique_ptr<T> >&, std::vector<std::unique_ptr<T> >& vSrc);
 
 		void SendTx(Transaction::Ptr& ptx, bool bFluff);
+		void AnnounceTx(const Transaction::KeyType&);
+		void RequestTx(const Transaction::KeyType&);
+		void QueueTxInv(std::vector<Transaction::KeyType>&, const Transaction::KeyType&);
+		void FlushTxInv();
+		void OnHaveTx(const Transaction::KeyType&);
+		void OnGetTx(const Transaction::KeyType&);
 
 		// proto::NodeConnection
 		virtual void OnConnectedSecure() override;
@@ -494,9 +671,15 @@ private:
 		virtual void OnMsg(proto::HdrPack&&) override;
 		virtual void OnMsg(proto::GetBody&&) override;
 		virtual void OnMsg(proto::Body&&) override;
+		virtual void OnMsg(proto::GetBodyCompact&&) override;
+		virtual void OnMsg(proto::BodyCompact&&) override;
+		virtual void OnMsg(proto::GetBodyMissing&&) override;
+		virtual void OnMsg(proto::BodyMissing&&) override;
 		virtual void OnMsg(proto::NewTransaction&&) override;
 		virtual void OnMsg(proto::HaveTransaction&&) override;
 		virtual void OnMsg(proto::GetTransaction&&) override;
+		virtual void OnMsg(proto::HaveTransactions&&) override;
+		virtual void OnMsg(proto::GetTransactions&&) override;
 		virtual void OnMsg(proto::GetCommonState&&) override;
 		virtual void OnMsg(proto::GetProofState&&) override;
 		virtual void OnMsg(proto::GetProofKernel&&) override;
@@ -514,6 +697,8 @@ private:
 		virtual void OnMsg(proto::BbsPickChannel&&) override;
 		virtual void OnMsg(proto::MacroblockGet&&) override;
 		virtual void OnMsg(proto::Macroblock&&) override;
+		virtual void OnMsg(proto::MacroblockGetRange&&) override;
+		virtual void OnMsg(proto::MacroblockRange&&) override;
 		virtual void OnMsg(proto::ProofChainWork&&) override;
 		virtual void OnMsg(proto::GetUtxoEvents&&) override;
 		virtual void OnMsg(proto::BlockFinalization&&) override;
@@ -639,10 +824,49 @@ private:
 		void OnNotify();
 		void Proceed();
 		bool ProceedInternal();
-		bool SquashOnce(std::vector<HeightRange>&);
-		bool SquashOnce(Block::BodyBase::RW&, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1);
 		uint64_t get_SizeTotal(Height);
 
+		struct Squash;
+		struct Range
+		{
+			HeightRange m_hr;
+			bool m_bMacroblock = false; // the previous macroblock, not a temporary range
+			std::unique_ptr<Squash> m_pSquash; // set while being merged
+
+			Range();
+			Range(Range&&);
+			~Range();
+		};
+
+		typedef std::vector<Range> RangeVec;
+
+		struct SquashQueue;
+		bool SquashStart(SquashQueue&, RangeVec& vSrc, Range& res);
+		bool SquashAll(SquashQueue&, RangeVec&);
+
+		struct Stats
+		{
+			uint32_t m_RangesExported = 0;
+			uint32_t m_RangesTotal = 0;
+			uint32_t m_Squashes = 0; // k-way merges completed
+			uint64_t m_SizeSquashed = 0; // bytes written by the merges
+			uint64_t m_Squash_ms = 0; // accumulated over all the threads
+		};
+
+		Stats get_Stats(); // can be called while the history is generated
+		Stats m_Stats; // protected by m_Mutex
+
+		// the most recently served macroblock, mapped into memory
+		struct Served
+		{
+			Height m_Height = 0;
+			io::SharedBuffer m_pData[Block::Body::RW::Type::count];
+		} m_Served;
+
+		const io::SharedBuffer& get_Served(Height, uint8_t iData);
+		uint64_t get_Portion(ByteBuffer&, Height, uint8_t iData, uint64_t nOffset, uint32_t nMaxSize); // returns the data size
+		void ResetServed(); // must be called before the files are deleted or replaced
+
 		PerThread m_Link;
 		std::mutex m_Mutex;
 		std::condition_variable m_Cond;
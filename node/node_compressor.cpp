@@ -92,6 +92,8 @@ void Node::Compressor::Delete(const NodeDB::StateID& sid)
 	NodeDB& db = get_ParentObj().m_Processor.get_DB();
 	db.MacroblockDel(sid.m_Row);
 
+	ResetServed();
+
 	Block::BodyBase::RW rw;
 	FmtPath(rw, sid.m_Height, NULL);
 	rw.Delete();
@@ -157,6 +159,20 @@ void Node::Compressor::FmtPath(std::string& out, Height h, const Height* pH0)
 	out = str.str();
 }
 
+static bool MoveHistoryFile(const std::string& sSrc, const std::string& sTrg)
+{
+	// missing source is ok
+#ifdef WIN32
+	return
+		MoveFileExW(Utf8toUtf16(sSrc.c_str()).c_str(), Utf8toUtf16(sTrg.c_str()).c_str(), MOVEFILE_REPLACE_EXISTING) ||
+		(GetLastError() == ERROR_FILE_NOT_FOUND);
+#else // WIN32
+	return
+		!rename(sSrc.c_str(), sTrg.c_str()) ||
+		(ENOENT == errno);
+#endif // WIN32
+}
+
 void Node::Compressor::OnNotify()
 {
 	assert(m_hrNew.m_Max);
@@ -192,6 +208,8 @@ void Node::Compressor::OnNotify()
 
 		if (m_bSuccess)
 		{
+			ResetServed();
+
 			Block::Body::RW rwSrc, rwTrg;
 			FmtPath(rwSrc, h, &Rules::HeightGenesis);
 			FmtPath(rwTrg, h, NULL);
@@ -203,15 +221,13 @@ void Node::Compressor::OnNotify()
 				rwSrc.GetPath(sSrc, i);
 				rwTrg.GetPath(sTrg, i);
 
-#ifdef WIN32
-				bool bOk =
-					MoveFileExW(Utf8toUtf16(sSrc.c_str()).c_str(), Utf8toUtf16(sTrg.c_str()).c_str(), MOVEFILE_REPLACE_EXISTING) ||
-					(GetLastError() == ERROR_FILE_NOT_FOUND);
-#else // WIN32
-				bool bOk =
-					!rename(sSrc.c_str(), sTrg.c_str()) ||
-					(ENOENT == errno);
-#endif // WIN32
+				bool bOk = MoveHistoryFile(sSrc, sTrg);
+
+				if (bOk && rwSrc.GetIndexPath(sSrc, i))
+				{
+					rwTrg.GetIndexPath(sTrg, i);
+					bOk = MoveHistoryFile(sSrc, sTrg);
+				}
 
 				if (!bOk)
 				{
@@ -278,19 +294,163 @@ void Node::Compressor::Proceed()
 	m_Link.m_pEvt->post();
 }
 
+// k-way merge of consequent ranges into one, on its own thread
+struct Node::Compressor::Squash
+{
+	Compressor& m_This;
+
+	std::vector<std::unique_ptr<Block::Body::RW> > m_vSrc;
+	Block::Body::RW m_Rw;
+
+	std::thread m_Thread;
+	bool m_bSuccess = false;
+	bool m_bJoined = false;
+
+	Squash(Compressor& x) :m_This(x) {}
+
+	~Squash()
+	{
+		Wait();
+	}
+
+	bool Wait()
+	{
+		if (!m_bJoined)
+		{
+			m_bJoined = true;
+			if (m_Thread.joinable())
+				m_Thread.join();
+		}
+
+		return m_bSuccess;
+	}
+
+	void Run()
+	{
+		try {
+			m_bSuccess = RunInternal();
+		} catch (const std::exception& e) {
+			LOG_WARNING() << "History squash " << e.what();
+		}
+	}
+
+	bool RunInternal()
+	{
+		uint32_t t_ms = GetTime_ms();
+
+		std::vector<Block::BodyBase::IMacroReader*> vR(m_vSrc.size());
+		std::vector<TxBase::IReader*> vR2(m_vSrc.size());
+
+		for (size_t i = 0; i < m_vSrc.size(); i++)
+		{
+			m_vSrc[i]->ROpen();
+			vR[i] = m_vSrc[i].get();
+			vR2[i] = m_vSrc[i].get();
+		}
+
+		m_Rw.m_hvContentTag = m_This.m_hvTag;
+		m_Rw.WCreate();
+
+		int nR = static_cast<int>(vR.size());
+		if (!m_Rw.CombineHdr(&vR.front(), nR, m_This.m_bStop))
+			return false;
+
+		if (!m_Rw.Combine(&vR2.front(), nR, m_This.m_bStop))
+			return false;
+
+		m_Rw.Close();
+		m_Rw.m_bAutoDelete = false;
+
+		uint64_t nSize = 0;
+		for (int i = 0; i < Block::Body::RW::Type::count; i++)
+		{
+			std::string sPath;
+			m_Rw.GetPath(sPath, i);
+
+			std::FStream fs;
+			if (fs.Open(sPath.c_str(), true))
+				nSize += fs.get_Remaining();
+		}
+
+		std::unique_lock<std::mutex> scope(m_This.m_Mutex);
+		m_This.m_Stats.m_Squashes++;
+		m_This.m_Stats.m_SizeSquashed += nSize;
+		m_This.m_Stats.m_Squash_ms += GetTime_ms() - t_ms;
+
+		return true;
+	}
+};
+
+// merges in progress, oldest first
+struct Node::Compressor::SquashQueue
+{
+	std::deque<Squash*> m_q;
+	uint32_t m_nMax;
+
+	bool Wait(Squash& x)
+	{
+		std::deque<Squash*>::iterator it = std::find(m_q.begin(), m_q.end(), &x);
+		if (m_q.end() != it)
+			m_q.erase(it);
+
+		return x.Wait();
+	}
+
+	bool Throttle()
+	{
+		while (m_q.size() >= m_nMax)
+		{
+			Squash* p = m_q.front();
+			m_q.pop_front();
+
+			if (!p->Wait())
+				return false;
+		}
+		return true;
+	}
+};
+
+Node::Compressor::Range::Range() {}
+Node::Compressor::Range::Range(Range&& x)
+	:m_hr(x.m_hr)
+	,m_bMacroblock(x.m_bMacroblock)
+	,m_pSquash(std::move(x.m_pSquash))
+{
+}
+Node::Compressor::Range::~Range() {}
+
+Node::Compressor::Stats Node::Compressor::get_Stats()
+{
+	std::unique_lock<std::mutex> scope(m_Mutex);
+	return m_Stats;
+}
+
 bool Node::Compressor::ProceedInternal()
 {
 	assert(m_hrNew.m_Max);
 	const Config::HistoryCompression& cfg = get_ParentObj().m_Cfg.m_HistoryCompression;
 
-	std::vector<HeightRange> v;
+	const uint32_t nNaggling = std::max(cfg.m_Naggling, 1U);
+	const uint32_t nFanIn = std::max(cfg.m_MergeFanIn, 2U);
 
-	uint32_t i = 0;
-	for (Height hPos = m_hrNew.m_Min; hPos < m_hrNew.m_Max; i++)
+	{
+		std::unique_lock<std::mutex> scope(m_Mutex);
+		m_Stats = Stats();
+		m_Stats.m_RangesTotal = static_cast<uint32_t>((m_hrNew.m_Max - m_hrNew.m_Min + nNaggling - 1) / nNaggling);
+	}
+
+	SquashQueue sq;
+	sq.m_nMax = std::max(cfg.m_MergeThreads, 1U);
+
+	// Ranges are exported one by one (this must be done in the main thread), and merged in the background as soon as there are enough of them.
+	// vLevels[i] contains the ranges merged i times, older levels hold older ranges.
+	std::vector<RangeVec> vLevels(1);
+
+	for (Height hPos = m_hrNew.m_Min; hPos < m_hrNew.m_Max; )
 	{
 		HeightRange hr;
 		hr.m_Min = hPos + 1; // convention is boundary-inclusive, whereas m_hrNew excludes min bound
-		hr.m_Max = std::min(hPos + cfg.m_Naggling, m_hrNew.m_Max);
+		hr.m_Max = std::min(hPos + nNaggling, m_hrNew.m_Max);
 
 		{
 			std::unique_lock<std::mutex> scope(m_Mutex);
@@ -302,76 +462,138 @@ bool Node::Compressor::ProceedInternal()
 
 			if (m_bStop)
 				return false;
+
+			m_Stats.m_RangesExported++;
 		}
 
-		v.push_back(hr);
+		vLevels[0].emplace_back();
+		vLevels[0].back().m_hr = hr;
 		hPos = hr.m_Max;
 
-		for (uint32_t j = i; 1 & j; j >>= 1)
-			SquashOnce(v);
-	}
+		for (size_t iLevel = 0; vLevels[iLevel].size() >= nFanIn; iLevel++)
+		{
+			if (vLevels.size() == iLevel + 1)
+				vLevels.emplace_back();
 
-	while (v.size() > 1)
-		SquashOnce(v);
+			Range res;
+			if (!SquashStart(sq, vLevels[iLevel], res))
+				return false;
+
+			vLevels[iLevel + 1].push_back(std::move(res));
+		}
+	}
 
+	RangeVec v;
 	if (m_hrNew.m_Min >= Rules::HeightGenesis)
 	{
-		Block::Body::RW rw, rwSrc0, rwSrc1;
+		// merge with the previous macroblock in the same pass
+		v.emplace_back();
+		v.back().m_hr.m_Min = Rules::HeightGenesis;
+		v.back().m_hr.m_Max = m_hrNew.m_Min;
+		v.back().m_bMacroblock = true;
+	}
 
-		FmtPath(rw, m_hrNew.m_Max, &Rules::HeightGenesis);
-		FmtPath(rwSrc0, m_hrNew.m_Min, NULL);
+	for (size_t iLevel = vLevels.size(); iLevel--; )
+		for (size_t i = 0; i < vLevels[iLevel].size(); i++)
+			v.push_back(std::move(vLevels[iLevel][i]));
 
-		Height h0 = m_hrNew.m_Min + 1;
-		FmtPath(rwSrc1, m_hrNew.m_Max, &h0);
+	if (!SquashAll(sq, v))
+		return false;
 
-		rw.m_bAutoDelete = rwSrc1.m_bAutoDelete = true;
+	assert((1 == v.size()) && (Rules::HeightGenesis == v.front().m_hr.m_Min));
 
-		if (!SquashOnce(rw, rwSrc0, rwSrc1))
-			return false;
-
-		rw.m_bAutoDelete = false;
-	}
+	Stats st = get_Stats();
+	LOG_INFO() << "History squashed: " << st.m_Squashes << " merges, " << (st.m_SizeSquashed >> 20) << " MB written in " << st.m_Squash_ms << " ms";
 
 	return true;
 }
 
-bool Node::Compressor::SquashOnce(std::vector<HeightRange>& v)
+bool Node::Compressor::SquashStart(SquashQueue& sq, RangeVec& vSrc, Range& res)
 {
-	assert(v.size() >= 2);
+	assert(vSrc.size() >= 2);
 
-	HeightRange& hr0 = v[v.size() - 2];
-	HeightRange& hr1 = v[v.size() - 1];
+	for (size_t i = 0; i < vSrc.size(); i++)
+	{
+		Range& r = vSrc[i];
+		if (r.m_pSquash)
+		{
+			if (!sq.Wait(*r.m_pSquash))
+				return false;
+			r.m_pSquash.reset();
+		}
+	}
 
-	Block::Body::RW rw, rwSrc0, rwSrc1;
-	FmtPath(rw, hr1.m_Max, &hr0.m_Min);
-	FmtPath(rwSrc0, hr0.m_Max, &hr0.m_Min);
-	FmtPath(rwSrc1, hr1.m_Max, &hr1.m_Min);
+	if (!sq.Throttle())
+		return false;
 
-	hr0.m_Max = hr1.m_Max;
-	v.pop_back();
+	res.m_hr.m_Min = vSrc.front().m_hr.m_Min;
+	res.m_hr.m_Max = vSrc.back().m_hr.m_Max;
+	res.m_pSquash.reset(new Squash(*this));
 
-	rw.m_bAutoDelete = rwSrc0.m_bAutoDelete = rwSrc1.m_bAutoDelete = true;
+	Squash& x = *res.m_pSquash;
+	x.m_vSrc.resize(vSrc.size());
 
-	if (!SquashOnce(rw, rwSrc0, rwSrc1))
-		return false;
+	for (size_t i = 0; i < vSrc.size(); i++)
+	{
+		const Range& r = vSrc[i];
+
+		x.m_vSrc[i].reset(new Block::Body::RW);
+		Block::Body::RW& rw = *x.m_vSrc[i];
+
+		FmtPath(rw, r.m_hr.m_Max, r.m_bMacroblock ? NULL : &r.m_hr.m_Min);
+		rw.m_bAutoDelete = !r.m_bMacroblock;
+	}
+
+	vSrc.clear();
+
+	FmtPath(x.m_Rw, res.m_hr.m_Max, &res.m_hr.m_Min);
+	x.m_Rw.m_bAutoDelete = true;
+
+	sq.m_q.push_back(&x);
+	x.m_Thread = std::thread(&Squash::Run, &x);
 
-	rw.m_bAutoDelete = false;
 	return true;
 }
 
-bool Node::Compressor::SquashOnce(Block::BodyBase::RW& rw, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1)
+bool Node::Compressor::SquashAll(SquashQueue& sq, RangeVec& v)
 {
-	rwSrc0.ROpen();
-	rwSrc1.ROpen();
+	assert(!v.empty());
 
-	rw.m_hvContentTag = m_hvTag;
-	rw.WCreate();
+	while (v.size() > 1)
+	{
+		// independent groups are merged in parallel
+		RangeVec vNext;
 
-	if (!rw.CombineHdr(std::move(rwSrc0), std::move(rwSrc1), m_bStop))
-		return false;
+		for (size_t i0 = 0; i0 < v.size(); )
+		{
+			size_t i1 = std::min(i0 + std::max(get_ParentObj().m_Cfg.m_HistoryCompression.m_MergeFanIn, 2U), v.size());
 
-	if (!rw.Combine(std::move(rwSrc0), std::move(rwSrc1), m_bStop))
-		return false;
+			if (i1 - i0 > 1)
+			{
+				RangeVec vSrc;
+				for (size_t i = i0; i < i1; i++)
+					vSrc.push_back(std::move(v[i]));
+
+				vNext.emplace_back();
+				if (!SquashStart(sq, vSrc, vNext.back()))
+					return false;
+			}
+			else
+				vNext.push_back(std::move(v[i0]));
+
+			i0 = i1;
+		}
+
+		v.swap(vNext);
+	}
+
+	Range& r = v.front();
+	if (r.m_pSquash)
+	{
+		if (!sq.Wait(*r.m_pSquash))
+			return false;
+		r.m_pSquash.reset();
+	}
 
 	return true;
 }
@@ -396,4 +618,58 @@ uint64_t Node::Compressor::get_SizeTotal(Height h)
 	return ret;
 }
 
+const io::SharedBuffer& Node::Compressor::get_Served(Height h, uint8_t iData)
+{
+	assert(iData < Block::Body::RW::Type::count);
+
+	if (m_Served.m_Height != h)
+	{
+		ResetServed();
+
+		Block::Body::RW rw;
+		FmtPath(rw, h, NULL);
+
+		for (uint8_t i = 0; i < Block::Body::RW::Type::count; i++)
+		{
+			std::string sPath;
+			rw.GetPath(sPath, i);
+
+			try {
+				m_Served.m_pData[i] = io::map_file_read_only(sPath.c_str());
+			} catch (const std::exception& e) {
+				LOG_WARNING() << "History map " << e.what();
+			}
+		}
+
+		m_Served.m_Height = h;
+	}
+
+	return m_Served.m_pData[iData];
+}
+
+uint64_t Node::Compressor::get_Portion(ByteBuffer& res, Height h, uint8_t iData, uint64_t nOffset, uint32_t nMaxSize)
+{
+	const io::SharedBuffer& buf = get_Served(h, iData);
+
+	if (buf.size > nOffset)
+	{
+		uint64_t nDelta = buf.size - nOffset;
+		if (nMaxSize > nDelta)
+			nMaxSize = static_cast<uint32_t>(nDelta);
+
+		const uint8_t* p = buf.data + nOffset;
+		res.assign(p, p + nMaxSize);
+	}
+
+	return buf.size;
+}
+
+void Node::Compressor::ResetServed()
+{
+	m_Served.m_Height = 0;
+
+	for (uint8_t i = 0; i < Block::Body::RW::Type::count; i++)
+		m_Served.m_pData[i].clear();
+}
+
 } // namespace beam
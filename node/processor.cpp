@@ -12,10 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <thread>
 #include "processor.h"
 #include "../core/treasury.h"
 #include "../core/serialization_adapters.h"
 #include "../utility/serialize.h"
+#include "../utility/helpers.h"
 #include "../utility/logger.h"
 #include "../utility/logger_checkpoints.h"
 
@@ -60,6 +62,7 @@ void NodeProcessor::Initialize(const char* szPath, bool bResetCursor /* = false
 		m_DB.ResetCursor();
 
 	InitCursor();
+	InitActive();
 
 	InitializeFromBlocks();
 
@@ -117,6 +120,111 @@ void NodeProcessor::InitCursor()
 	m_Cursor.m_DifficultyNext = get_NextDifficulty();
 }
 
+void NodeProcessor::InitActive()
+{
+	m_vActive.clear();
+	m_ActiveMmr.Truncate(0);
+
+	NodeDB::WalkerState ws(m_DB);
+	for (m_DB.EnumActive(ws); ws.MoveNext(); )
+	{
+		if (ws.m_Sid.m_Height != m_vActive.size() + Rules::HeightGenesis)
+			OnCorrupted();
+
+		m_vActive.emplace_back();
+		m_DB.get_State(ws.m_Sid.m_Row, m_vActive.back());
+	}
+
+	if (m_vActive.size() + Rules::HeightGenesis != m_Cursor.m_Sid.m_Height + 1)
+		OnCorrupted();
+}
+
+void NodeProcessor::PushActive(const Block::SystemState::Full& s)
+{
+	assert(s.m_Height >= Rules::HeightGenesis);
+	size_t nPos = static_cast<size_t>(s.m_Height - Rules::HeightGenesis);
+
+	assert(nPos <= m_vActive.size());
+	m_vActive.resize(nPos);
+	m_vActive.push_back(s);
+
+	m_ActiveMmr.Truncate(nPos);
+}
+
+const Block::SystemState::Full* NodeProcessor::get_Active(Height h) const
+{
+	if ((h < Rules::HeightGenesis) || (h - Rules::HeightGenesis >= m_vActive.size()))
+		return NULL;
+
+	return &m_vActive[static_cast<size_t>(h - Rules::HeightGenesis)];
+}
+
+bool NodeProcessor::IsActive(const Block::SystemState::ID& id) const
+{
+	const Block::SystemState::Full* pS = get_Active(id.m_Height);
+	if (!pS)
+		return false;
+
+	Merkle::Hash hv;
+	pS->get_Hash(hv);
+	return (hv == id.m_Hash);
+}
+
+const Block::SystemState::Full* NodeProcessor::FindActiveWorkGreater(const Difficulty::Raw& d) const
+{
+	// chainwork is strictly increasing along the chain
+	std::vector<Block::SystemState::Full>::const_iterator it = std::upper_bound(m_vActive.begin(), m_vActive.end(), d,
+		[](const Difficulty::Raw& d_, const Block::SystemState::Full& s) { return d_ < s.m_ChainWork; });
+
+	return (m_vActive.end() == it) ? NULL : &(*it);
+}
+
+void NodeProcessor::get_ActiveProof(Merkle::IProofBuilder& bld, Height h)
+{
+	assert((h >= Rules::HeightGenesis) && (h < m_Cursor.m_Sid.m_Height));
+
+	// the history covers the states below the cursor
+	uint64_t nCount = m_Cursor.m_Sid.m_Height - Rules::HeightGenesis;
+	assert(nCount < m_vActive.size());
+
+	m_ActiveMmr.Truncate(nCount);
+
+	while (m_ActiveMmr.m_Count < nCount)
+	{
+		Merkle::Hash hv;
+		m_vActive[static_cast<size_t>(m_ActiveMmr.m_Count)].get_Hash(hv);
+		m_ActiveMmr.Append(hv);
+	}
+
+	m_ActiveMmr.get_Proof(bld, h - Rules::HeightGenesis);
+}
+
+void NodeProcessor::ActiveMmr::Truncate(uint64_t nCount)
+{
+	if (m_Count <= nCount)
+		return;
+
+	m_Count = nCount;
+	for (size_t i = 0; i < m_vLevels.size(); i++)
+		m_vLevels[i].resize(static_cast<size_t>(nCount >> i));
+}
+
+void NodeProcessor::ActiveMmr::LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const
+{
+	assert((pos.H < m_vLevels.size()) && (pos.X < m_vLevels[pos.H].size()));
+	hv = m_vLevels[pos.H][static_cast<size_t>(pos.X)];
+}
+
+void NodeProcessor::ActiveMmr::SaveElement(const Merkle::Hash& hv, const Merkle::Position& pos)
+{
+	if (m_vLevels.size() <= pos.H)
+		m_vLevels.resize(pos.H + 1);
+
+	std::vector<Merkle::Hash>& v = m_vLevels[pos.H];
+	assert(pos.X == v.size()); // appended in order
+	v.push_back(hv);
+}
+
 void NodeProcessor::EnumCongestions(uint32_t nMaxBlocksBacklog)
 {
 	if (!EnsureTreasuryHandled())
@@ -747,61 +855,100 @@ void NodeProcessor::RecognizeUtxos(TxBase::IReader&& r, Height hMax)
 		}
 	}
 
-	for (; r.m_pUtxoOut; r.NextUtxoOut())
+	struct KeyProbe :public IKeyWalker
 	{
-		const Output& x = *r.m_pUtxoOut;
+		virtual bool OnKey(Key::IPKdf&, Key::Index) override { return false; }
+	} kp;
 
-		struct Walker :public IKeyWalker
-		{
-			const Output& m_Output;
-			UtxoEvent::Value m_Value;
+	if (EnumViewerKeys(kp))
+		return; // no viewer keys, nothing to recognize
 
-			Walker(const Output& x) :m_Output(x) {}
+	// Outputs are recovered in chunks, possibly in parallel. The reader may reuse the output object, hence the copies.
+	// Events are inserted in the original order.
+	const uint32_t nChunk = 1024;
 
-			virtual bool OnKey(Key::IPKdf& tag, Key::Index) override
-			{
-				Key::IDV kidv;
-				if (!m_Output.Recover(tag, kidv))
-					return true; // continue enumeration
+	std::vector<Output::Ptr> vOuts;
+	std::vector<const Output*> vPtrs;
+	std::vector<Key::IDV> vKidv;
+	std::vector<uint8_t> vFound;
 
-				m_Value.m_Kidv = kidv;
-				return false; // stop
-			}
-		};
+	while (r.m_pUtxoOut)
+	{
+		vOuts.clear();
+		vPtrs.clear();
 
-		Walker w(x);
-		w.m_Value.m_Added = 1;
-		if (!EnumViewerKeys(w))
+		for (; r.m_pUtxoOut && (vOuts.size() < nChunk); r.NextUtxoOut())
 		{
-			// filter-out dummies
-			if (w.m_Value.m_Kidv.m_Value == Zero)
-			{
-				uint32_t nType;
-				w.m_Value.m_Kidv.m_Type.Export(nType);
-				if (Key::Type::Decoy == nType)
-					continue;
-			}
+			vOuts.emplace_back(new Output);
+			*vOuts.back() = *r.m_pUtxoOut;
+			vPtrs.push_back(vOuts.back().get());
+		}
 
-			// bingo!
-			Height h;
-			if (x.m_Maturity)
-			{
-				w.m_Value.m_Maturity = x.m_Maturity;
-				// try to reverse-engineer the original block from the maturity
-				h = x.m_Maturity - x.get_MinMaturity(0);
-			}
-			else
-			{
-				h = hMax;
-				w.m_Value.m_Maturity = x.get_MinMaturity(h);
-			}
+		uint32_t nCount = static_cast<uint32_t>(vOuts.size());
+		vKidv.resize(nCount);
+		vFound.assign(nCount, 0);
 
-			w.m_Value.m_AssetID = r.m_pUtxoOut->m_AssetID;
+		RecognizeOutputs(&vPtrs.front(), nCount, &vKidv.front(), &vFound.front());
 
-			const UtxoEvent::Key& key = x.m_Commitment;
-			m_DB.InsertEvent(h, Blob(&w.m_Value, sizeof(w.m_Value)), Blob(&key, sizeof(key)));
+		for (uint32_t i = 0; i < nCount; i++)
+			if (vFound[i])
+				OnUtxoRecognized(*vOuts[i], vKidv[i], hMax);
+	}
+}
+
+bool NodeProcessor::RecognizeOutput(const Output& x, Key::IDV& kidv)
+{
+	struct Walker :public IKeyWalker
+	{
+		const Output& m_Output;
+		Key::IDV& m_Kidv;
+
+		Walker(const Output& x, Key::IDV& kidv) :m_Output(x) ,m_Kidv(kidv) {}
+
+		virtual bool OnKey(Key::IPKdf& tag, Key::Index) override
+		{
+			return !m_Output.Recover(tag, m_Kidv); // stop if recovered
 		}
+	};
+
+	Walker w(x, kidv);
+	return !EnumViewerKeys(w);
+}
+
+void NodeProcessor::RecognizeOutputs(const Output* const* ppOut, uint32_t nCount, Key::IDV* pKidv, uint8_t* pFound)
+{
+	for (uint32_t i = 0; i < nCount; i++)
+		pFound[i] = RecognizeOutput(*ppOut[i], pKidv[i]);
+}
+
+void NodeProcessor::OnUtxoRecognized(const Output& x, const Key::IDV& kidv, Height hMax)
+{
+	// filter-out dummies
+	if ((kidv.m_Value == 0) && (Key::Type::Decoy == kidv.m_Type))
+		return;
+
+	// bingo!
+	UtxoEvent::Value evt;
+	evt.m_Kidv = kidv;
+	evt.m_Added = 1;
+
+	Height h;
+	if (x.m_Maturity)
+	{
+		evt.m_Maturity = x.m_Maturity;
+		// try to reverse-engineer the original block from the maturity
+		h = x.m_Maturity - x.get_MinMaturity(0);
+	}
+	else
+	{
+		h = hMax;
+		evt.m_Maturity = x.get_MinMaturity(h);
 	}
+
+	evt.m_AssetID = x.m_AssetID;
+
+	const UtxoEvent::Key& key = x.m_Commitment;
+	m_DB.InsertEvent(h, Blob(&evt, sizeof(evt)), Blob(&key, sizeof(key)));
 }
 
 bool NodeProcessor::HandleValidatedTx(TxBase::IReader&& r, Height h, bool bFwd, const Height* pHMax)
@@ -818,12 +965,18 @@ bool NodeProcessor::HandleValidatedTx(TxBase::IReader&& r, Height h, bool bFwd,
 		}
 
 	if (bOk)
-		for (; r.m_pUtxoOut; r.NextUtxoOut(), nOut++)
-			if (!HandleBlockElement(*r.m_pUtxoOut, h, pHMax, bFwd))
-			{
-				bOk = false;
-				break;
-			}
+	{
+		if (pHMax && bFwd)
+			// macroblock: outputs come in bulk, all or nothing (nOut remains 0)
+			bOk = HandleOutputsBulk(r, h, pHMax);
+		else
+			for (; r.m_pUtxoOut; r.NextUtxoOut(), nOut++)
+				if (!HandleBlockElement(*r.m_pUtxoOut, h, pHMax, bFwd))
+				{
+					bOk = false;
+					break;
+				}
+	}
 
 	if (bOk)
 		return true;
@@ -932,7 +1085,7 @@ bool NodeProcessor::HandleBlockElement(const Input& v, Height h, const Height* p
 	return true;
 }
 
-bool NodeProcessor::HandleBlockElement(const Output& v, Height h, const Height* pHMax, bool bFwd)
+bool NodeProcessor::get_OutputKey(UtxoTree::Key& key, const Output& v, Height h, const Height* pHMax)
 {
 	UtxoTree::Key::Data d;
 	d.m_Commitment = v.m_Commitment;
@@ -946,8 +1099,32 @@ bool NodeProcessor::HandleBlockElement(const Output& v, Height h, const Height*
 		d.m_Maturity = v.m_Maturity;
 	}
 
-	UtxoTree::Key key;
 	key = d;
+	return true;
+}
+
+bool NodeProcessor::HandleOutputsBulk(TxBase::IReader& r, Height h, const Height* pHMax)
+{
+	// Insert them in a single bottom-up rebuild, instead of the per-element descent. Pays off for big sets (macroblocks)
+	std::vector<UtxoTree::Key> vKeys;
+
+	for (; r.m_pUtxoOut; r.NextUtxoOut())
+	{
+		vKeys.emplace_back();
+		if (!get_OutputKey(vKeys.back(), *r.m_pUtxoOut, h, pHMax))
+			return false;
+	}
+
+	std::sort(vKeys.begin(), vKeys.end());
+
+	return m_Utxos.AddSorted(vKeys.empty() ? NULL : &vKeys.front(), vKeys.size());
+}
+
+bool NodeProcessor::HandleBlockElement(const Output& v, Height h, const Height* pHMax, bool bFwd)
+{
+	UtxoTree::Key key;
+	if (!get_OutputKey(key, v, h, pHMax))
+		return false;
 
 	UtxoTree::Cursor cu;
 	bool bCreate = true;
@@ -989,6 +1166,7 @@ bool NodeProcessor::GoForward(uint64_t row)
 	{
 		m_DB.MoveFwd(sid);
 		InitCursor();
+		PushActive(m_Cursor.m_Full);
 		return true;
 	}
 
@@ -1011,17 +1189,21 @@ void NodeProcessor::Rollback()
 	m_DB.MoveBack(m_Cursor.m_Sid);
 	InitCursor();
 
+	assert(!m_vActive.empty());
+	m_vActive.pop_back();
+	m_ActiveMmr.Truncate(m_vActive.size());
+
 	if (!HandleBlock(sid, false))
 		OnCorrupted();
 
 	OnRolledBack();
 }
 
-NodeProcessor::DataStatus::Enum NodeProcessor::OnStateInternal(const Block::SystemState::Full& s, Block::SystemState::ID& id)
+NodeProcessor::DataStatus::Enum NodeProcessor::OnStateInternal(const Block::SystemState::Full& s, Block::SystemState::ID& id, bool bPoWVerified)
 {
 	s.get_ID(id);
 
-	if (!s.IsValid())
+	if (!(bPoWVerified ? s.IsSane() : s.IsValid()))
 	{
 		LOG_WARNING() << id << " header invalid!";
 		return DataStatus::Invalid;
@@ -1047,11 +1229,11 @@ NodeProcessor::DataStatus::Enum NodeProcessor::OnStateInternal(const Block::Syst
 	return DataStatus::Accepted;
 }
 
-NodeProcessor::DataStatus::Enum NodeProcessor::OnState(const Block::SystemState::Full& s, const PeerID& peer)
+NodeProcessor::DataStatus::Enum NodeProcessor::OnState(const Block::SystemState::Full& s, const PeerID& peer, bool bPoWVerified)
 {
 	Block::SystemState::ID id;
 
-	DataStatus::Enum ret = OnStateInternal(s, id);
+	DataStatus::Enum ret = OnStateInternal(s, id, bPoWVerified);
 	if (DataStatus::Accepted == ret)
 	{
 		uint64_t rowid = m_DB.InsertState(s);
@@ -1556,6 +1738,17 @@ bool NodeProcessor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&&
 	return block.IsValid(hr, std::move(r));
 }
 
+bool NodeProcessor::VerifyMacroBlock(const Block::BodyBase& block, Block::BodyBase::RW& rw, const HeightRange& hr)
+{
+	return VerifyBlock(block, std::move(rw), hr);
+}
+
+void NodeProcessor::VerifyPoW(const Block::SystemState::Full* pHdrs, uint32_t nCount, uint8_t* pValid)
+{
+	for (uint32_t i = 0; i < nCount; i++)
+		pValid[i] = pHdrs[i].IsValidPoW();
+}
+
 void NodeProcessor::ExtractBlockWithExtra(Block::Body& block, const NodeDB::StateID& sid)
 {
 	ByteBuffer bbP, bbE;
@@ -1640,6 +1833,17 @@ void NodeProcessor::ExportHdrRange(const HeightRange& hr, Block::SystemState::Se
 	{
 		v.resize(hr.m_Max - hr.m_Min + 1);
 
+		if (get_Active(hr.m_Max) && (hr.m_Min >= Rules::HeightGenesis))
+		{
+			const Block::SystemState::Full* pS = get_Active(hr.m_Min);
+			prefix = *pS;
+
+			for (size_t i = 0; i < v.size(); i++)
+				v[i] = pS[i];
+
+			return;
+		}
+
 		NodeDB::StateID sid;
 		sid.m_Row = FindActiveAtStrict(hr.m_Max);
 		sid.m_Height = hr.m_Max;
@@ -1663,7 +1867,7 @@ void NodeProcessor::ExportHdrRange(const HeightRange& hr, Block::SystemState::Se
 	}
 }
 
-bool NodeProcessor::ImportMacroBlock(Block::BodyBase::IMacroReader& r)
+bool NodeProcessor::ImportMacroBlock(Block::BodyBase::RW& r)
 {
 	if (!ImportMacroBlockInternal(r))
 		return false;
@@ -1672,7 +1876,28 @@ bool NodeProcessor::ImportMacroBlock(Block::BodyBase::IMacroReader& r)
 	return true;
 }
 
-bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
+bool NodeProcessor::VerifyPoWBatch(std::vector<Block::SystemState::Full>& vHdrs)
+{
+	if (vHdrs.empty())
+		return true;
+
+	std::vector<uint8_t> vValid(vHdrs.size());
+	VerifyPoW(&vHdrs.front(), static_cast<uint32_t>(vHdrs.size()), &vValid.front());
+
+	for (size_t i = 0; i < vHdrs.size(); i++)
+		if (!vValid[i])
+		{
+			Block::SystemState::ID id;
+			vHdrs[i].get_ID(id);
+			LOG_WARNING() << "Invald header encountered: " << id;
+			return false;
+		}
+
+	vHdrs.clear();
+	return true;
+}
+
+bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::RW& r)
 {
 	Block::BodyBase body;
 	Block::SystemState::Full s;
@@ -1711,6 +1936,38 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 
 	LOG_INFO() << "Verifying headers...";
 
+	// PoW of the headers not known yet, in batches. Those already in the DB have been verified upon insertion
+	{
+		std::vector<Block::SystemState::Full> vHdrs;
+		const size_t nBatch = 1024;
+		vHdrs.reserve(nBatch);
+
+		Block::SystemState::Full s2 = s;
+		Block::SystemState::ID id2;
+
+		for (bool bFirstTime = true; r.get_NextHdr(s2); s2.NextPrefix())
+		{
+			if (bFirstTime)
+				bFirstTime = false;
+			else
+				s2.m_ChainWork += s2.m_PoW.m_Difficulty;
+
+			s2.get_ID(id2);
+			if (!m_DB.StateFindSafe(id2))
+			{
+				vHdrs.push_back(s2);
+				if ((vHdrs.size() == nBatch) && !VerifyPoWBatch(vHdrs))
+					return false;
+			}
+		}
+
+		if (!VerifyPoWBatch(vHdrs))
+			return false;
+
+		r.Reset();
+		r.get_Start(body, s);
+	}
+
 	for (bool bFirstTime = true ; r.get_NextHdr(s); s.NextPrefix())
 	{
 		// Difficulty check?!
@@ -1733,7 +1990,7 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 		if (id.m_Height >= Rules::HeightGenesis)
 			cmmr.Append(id.m_Hash);
 
-		switch (OnStateInternal(s, id))
+		switch (OnStateInternal(s, id, true))
 		{
 		case DataStatus::Invalid:
 		{
@@ -1778,7 +2035,7 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 
 	LOG_INFO() << "Context-free validation...";
 
-	if (!VerifyBlock(body, std::move(r), HeightRange(m_Cursor.m_ID.m_Height + 1, id.m_Height)))
+	if (!VerifyMacroBlock(body, r, HeightRange(m_Cursor.m_ID.m_Height + 1, id.m_Height)))
 	{
 		LOG_WARNING() << "Context-free verification failed";
 		return false;
@@ -1832,6 +2089,7 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 
 		sid.m_Height = id.m_Height;
 		m_DB.MoveFwd(sid);
+		PushActive(s);
 	}
 
 	// kernels
@@ -1988,10 +2246,175 @@ bool NodeProcessor::IUtxoWalker::OnBlock(const Block::BodyBase&, TxBase::IReader
 	return true;
 }
 
+struct NodeProcessor::UtxoRecoverSimple::Batch
+	:public IBlockWalker
+	,public ThreadPool::Context
+{
+	UtxoRecoverSimple& m_Owner;
+	uint32_t m_nThreads;
+
+	struct Item
+	{
+		// either input or output
+		std::unique_ptr<Input> m_pInput;
+		Output::Ptr m_pOutput;
+		uint32_t m_iHdr;
+		bool m_bFound;
+		uint32_t m_iKey;
+		Key::IDV m_Kidv;
+	};
+
+	std::vector<Item> m_vItems;
+	std::vector<Block::SystemState::Full> m_vHdrs;
+	uint32_t m_nOutputs; // in the current batch
+
+	// progress
+	uint64_t m_nDone;
+	uint64_t m_nFound;
+	uint64_t m_tStart_ms;
+	uint64_t m_tReport_ms;
+
+	Batch(UtxoRecoverSimple& x, uint32_t nThreads)
+		:m_Owner(x)
+		,m_nThreads(nThreads)
+		,m_nOutputs(0)
+		,m_nDone(0)
+		,m_nFound(0)
+	{
+		m_tStart_ms = m_tReport_ms = local_timestamp_msec();
+	}
+
+	virtual bool OnBlock(const Block::BodyBase&, TxBase::IReader&& r, uint64_t rowid, Height h, const Height* pHMax) override
+	{
+		m_vHdrs.emplace_back();
+		if (rowid)
+			m_Owner.m_This.get_DB().get_State(rowid, m_vHdrs.back());
+		else
+			ZeroObject(m_vHdrs.back());
+
+		// The reader may reuse its objects, hence the copies
+		for (r.Reset(); r.m_pUtxoIn; r.NextUtxoIn())
+		{
+			Item& x = AddItem();
+			x.m_pInput.reset(new Input);
+			*x.m_pInput = *r.m_pUtxoIn;
+
+			if (!FlushIfFull())
+				return false;
+		}
+
+		for ( ; r.m_pUtxoOut; r.NextUtxoOut())
+		{
+			Item& x = AddItem();
+			x.m_pOutput.reset(new Output);
+			*x.m_pOutput = *r.m_pUtxoOut;
+			m_nOutputs++;
+
+			if (!FlushIfFull())
+				return false;
+		}
+
+		uint64_t t_ms = local_timestamp_msec();
+		if (t_ms - m_tReport_ms >= 5000)
+		{
+			m_tReport_ms = t_ms;
+			LOG_INFO() << "UTXO recovery: height " << (pHMax ? *pHMax : h) << "/" << m_Owner.m_This.m_Cursor.m_ID.m_Height << ", " << m_nDone << " outputs, " << m_nFound << " found, " << get_Rate(t_ms) << " outputs/sec";
+		}
+
+		return true;
+	}
+
+	Item& AddItem()
+	{
+		m_vItems.emplace_back();
+		Item& x = m_vItems.back();
+		x.m_iHdr = static_cast<uint32_t>(m_vHdrs.size() - 1);
+		x.m_bFound = false;
+		return x;
+	}
+
+	bool FlushIfFull()
+	{
+		// inputs count too, they're kept in memory until the flush
+		if (m_vItems.size() < m_nThreads * 1024)
+			return true;
+
+		if (!Flush())
+			return false;
+
+		m_vHdrs.erase(m_vHdrs.begin(), m_vHdrs.end() - 1); // the current block may continue
+		return true;
+	}
+
+	uint64_t get_Rate(uint64_t t_ms) const
+	{
+		return (t_ms > m_tStart_ms) ? (m_nDone * 1000 / (t_ms - m_tStart_ms)) : 0;
+	}
+
+	virtual void Do(size_t iTask) override
+	{
+		Item& x = m_vItems[iTask];
+		if (x.m_pOutput)
+		{
+			ECC::Mode::Scope scope(ECC::Mode::Fast);
+			x.m_bFound = m_Owner.Recover(*x.m_pOutput, x.m_iKey, x.m_Kidv);
+		}
+	}
+
+	bool Flush()
+	{
+		if (m_nOutputs)
+			DoAll(m_vItems.size(), m_nThreads);
+
+		// merge in the original order, so that the inputs are matched against the outputs exactly as in the serial pass
+		uint32_t iHdr = static_cast<uint32_t>(-1);
+		bool bRet = true;
+
+		for (size_t i = 0; bRet && (i < m_vItems.size()); i++)
+		{
+			Item& x = m_vItems[i];
+			if (iHdr != x.m_iHdr)
+			{
+				iHdr = x.m_iHdr;
+				m_Owner.m_Hdr = m_vHdrs[iHdr];
+			}
+
+			if (x.m_pInput)
+				bRet = m_Owner.OnInput(*x.m_pInput);
+			else
+				if (x.m_bFound)
+				{
+					m_nFound++;
+					bRet = m_Owner.OnOutput(x.m_iKey, x.m_Kidv, *x.m_pOutput);
+				}
+		}
+
+		m_nDone += m_nOutputs;
+		m_nOutputs = 0;
+		m_vItems.clear();
+
+		return bRet;
+	}
+};
+
 bool NodeProcessor::UtxoRecoverSimple::Proceed()
 {
-	ECC::Mode::Scope scope(ECC::Mode::Fast);
-	return m_This.EnumBlocks(*this);
+	uint32_t nThreads = m_nThreads;
+	if (!nThreads)
+	{
+		nThreads = std::thread::hardware_concurrency();
+		if (!nThreads)
+			nThreads = 1;
+	}
+
+	Batch b(*this, nThreads);
+
+	bool bRet = m_This.EnumBlocks(b) && b.Flush();
+
+	uint64_t t_ms = local_timestamp_msec();
+	LOG_INFO() << "UTXO recovery " << (bRet ? "done" : "interrupted") << ": " << b.m_nDone << " outputs, " << b.m_nFound << " found, " << (t_ms - b.m_tStart_ms) << " ms, " << b.get_Rate(t_ms) << " outputs/sec, threads=" << nThreads;
+
+	return bRet;
 }
 
 bool NodeProcessor::UtxoRecoverEx::OnOutput(uint32_t iKey, const Key::IDV& kidv, const Output& x)
@@ -2023,13 +2446,22 @@ bool NodeProcessor::UtxoRecoverEx::OnInput(const Input& x)
 	return true;
 }
 
+bool NodeProcessor::UtxoRecoverSimple::Recover(const Output& x, uint32_t& iKey, Key::IDV& kidv) const
+{
+	for (iKey = 0; iKey < m_vKeys.size(); iKey++)
+		if (x.Recover(*m_vKeys[iKey], kidv))
+			return true;
+
+	return false;
+}
+
 bool NodeProcessor::UtxoRecoverSimple::OnOutput(const Output& x)
 {
+	uint32_t iKey;
 	Key::IDV kidv;
 
-	for (uint32_t iKey = 0; iKey < m_vKeys.size(); iKey++)
-		if (x.Recover(*m_vKeys[iKey], kidv))
-			return OnOutput(iKey, kidv, x);
+	if (Recover(x, iKey, kidv))
+		return OnOutput(iKey, kidv, x);
 
 	return true;
 }
@@ -54,9 +54,13 @@ class NodeProcessor
 	bool HandleValidatedBlock(TxBase::IReader&&, const Block::BodyBase&, Height, bool bFwd, const Height* = NULL);
 	bool HandleBlockElement(const Input&, Height, const Height*, bool bFwd);
 	bool HandleBlockElement(const Output&, Height, const Height*, bool bFwd);
+	bool HandleOutputsBulk(TxBase::IReader&, Height, const Height*);
+	static bool get_OutputKey(UtxoTree::Key&, const Output&, Height, const Height*);
 
-	bool ImportMacroBlockInternal(Block::BodyBase::IMacroReader&);
+	bool ImportMacroBlockInternal(Block::BodyBase::RW&);
+	bool VerifyPoWBatch(std::vector<Block::SystemState::Full>&);
 	void RecognizeUtxos(TxBase::IReader&&, Height hMax);
+	void OnUtxoRecognized(const Output&, const Key::IDV&, Height hMax);
 
 	static void SquashOnce(std::vector<Block::Body>&);
 	static uint64_t ProcessKrnMmr(Merkle::Mmr&, TxBase::IReader&&, Height, const Merkle::Hash& idKrn, TxKernel::Ptr* ppRes);
@@ -70,6 +74,21 @@ class NodeProcessor
 	Timestamp get_MovingMedianEx(uint64_t& row); // in-out
 	Height get_FossilHeight();
 
+	std::vector<Block::SystemState::Full> m_vActive; // headers of the active chain, indexed by height (starting from HeightGenesis)
+	void InitActive();
+	void PushActive(const Block::SystemState::Full&);
+
+	// MMR of the active states hashes, same as the DB history. Grows lazily, on demand
+	struct ActiveMmr
+		:public Merkle::Mmr
+	{
+		std::vector<std::vector<Merkle::Hash> > m_vLevels; // complete nodes only
+		void Truncate(uint64_t nCount); // no-op if smaller already
+	protected:
+		virtual void LoadElement(Merkle::Hash&, const Merkle::Position&) const override;
+		virtual void SaveElement(const Merkle::Hash&, const Merkle::Position&) override;
+	} m_ActiveMmr;
+
 	struct UtxoSig;
 	struct UnspentWalker;
 
@@ -132,7 +151,13 @@ public:
 	void ExtractBlockWithExtra(Block::Body&, const NodeDB::StateID&);
 	void ExportMacroBlock(Block::BodyBase::IMacroWriter&, const HeightRange&);
 	void ExportHdrRange(const HeightRange&, Block::SystemState::Sequence::Prefix&, std::vector<Block::SystemState::Sequence::Element>&);
-	bool ImportMacroBlock(Block::BodyBase::IMacroReader&);
+	bool ImportMacroBlock(Block::BodyBase::RW&);
+
+	// active chain headers, served from memory
+	const Block::SystemState::Full* get_Active(Height) const; // NULL if above the cursor
+	bool IsActive(const Block::SystemState::ID&) const;
+	const Block::SystemState::Full* FindActiveWorkGreater(const Difficulty::Raw&) const; // NULL if none
+	void get_ActiveProof(Merkle::IProofBuilder&, Height); // same as NodeDB::get_Proof() for the cursor, without DB access
 
 	struct DataStatus {
 		enum Enum {
@@ -143,7 +168,7 @@ public:
 		};
 	};
 
-	DataStatus::Enum OnState(const Block::SystemState::Full&, const PeerID&);
+	DataStatus::Enum OnState(const Block::SystemState::Full&, const PeerID&, bool bPoWVerified = false);
 	DataStatus::Enum OnBlock(const Block::SystemState::ID&, const Blob& bbP, const Blob& bbE, const PeerID&);
 	DataStatus::Enum OnTreasury(const Blob&);
 
@@ -163,6 +188,8 @@ public:
 	virtual void OnNewState() {}
 	virtual void OnRolledBack() {}
 	virtual bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&);
+	virtual bool VerifyMacroBlock(const Block::BodyBase&, Block::BodyBase::RW&, const HeightRange&);
+	virtual void VerifyPoW(const Block::SystemState::Full*, uint32_t nCount, uint8_t* pValid);
 	virtual void AdjustFossilEnd(Height&) {}
 	virtual bool OpenMacroblock(Block::BodyBase::RW&, const NodeDB::StateID&) { return false; }
 	virtual void OnModified() {}
@@ -172,6 +199,11 @@ public:
 	};
 	virtual bool EnumViewerKeys(IKeyWalker&) { return true; }
 
+	// Tries all the viewer keys. Must be thread-safe (given EnumViewerKeys is)
+	bool RecognizeOutput(const Output&, Key::IDV&);
+	// pFound[i] is set if the i-th output is recognized. Can be overridden to run in parallel, the results must not depend on the order
+	virtual void RecognizeOutputs(const Output* const* ppOut, uint32_t nCount, Key::IDV* pKidv, uint8_t* pFound);
+
 	uint64_t FindActiveAtStrict(Height);
 
 	bool ValidateTxContext(const Transaction&); // assuming context-free validation is already performed, but 
@@ -214,15 +246,23 @@ public:
 		:public IUtxoWalker
 	{
 		std::vector<Key::IPKdf::Ptr> m_vKeys;
+		uint32_t m_nThreads; // outputs are recognized in parallel. 0 - use all the cores. Default is 1 (caller thread only)
 
-		UtxoRecoverSimple(NodeProcessor& x) :IUtxoWalker(x) {}
+		UtxoRecoverSimple(NodeProcessor& x) :IUtxoWalker(x) ,m_nThreads(1) {}
 
+		// Blocks are read in batches, the outputs are recognized on the worker threads, then the results are passed to OnInput/OnOutput
+		// on the caller thread in the original order.
 		bool Proceed();
 
 		virtual bool OnInput(const Input&) override;
 		virtual bool OnOutput(const Output&) override;
 
 		virtual bool OnOutput(uint32_t iKey, const Key::IDV&, const Output&) = 0;
+
+		bool Recover(const Output&, uint32_t& iKey, Key::IDV&) const; // thread-safe
+
+	private:
+		struct Batch;
 	};
 
 	struct UtxoRecoverEx
@@ -263,7 +303,7 @@ public:
 private:
 	size_t GenerateNewBlockInternal(BlockContext&);
 	void GenerateNewHdr(BlockContext&);
-	DataStatus::Enum OnStateInternal(const Block::SystemState::Full&, Block::SystemState::ID&);
+	DataStatus::Enum OnStateInternal(const Block::SystemState::Full&, Block::SystemState::ID&, bool bPoWVerified);
 };
 
 
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "processor.h"
+#include "../core/serialization_adapters.h"
 #include "../utility/logger.h"
 #include "../utility/logger_checkpoints.h"
 
@@ -56,6 +57,21 @@ void TxPool::Fluff::AddValidTx(Transaction::Ptr&& pValue, const Transaction::Con
 	m_setThreshold.insert(p->m_Threshold);
 	m_setProfit.insert(p->m_Profit);
 	m_setTxs.insert(p->m_Tx);
+
+	const Transaction& tx = *p->m_pValue;
+	p->m_vParts.resize(tx.m_vOutputs.size() + tx.m_vKernels.size());
+
+	for (size_t i = 0; i < p->m_vParts.size(); i++)
+	{
+		Element::Part& n = p->m_vParts[i];
+		if (i < tx.m_vOutputs.size())
+			get_PartID(n.m_hv, *tx.m_vOutputs[i]);
+		else
+			tx.m_vKernels[i - tx.m_vOutputs.size()]->get_ID(n.m_hv);
+
+		n.m_pThis = p;
+		m_setParts.insert(n);
+	}
 }
 
 void TxPool::Fluff::Delete(Element& x)
@@ -63,9 +79,67 @@ void TxPool::Fluff::Delete(Element& x)
 	m_setThreshold.erase(ThresholdSet::s_iterator_to(x.m_Threshold));
 	m_setProfit.erase(ProfitSet::s_iterator_to(x.m_Profit));
 	m_setTxs.erase(TxSet::s_iterator_to(x.m_Tx));
+
+	for (size_t i = 0; i < x.m_vParts.size(); i++)
+		m_setParts.erase(PartSet::s_iterator_to(x.m_vParts[i]));
+
 	delete &x;
 }
 
+const Output* TxPool::Fluff::Element::Part::get_Output() const
+{
+	size_t i = this - &m_pThis->m_vParts.front();
+	const Transaction& tx = *m_pThis->m_pValue;
+	return (i < tx.m_vOutputs.size()) ? tx.m_vOutputs[i].get() : NULL;
+}
+
+const TxKernel* TxPool::Fluff::Element::Part::get_Kernel() const
+{
+	size_t i = this - &m_pThis->m_vParts.front();
+	const Transaction& tx = *m_pThis->m_pValue;
+	return (i < tx.m_vOutputs.size()) ? NULL : tx.m_vKernels[i - tx.m_vOutputs.size()].get();
+}
+
+void TxPool::Fluff::get_PartID(Merkle::Hash& hv, const Output& v)
+{
+	// the whole output, including the rangeproof. Commitment alone isn't enough to identify it
+	Serializer ser;
+	ser & v;
+
+	SerializeBuffer sb = ser.buffer();
+
+	ECC::Hash::Processor()
+		<< Blob(sb.first, static_cast<uint32_t>(sb.second))
+		>> hv;
+}
+
+uint64_t TxPool::Fluff::get_ShortID(const Merkle::Hash& hv)
+{
+	uint64_t val = 0;
+	for (uint32_t i = 0; i < sizeof(val); i++)
+		val = (val << 8) | hv.m_pData[i];
+
+	return val ? val : 1; // 0 is reserved
+}
+
+const TxPool::Fluff::Element::Part* TxPool::Fluff::FindPart(uint64_t nShortID) const
+{
+	Element::Part key;
+	key.m_hv = Zero;
+	for (uint32_t i = sizeof(nShortID); i--; nShortID >>= 8)
+		key.m_hv.m_pData[i] = static_cast<uint8_t>(nShortID);
+
+	PartSet::const_iterator it = m_setParts.lower_bound(key);
+	if ((m_setParts.end() == it) || (get_ShortID(it->m_hv) != get_ShortID(key.m_hv)))
+		return NULL;
+
+	const Element::Part& res = *it;
+	if ((m_setParts.end() != ++it) && (get_ShortID(it->m_hv) == get_ShortID(res.m_hv)))
+		return NULL; // ambiguous
+
+	return &res;
+}
+
 void TxPool::Fluff::DeleteOutOfBound(Height h)
 {
 	while (!m_setThreshold.empty())
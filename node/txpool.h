@@ -63,15 +63,36 @@ struct TxPool
 
 				IMPLEMENT_GET_PARENT_OBJ(Element, m_Threshold)
 			} m_Threshold;
+
+			struct Part
+				:public boost::intrusive::set_base_hook<>
+			{
+				// output or kernel, used to reconstruct compact blocks
+				Merkle::Hash m_hv;
+				Element* m_pThis;
+
+				const Output* get_Output() const; // NULL if it's a kernel
+				const TxKernel* get_Kernel() const; // NULL if it's an output
+
+				bool operator < (const Part& t) const { return m_hv < t.m_hv; }
+			};
+
+			std::vector<Part> m_vParts; // outputs, then kernels
 		};
 
 		typedef boost::intrusive::multiset<Element::Tx> TxSet;
 		typedef boost::intrusive::multiset<Element::Profit> ProfitSet;
 		typedef boost::intrusive::multiset<Element::Threshold> ThresholdSet;
+		typedef boost::intrusive::multiset<Element::Part> PartSet;
 
 		TxSet m_setTxs;
 		ProfitSet m_setProfit;
 		ThresholdSet m_setThreshold;
+		PartSet m_setParts;
+
+		static void get_PartID(Merkle::Hash&, const Output&);
+		static uint64_t get_ShortID(const Merkle::Hash&); // leading 64 bits, never 0
+		const Element::Part* FindPart(uint64_t nShortID) const; // NULL if not found or ambiguous
 
 		void AddValidTx(Transaction::Ptr&&, const Transaction::Context&, const Transaction::KeyType&);
 		void Delete(Element&);
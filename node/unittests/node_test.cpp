@@ -395,6 +395,15 @@ namespace beam
 			db.MoveFwd(sid);
 		}
 
+		{
+			NodeDB::WalkerState ws(db);
+			Height h = Rules::HeightGenesis;
+			for (db.EnumActive(ws); ws.MoveNext(); h++)
+				verify_test((ws.m_Sid.m_Height == h) && (ws.m_Sid.m_Row == pRows[h - Rules::HeightGenesis]));
+
+			verify_test(h == hMax + 1);
+		}
+
 		tr.Commit();
 		tr.Start(db);
 
@@ -548,10 +557,12 @@ namespace beam
 		const char* g_sz = "mytest.db";
 		const char* g_sz2 = "mytest2.db";
 		const char* g_sz3 = "macroblock_";
+		const char* g_sz4 = "macroblock2_";
 #else // WIN32
 		const char* g_sz = "/tmp/mytest.db";
 		const char* g_sz2 = "/tmp/mytest2.db";
 		const char* g_sz3 = "/tmp/macroblock_";
+		const char* g_sz4 = "/tmp/macroblock2_";
 #endif // WIN32
 
 	void TestNodeDB()
@@ -848,8 +859,299 @@ namespace beam
 
 			rwData.ROpen();
 			verify_test(np2.ImportMacroBlock(rwData));
+
+			// seek outputs by (maturity, commitment)
+			std::vector<std::pair<Height, ECC::Point> > vOuts;
+			for (rwData.Reset(); rwData.m_pUtxoOut; rwData.NextUtxoOut())
+				vOuts.emplace_back(rwData.m_pUtxoOut->m_Maturity, rwData.m_pUtxoOut->m_Commitment);
+			verify_test(!vOuts.empty());
+
+			for (size_t i = vOuts.size(); i--; )
+			{
+				rwData.Reset();
+				rwData.NextUtxoOutFF(vOuts[i].first, vOuts[i].second);
+				verify_test(rwData.m_pUtxoOut && (rwData.m_pUtxoOut->m_Maturity == vOuts[i].first) && (rwData.m_pUtxoOut->m_Commitment == vOuts[i].second));
+
+				rwData.NextUtxoOut();
+				verify_test((i + 1 < vOuts.size()) ? (rwData.m_pUtxoOut && (rwData.m_pUtxoOut->m_Commitment == vOuts[i + 1].second)) : !rwData.m_pUtxoOut);
+			}
+
+			rwData.Reset();
+			rwData.NextUtxoOutFF(vOuts.back().first + 1, vOuts.back().second);
+			verify_test(!rwData.m_pUtxoOut);
+
+			// range-partitioned verification
+			verify_test(rwData.IsIndexed());
+			for (uint32_t nVerifiers = 1; nVerifiers <= 5; nVerifiers++)
+			{
+				Block::BodyBase body;
+				Block::SystemState::Sequence::Prefix prefix;
+				rwData.Reset();
+				rwData.get_Start(body, prefix);
+
+				TxBase::Context ctx;
+				ctx.m_Height = HeightRange(hMid + 1, Rules::HeightGenesis + blockChain.size() - 1);
+				ctx.m_bBlockMode = true;
+
+				for (uint32_t i = 0; i < nVerifiers; i++)
+				{
+					TxBase::Context ctx2;
+					ctx2.m_Height = ctx.m_Height;
+					ctx2.m_bBlockMode = true;
+					ctx2.m_nVerifiers = nVerifiers;
+					ctx2.m_iVerifier = i;
+
+					verify_test(ctx2.ValidateAndSummarizeSlice(body, rwData));
+					verify_test(ctx.Merge(ctx2));
+				}
+
+				verify_test(ctx.IsValidBlock(body));
+			}
+
+			// tampered copies must be rejected by every slicing, without crashing the verifiers
+			{
+				typedef Block::BodyBase::RW RW;
+
+				struct MbTamper
+				{
+					static void Load(const std::string& sPath, ByteBuffer& buf)
+					{
+						buf.clear();
+						std::FStream fs;
+						if (fs.Open(sPath.c_str(), true))
+						{
+							buf.resize(static_cast<size_t>(fs.get_Remaining()));
+							if (!buf.empty())
+								fs.read(&buf.front(), buf.size());
+						}
+					}
+
+					static void Save(const std::string& sPath, const ByteBuffer& buf)
+					{
+						std::FStream fs;
+						fs.Open(sPath.c_str(), false, true);
+						if (!buf.empty())
+							fs.write(&buf.front(), buf.size());
+					}
+
+					static void Copy(const RW& rwSrc, const RW& rwDst)
+					{
+						ByteBuffer buf;
+						std::string sSrc, sDst;
+						for (int iData = 0; iData < RW::Type::count; iData++)
+						{
+							rwSrc.GetPath(sSrc, iData);
+							rwDst.GetPath(sDst, iData);
+							Load(sSrc, buf);
+							Save(sDst, buf);
+
+							if (rwSrc.GetIndexPath(sSrc, iData))
+							{
+								verify_test(rwDst.GetIndexPath(sDst, iData));
+								Load(sSrc, buf);
+								Save(sDst, buf);
+							}
+						}
+					}
+
+					static size_t Find(const ByteBuffer& buf, const ECC::uintBig& x)
+					{
+						auto it = std::search(buf.begin(), buf.end(), x.m_pData, x.m_pData + x.nBytes);
+						verify_test(buf.end() != it);
+						return it - buf.begin();
+					}
+
+					static bool VerifySlices(RW& rw, const HeightRange& hr, uint32_t nVerifiers)
+					{
+						Block::BodyBase body;
+						Block::SystemState::Sequence::Prefix prefix;
+						try {
+							rw.Reset(); // preloads the 1st elements, may fail already
+							rw.get_Start(body, prefix);
+						} catch (const std::exception&) {
+							return false;
+						}
+
+						TxBase::Context ctx;
+						ctx.m_Height = hr;
+						ctx.m_bBlockMode = true;
+
+						for (uint32_t i = 0; i < nVerifiers; i++)
+						{
+							TxBase::Context ctx2;
+							ctx2.m_Height = hr;
+							ctx2.m_bBlockMode = true;
+							ctx2.m_nVerifiers = nVerifiers;
+							ctx2.m_iVerifier = i;
+
+							if (!ctx2.ValidateAndSummarizeSlice(body, rw) || !ctx.Merge(ctx2))
+								return false;
+						}
+
+						return ctx.IsValidBlock(body);
+					}
+				};
+
+				HeightRange hr(hMid + 1, Rules::HeightGenesis + blockChain.size() - 1);
+
+				RW rwT;
+				rwT.m_sPath = std::string(g_sz3) + "t_";
+				ByteBuffer buf;
+
+				// the last index entry points to a later element. The slice that starts there would skip the elements in-between
+				for (int iData = RW::Type::ui; iData <= RW::Type::uo; iData++)
+				{
+					uint64_t nEntries = rwData.get_IndexEntries(iData);
+					verify_test(nEntries);
+
+					// the last element of the stream
+					Height hLast = 0;
+					ECC::Point ptLast;
+					uint64_t nCount = 0;
+					rwData.Reset();
+					for (; ; nCount++)
+					{
+						const TxElement* pElem = (RW::Type::ui == iData) ? static_cast<const TxElement*>(rwData.m_pUtxoIn) : static_cast<const TxElement*>(rwData.m_pUtxoOut);
+						if (!pElem)
+							break;
+
+						hLast = pElem->m_Maturity;
+						ptLast = pElem->m_Commitment;
+
+						if (RW::Type::ui == iData)
+							rwData.NextUtxoIn();
+						else
+							rwData.NextUtxoOut();
+					}
+					verify_test((nCount - 1) / RW::s_IndexStep == nEntries - 1);
+					verify_test((nCount - 1) % RW::s_IndexStep); // not the indexed one
+
+					MbTamper::Copy(rwData, rwT);
+
+					std::string sPath, sPathIdx;
+					rwT.GetPath(sPath, iData);
+					verify_test(rwT.GetIndexPath(sPathIdx, iData));
+
+					ByteBuffer bufIdx;
+					MbTamper::Load(sPath, buf);
+					MbTamper::Load(sPathIdx, bufIdx);
+					verify_test(bufIdx.size() == sizeof(RW::IndexEntry) * nEntries + sizeof(RW::IndexTrailer));
+
+					// locate the element by its commitment, relative to the 1st entry
+					RW::IndexEntry& e0 = reinterpret_cast<RW::IndexEntry&>(bufIdx.front());
+					RW::IndexEntry& e = reinterpret_cast<RW::IndexEntry&>(bufIdx.at(sizeof(RW::IndexEntry) * (nEntries - 1)));
+
+					uint64_t nPos0;
+					e0.m_Pos.Export(nPos0);
+					size_t nDelta = MbTamper::Find(buf, e0.m_Commitment.m_X) - static_cast<size_t>(nPos0);
+
+					e.m_Maturity = hLast;
+					e.m_Commitment = ptLast;
+					e.m_Pos = static_cast<uint64_t>(MbTamper::Find(buf, ptLast.m_X) - nDelta);
+					MbTamper::Save(sPathIdx, bufIdx);
+
+					rwT.ROpen();
+					verify_test(rwT.IsIndexed());
+					for (uint32_t nVerifiers = 1; nVerifiers <= 5; nVerifiers++)
+						verify_test(!MbTamper::VerifySlices(rwT, hr, nVerifiers));
+					rwT.Close();
+				}
+
+				// kernel threshold points past the kernels of the following heights
+				{
+					MbTamper::Copy(rwData, rwT);
+
+					std::string sPath;
+					rwT.GetPath(sPath, RW::Type::kx);
+					MbTamper::Load(sPath, buf);
+
+					const size_t nSizeKx = sizeof(uintBigFor<Height>::Type);
+					verify_test(buf.size() >= nSizeKx * 3);
+					size_t iKx = buf.size() / nSizeKx / 2;
+					memcpy(&buf.at(iKx * nSizeKx), &buf.at(buf.size() - nSizeKx), nSizeKx);
+					MbTamper::Save(sPath, buf);
+
+					rwT.ROpen();
+					for (uint32_t nVerifiers = 1; nVerifiers <= 5; nVerifiers++)
+						verify_test(!MbTamper::VerifySlices(rwT, hr, nVerifiers));
+					rwT.Close();
+				}
+
+				// the data alone (as served to others) has no index. It's created locally, and must be the same
+				{
+					MbTamper::Copy(rwData, rwT);
+
+					std::string sPathIdx;
+					for (int iData = RW::Type::ui; iData <= RW::Type::uo; iData++)
+					{
+						verify_test(rwT.GetIndexPath(sPathIdx, iData));
+						DeleteFile(sPathIdx.c_str());
+					}
+
+					rwT.ROpen();
+					verify_test(!rwT.IsIndexed());
+					rwT.CreateIndex();
+					verify_test(rwT.IsIndexed());
+
+					for (uint32_t nVerifiers = 1; nVerifiers <= 3; nVerifiers++)
+						verify_test(MbTamper::VerifySlices(rwT, hr, nVerifiers));
+					rwT.Close();
+
+					ByteBuffer buf2;
+					std::string sPathIdx2;
+					for (int iData = RW::Type::ui; iData <= RW::Type::uo; iData++)
+					{
+						verify_test(rwData.GetIndexPath(sPathIdx, iData));
+						verify_test(rwT.GetIndexPath(sPathIdx2, iData));
+						MbTamper::Load(sPathIdx, buf);
+						MbTamper::Load(sPathIdx2, buf2);
+						verify_test(!buf.empty() && (buf == buf2));
+					}
+				}
+
+				rwT.Delete();
+			}
+
 			rwData.Close();
 
+			// the index is kept in a separate local file, the data is served to others as-is. For the data without the index it's recreated
+			{
+				std::string sPathIdx;
+				verify_test(rwData.GetIndexPath(sPathIdx, Block::BodyBase::RW::Type::uo));
+
+				ByteBuffer pBuf[2];
+				for (size_t i = 0; i < _countof(pBuf); i++)
+				{
+					if (i)
+					{
+						DeleteFile(sPathIdx.c_str());
+
+						rwData.ROpen();
+						verify_test(!rwData.IsIndexed());
+						rwData.CreateIndex();
+						verify_test(rwData.IsIndexed());
+						rwData.Close();
+					}
+
+					std::FStream fs;
+					verify_test(fs.Open(sPathIdx.c_str(), true));
+					pBuf[i].resize(static_cast<size_t>(fs.get_Remaining()));
+					verify_test(!pBuf[i].empty());
+					fs.read(&pBuf[i].front(), pBuf[i].size());
+				}
+
+				verify_test(pBuf[0] == pBuf[1]);
+			}
+
+			// history proofs from memory must match the DB
+			for (Height h = Rules::HeightGenesis; h < np2.m_Cursor.m_Sid.m_Height; h += 3)
+			{
+				Merkle::ProofBuilderStd bld0, bld1;
+				np2.get_DB().get_Proof(bld0, np2.m_Cursor.m_Sid, h);
+				np2.get_ActiveProof(bld1, h);
+				verify_test(bld0.m_Proof == bld1.m_Proof);
+			}
+
 			np2.get_DB().MacroblockIns(np2.m_Cursor.m_Sid.m_Row);
 			np2.m_sPathMB = g_sz3;
 
@@ -926,65 +1228,923 @@ namespace beam
 				blockChain[i]->m_Hdr.get_ID(id);
 				np.OnBlock(id, blockChain[i]->m_BodyP, blockChain[i]->m_BodyE, peer);
 			}
-		}
+		}
+
+		{
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz);
+
+			PeerID peer;
+			ZeroObject(peer);
+
+			for (size_t i = 1; i < blockChain.size(); i += 2)
+				np.OnState(blockChain[i]->m_Hdr, peer);
+		}
+
+		{
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz);
+
+			PeerID peer;
+			ZeroObject(peer);
+
+			for (size_t i = 0; i < nMid; i++)
+			{
+				Block::SystemState::ID id;
+				blockChain[i]->m_Hdr.get_ID(id);
+				np.OnBlock(id, blockChain[i]->m_BodyP, blockChain[i]->m_BodyE, peer);
+			}
+		}
+
+		{
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz);
+
+			PeerID peer;
+			ZeroObject(peer);
+
+			for (size_t i = nMid; i < blockChain.size(); i++)
+			{
+				Block::SystemState::ID id;
+				blockChain[i]->m_Hdr.get_ID(id);
+				np.OnBlock(id, blockChain[i]->m_BodyP, blockChain[i]->m_BodyE, peer);
+			}
+		}
+
+		{
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz, true); // reset cursor
+		}
+
+	}
+
+	const uint16_t g_Port = 25003; // don't use the default port to prevent collisions with running nodes, beacons and etc.
+
+	struct TestPeer
+		:public proto::NodeConnection
+	{
+		// Connects to the node as another node (proves a node ID), so that it's assigned the download tasks.
+		// Serves only what the test implements
+		uint8_t m_LoginFlags = 0;
+
+		virtual void OnConnectedSecure() override
+		{
+			ECC::Scalar::Native sk;
+			sk.GenRandomNnz();
+			ProveID(sk, proto::IDType::Node);
+
+			proto::Login msg;
+			msg.m_CfgChecksum = Rules::get().Checksum;
+			msg.m_Flags = m_LoginFlags;
+			Send(msg);
+		}
+
+		void ConnectTo(uint16_t nPort)
+		{
+			io::Address addr;
+			addr.resolve("127.0.0.1");
+			addr.port(nPort);
+
+			Connect(addr);
+		}
+
+		void SendTip(const Block::SystemState::Full& s)
+		{
+			proto::NewTip msg;
+			msg.m_Description = s;
+			Send(msg);
+		}
+	};
+
+	void TestNodeConversation()
+	{
+		// Testing configuration: Node0 <-> Node1 <-> Client.
+
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		Node node, node2;
+		node.m_Cfg.m_sPathLocal = g_sz;
+		node.m_Cfg.m_Listen.port(g_Port);
+		node.m_Cfg.m_Listen.ip(INADDR_ANY);
+		node.m_Cfg.m_Sync.m_SrcPeers = 0;
+		node.m_Cfg.m_Treasury = g_Treasury;
+
+		node.m_Cfg.m_Timeout.m_GetBlock_ms = 1000 * 60;
+		node.m_Cfg.m_Timeout.m_GetState_ms = 1000 * 60;
+
+		node2.m_Cfg.m_sPathLocal = g_sz2;
+		node2.m_Cfg.m_Listen.port(g_Port + 1);
+		node2.m_Cfg.m_Listen.ip(INADDR_ANY);
+		node2.m_Cfg.m_Timeout = node.m_Cfg.m_Timeout;
+		node2.m_Cfg.m_Sync.m_SrcPeers = 0;
+		node2.m_Cfg.m_Treasury = g_Treasury;
+
+		node2.m_Cfg.m_BeaconPort = g_Port;
+
+		ECC::SetRandom(node);
+		ECC::SetRandom(node2);
+
+		node.Initialize();
+		node2.Initialize();
+
+		struct MyClient
+			:public proto::NodeConnection
+		{
+			Node* m_ppNode[2];
+			unsigned int m_iNode;
+			unsigned int m_WaitingCycles;
+
+			Height m_HeightMax;
+			const Height m_HeightTrg = 70;
+
+			MyClient()
+			{
+				m_pTimer = io::Timer::create(io::Reactor::get_Current());
+			}
+
+			virtual void OnConnectedSecure() override {
+				OnTimer();
+			}
+
+			virtual void OnDisconnect(const DisconnectReason&) override {
+				fail_test("OnDisconnect");
+			}
+
+			io::Timer::Ptr m_pTimer;
+
+			void OnTimer() {
+
+
+				if (m_HeightMax < m_HeightTrg)
+				{
+					Node& n = *m_ppNode[m_iNode];
+
+					TxPool::Fluff txPool; // empty, no transactions
+					NodeProcessor::BlockContext bc(txPool, 0, *n.m_Keys.m_pMiner, *n.m_Keys.m_pMiner);
+
+					verify_test(n.get_Processor().GenerateNewBlock(bc));
+
+					n.get_Processor().OnState(bc.m_Hdr, PeerID());
+
+					Block::SystemState::ID id;
+					bc.m_Hdr.get_ID(id);
+
+					n.get_Processor().OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+
+					m_HeightMax = std::max(m_HeightMax, bc.m_Hdr.m_Height);
+
+					printf("Mined block Height = %u, node = %u \n", (unsigned int) bc.m_Hdr.m_Height, (unsigned int)m_iNode);
+
+					++m_iNode %= _countof(m_ppNode);
+				}
+				else
+					if (m_WaitingCycles++ > 60)
+					{
+						fail_test("Blockchain height didn't reach target");
+						io::Reactor::get_Current().stop();
+					}
+
+				SetTimer(100);
+			}
+
+			virtual void OnMsg(proto::NewTip&& msg) override
+			{
+				printf("Tip Height=%u\n", (unsigned int) msg.m_Description.m_Height);
+				verify_test(msg.m_Description.m_Height <= m_HeightMax);
+				if (msg.m_Description.m_Height == m_HeightTrg)
+					io::Reactor::get_Current().stop();
+			}
+
+			void SetTimer(uint32_t timeout_ms) {
+				m_pTimer->start(timeout_ms, false, [this]() { return (this->OnTimer)(); });
+			}
+		};
+
+		MyClient cl;
+		cl.m_iNode = 0;
+		cl.m_HeightMax = 0;
+		cl.m_WaitingCycles = 0;
+		cl.m_ppNode[0] = &node;
+		cl.m_ppNode[1] = &node2;
+
+		io::Address addr;
+		addr.resolve("127.0.0.1");
+		addr.port(g_Port + 1);
+
+		cl.Connect(addr);
+
+
+		pReactor->run();
+
+		// each node mined half of the blocks, the rest were downloaded from the other
+		verify_test(node.m_DownloadStats.m_Blocks && node2.m_DownloadStats.m_Blocks);
+	}
+
+	void DeleteMacroblocks(const char* szPrefix, Height hMax)
+	{
+		for (Height h = 0; h <= hMax; h++)
+		{
+			Block::BodyBase::RW rw;
+			rw.m_sPath = szPrefix;
+			rw.m_sPath += "mb_" + std::to_string(h);
+			rw.Delete();
+
+			DeleteFile((rw.m_sPath + "_sync").c_str());
+		}
+	}
+
+	void TestMacroblockSync()
+	{
+		// Node0 compresses its history into a macroblock (multi-level k-way merge). Node1 bootstraps from it, the macroblock is downloaded in small chunks.
+		// Node1 is restarted during the download, and resumes it. Then it's joined by a peer that acts as an older node (no ranges), and relays Node0 via MacroblockGet.
+
+		const Rules rulesWas = Rules::get();
+		Rules::get().MaxRollbackHeight = 10;
+		Rules::get().MacroblockGranularity = 10;
+		Rules::get().UpdateChecksum();
+
+		const Height hTrg = 45;
+		DeleteMacroblocks(g_sz3, hTrg);
+		DeleteMacroblocks(g_sz4, hTrg);
+
+		{
+			io::Reactor::Ptr pReactor(io::Reactor::create());
+			io::Reactor::Scope scope(*pReactor);
+
+			Node node;
+			node.m_Cfg.m_sPathLocal = g_sz;
+			node.m_Cfg.m_Listen.port(g_Port);
+			node.m_Cfg.m_Listen.ip(INADDR_ANY);
+			node.m_Cfg.m_Sync.m_SrcPeers = 0;
+			node.m_Cfg.m_Treasury = g_Treasury;
+			node.m_Cfg.m_HistoryCompression.m_sPathOutput = g_sz3;
+			node.m_Cfg.m_HistoryCompression.m_sPathTmp = g_sz3;
+			node.m_Cfg.m_HistoryCompression.m_Naggling = 2;
+			node.m_Cfg.m_HistoryCompression.m_MergeFanIn = 3; // several merge levels
+			node.m_Cfg.m_HistoryCompression.m_UploadPortion = 200; // many requests, to interrupt the download in the middle
+
+			ECC::SetRandom(node);
+			node.Initialize();
+
+			for (Height h = 0; h < hTrg; h++)
+			{
+				TxPool::Fluff txPool; // empty, no transactions
+				NodeProcessor::BlockContext bc(txPool, 0, *node.m_Keys.m_pMiner, *node.m_Keys.m_pMiner);
+
+				verify_test(node.get_Processor().GenerateNewBlock(bc));
+
+				node.get_Processor().OnState(bc.m_Hdr, PeerID());
+
+				Block::SystemState::ID id;
+				bc.m_Hdr.get_ID(id);
+
+				node.get_Processor().OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+			}
+
+			struct LegacyPeer
+				:public TestPeer
+			{
+				// Logs in without the macroblock ranges. Relays the requests to Node0, and its responses back (in order)
+				struct Source
+					:public proto::NodeConnection
+				{
+					LegacyPeer* m_pThis;
+					Block::SystemState::Full m_Tip;
+					bool m_bTip;
+
+					virtual void OnMsg(proto::NewTip&& msg) override
+					{
+						m_Tip = msg.m_Description;
+						if (!m_bTip)
+						{
+							m_bTip = true;
+							m_pThis->ConnectTo(g_Port + 1);
+						}
+					}
+
+					virtual void OnMsg(proto::ProofChainWork&& msg) override { m_pThis->Send(msg); }
+					virtual void OnMsg(proto::Macroblock&& msg) override { m_pThis->Send(msg); }
+					virtual void OnMsg(proto::Hdr&& msg) override { m_pThis->Send(msg); }
+					virtual void OnMsg(proto::HdrPack&& msg) override { m_pThis->Send(msg); }
+					virtual void OnMsg(proto::Body&& msg) override { m_pThis->Send(msg); }
+					virtual void OnMsg(proto::DataMissing&& msg) override { m_pThis->Send(msg); }
+
+				} m_Src;
+
+				LegacyPeer()
+				{
+					m_Src.m_pThis = this;
+				}
+
+				void Start()
+				{
+					Reset();
+					m_Src.Reset();
+					m_Src.m_bTip = false;
+
+					io::Address addr;
+					addr.resolve("127.0.0.1");
+					addr.port(g_Port);
+					m_Src.Connect(addr);
+				}
+
+				virtual void OnConnectedSecure() override
+				{
+					TestPeer::OnConnectedSecure();
+					SendTip(m_Src.m_Tip);
+				}
+
+				virtual void OnDisconnect(const DisconnectReason&) override
+				{
+					m_Src.Reset(); // drop the pending responses
+				}
+
+				virtual void OnMsg(proto::GetProofChainWork&& msg) override { m_Src.Send(msg); }
+				virtual void OnMsg(proto::MacroblockGet&& msg) override { m_Src.Send(msg); }
+				virtual void OnMsg(proto::GetHdr&& msg) override { m_Src.Send(msg); }
+				virtual void OnMsg(proto::GetHdrPack&& msg) override { m_Src.Send(msg); }
+				virtual void OnMsg(proto::GetBody&& msg) override { m_Src.Send(msg); }
+			};
+
+			struct MyPoller
+			{
+				Node* m_pNode;
+				std::unique_ptr<Node> m_pNode2;
+				LegacyPeer m_Legacy;
+				Height m_hMacroblock = 0;
+				bool m_bInterrupt = true; // restart as soon as the download starts
+				uint32_t m_Deadline_ms;
+				io::Timer::Ptr m_pTimer;
+
+				// the interrupted download
+				uint64_t m_nBytes = 0;
+				uint64_t m_nBytesLegacy = 0;
+				Height m_hInterrupted = 0;
+
+				static Height get_Macroblock(Node& n)
+				{
+					NodeDB& db = n.get_Processor().get_DB();
+					NodeDB::WalkerState ws(db);
+					db.EnumMacroblocks(ws);
+					return ws.MoveNext() ? ws.m_Sid.m_Height : 0;
+				}
+
+				void StartNode2(bool bLegacy)
+				{
+					m_pNode2.reset(new Node);
+					Node& node2 = *m_pNode2;
+
+					node2.m_Cfg.m_sPathLocal = g_sz2;
+					node2.m_Cfg.m_Listen.port(g_Port + 1);
+					node2.m_Cfg.m_Listen.ip(INADDR_ANY);
+					node2.m_Cfg.m_Connect.resize(1);
+					node2.m_Cfg.m_Connect[0].resolve("127.0.0.1");
+					node2.m_Cfg.m_Connect[0].port(g_Port);
+					node2.m_Cfg.m_Treasury = g_Treasury;
+					node2.m_Cfg.m_HistoryCompression.m_sPathOutput = g_sz4;
+					node2.m_Cfg.m_HistoryCompression.m_sPathTmp = g_sz4;
+					node2.m_Cfg.m_Sync.m_Timeout_ms = 0; // sync immediately after seeing 1st peer
+					node2.m_Cfg.m_Sync.m_ChunkSize = 256;
+					node2.m_Cfg.m_Sync.m_RequestsPerPeer = 3;
+					node2.m_Cfg.m_VerificationThreads = 3; // range-partitioned macroblock verification
+
+					node2.m_Keys.SetSingleKey(m_pNode->m_Keys.m_pMiner); // same owner, the macroblock outputs are recognized by the verifier threads
+
+					node2.Initialize();
+
+					if (bLegacy)
+						m_Legacy.Start(); // connects before Node1 connects to Node0
+				}
+
+				void Start()
+				{
+					m_Deadline_ms = GetTime_ms() + 30000;
+					OnTimer();
+				}
+
+				void OnTimer()
+				{
+					uint32_t nPeriod_ms = 100;
+
+					if (!m_hMacroblock)
+					{
+						// wait for the history to be compressed
+						m_hMacroblock = get_Macroblock(*m_pNode);
+						if (m_hMacroblock)
+							StartNode2(false);
+					}
+					else
+					{
+						if (m_bInterrupt)
+						{
+							if (m_pNode2)
+							{
+								if (m_pNode2->m_DownloadStats.m_MacroblockBytes)
+								{
+									m_nBytes = m_pNode2->m_DownloadStats.m_MacroblockBytes;
+									m_nBytesLegacy = m_pNode2->m_DownloadStats.m_MacroblockBytesLegacy;
+									m_hInterrupted = m_pNode2->get_Processor().m_Cursor.m_ID.m_Height;
+									m_pNode2.reset();
+								}
+								else
+									nPeriod_ms = 1;
+							}
+							else
+							{
+								// restarted after the peers noticed the disconnect
+								StartNode2(true);
+								m_bInterrupt = false;
+							}
+						}
+						else
+							if (m_pNode2->get_Processor().m_Cursor.m_ID.m_Height == m_pNode->get_Processor().m_Cursor.m_ID.m_Height)
+							{
+								io::Reactor::get_Current().stop();
+								return;
+							}
+					}
+
+					if (int32_t(GetTime_ms() - m_Deadline_ms) > 0)
+					{
+						fail_test("Macroblock sync timeout");
+						io::Reactor::get_Current().stop();
+						return;
+					}
+
+					m_pTimer->start(nPeriod_ms, false, [this]() { OnTimer(); });
+				}
+
+			} poller;
+
+			poller.m_pNode = &node;
+			poller.m_pTimer = io::Timer::create(*pReactor);
+
+			poller.Start();
+			pReactor->run();
+
+			verify_test(poller.m_hMacroblock);
+			verify_test(poller.m_hInterrupted < hTrg); // interrupted in the middle of the download
+			verify_test(!poller.m_bInterrupt); // and restarted
+
+			Node& node2 = *poller.m_pNode2;
+			verify_test(node2.get_Processor().m_Cursor.m_ID.m_Height == hTrg);
+
+			// blocks below the macroblock were not downloaded one by one
+			verify_test(node2.m_DownloadStats.m_Blocks <= hTrg - poller.m_hMacroblock);
+
+			// the download was resumed, not restarted. Both the sources were used
+			uint64_t nSizeTotal = 0;
+			{
+				Block::BodyBase::RW rw;
+				rw.m_sPath = std::string(g_sz4) + "mb_" + std::to_string(poller.m_hMacroblock);
+
+				for (int iData = 0; iData < Block::BodyBase::RW::Type::count; iData++)
+				{
+					std::string sPath;
+					rw.GetPath(sPath, iData);
+
+					std::FStream fs;
+					if (fs.Open(sPath.c_str(), true))
+						nSizeTotal += fs.get_Remaining();
+				}
+			}
+
+			uint64_t nBytes = poller.m_nBytes;
+			uint64_t nBytesLegacy = poller.m_nBytesLegacy;
+			verify_test(nBytes && (nBytes < nSizeTotal));
+			nBytes += node2.m_DownloadStats.m_MacroblockBytes;
+			nBytesLegacy += node2.m_DownloadStats.m_MacroblockBytesLegacy;
+
+			verify_test(nBytes == nSizeTotal);
+			verify_test(nBytesLegacy && (nBytesLegacy < nBytes));
+
+			// both nodes must have recognized the same UTXOs
+			uint32_t nEvents = 0;
+			NodeDB& db2 = node2.get_Processor().get_DB();
+			NodeDB::WalkerEvent wlk2(db2);
+			for (db2.EnumEvents(wlk2, 0); wlk2.MoveNext(); nEvents++)
+			{
+				NodeDB& db = node.get_Processor().get_DB();
+				NodeDB::WalkerEvent wlk(db);
+				db.FindEvents(wlk, wlk2.m_Key);
+				verify_test(wlk.MoveNext());
+			}
+
+			uint32_t nEvents0 = 0;
+			NodeDB& db0 = node.get_Processor().get_DB();
+			NodeDB::WalkerEvent wlk0(db0);
+			for (db0.EnumEvents(wlk0, 0); wlk0.MoveNext(); )
+				nEvents0++;
+
+			verify_test(nEvents && (nEvents == nEvents0));
+		}
+
+		DeleteMacroblocks(g_sz3, hTrg);
+		DeleteMacroblocks(g_sz4, hTrg);
+
+		Rules::get() = rulesWas;
+	}
+
+	void TestCompactBlocks()
+	{
+		// Node0 relays new blocks to Node1 in the compact form. Node1 has some of the block txs in its pool, the rest is fetched via GetBodyMissing.
+		// Then a peer sends a compact block that can't be rebuilt (wrong checksum), and Node1 falls back to the full body.
+
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		Node node, node2;
+		node.m_Cfg.m_sPathLocal = g_sz;
+		node.m_Cfg.m_Listen.port(g_Port);
+		node.m_Cfg.m_Listen.ip(INADDR_ANY);
+		node.m_Cfg.m_Sync.m_SrcPeers = 0;
+		node.m_Cfg.m_Treasury = g_Treasury;
+
+		node2.m_Cfg.m_sPathLocal = g_sz2;
+		node2.m_Cfg.m_Listen.port(g_Port + 1);
+		node2.m_Cfg.m_Listen.ip(INADDR_ANY);
+		node2.m_Cfg.m_Connect.resize(1);
+		node2.m_Cfg.m_Connect[0].resolve("127.0.0.1");
+		node2.m_Cfg.m_Connect[0].port(g_Port);
+		node2.m_Cfg.m_Sync.m_SrcPeers = 0;
+		node2.m_Cfg.m_Treasury = g_Treasury;
+
+		ECC::SetRandom(node);
+		ECC::SetRandom(node2);
+
+		node.Initialize();
+		node2.Initialize();
+
+		struct MyPeer
+			:public TestPeer
+		{
+			ByteBuffer m_BodyP;
+			ByteBuffer m_BodyE;
+
+			virtual void OnMsg(proto::GetBodyCompact&& msg) override
+			{
+				// all the elements are prefilled, but the checksum doesn't match
+				Block::Body block;
+				NodeProcessor::ReadBody(block, m_BodyP, m_BodyE);
+
+				proto::BodyCompact msgOut;
+				msgOut.m_Outputs.resize(block.m_vOutputs.size());
+				msgOut.m_Kernels.resize(block.m_vKernels.size());
+				msgOut.m_Checksum = Zero;
+
+				Serializer ser;
+				ser & Cast::Down<Block::BodyBase>(block);
+				ser & Cast::Down<TxVectors::Perishable>(block);
+				ser & Cast::Down<TxVectors::Eternal>(block);
+				ser.swap_buf(msgOut.m_Prefilled);
+
+				Send(msgOut);
+			}
+
+			virtual void OnMsg(proto::GetBody&& msg) override
+			{
+				proto::Body msgOut;
+				msgOut.m_Perishable = m_BodyP;
+				msgOut.m_Eternal = m_BodyE;
+				Send(msgOut);
+			}
+		};
+
+		MyPeer peer;
+		peer.m_LoginFlags = proto::LoginFlags::CompactBlocks;
+		peer.ConnectTo(g_Port + 1);
+
+		MiniWallet wallet;
+		ECC::SetRandom(wallet.m_pKdf);
+
+		// the same history for both, until the coinbase outputs are spendable
+		for (Height h = Rules::HeightGenesis; h < Rules::HeightGenesis + Rules::get().MaturityCoinbase + 10; h++)
+		{
+			TxPool::Fluff txPool; // empty, no transactions
+			NodeProcessor::BlockContext bc(txPool, 0, *wallet.m_pKdf, *wallet.m_pKdf);
+
+			verify_test(node.get_Processor().GenerateNewBlock(bc));
+
+			Block::SystemState::ID id;
+			bc.m_Hdr.get_ID(id);
+
+			for (Node* pNode : { &node, &node2 })
+			{
+				pNode->get_Processor().OnState(bc.m_Hdr, PeerID());
+				pNode->get_Processor().OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+			}
+
+			wallet.AddMyUtxo(Key::IDV(Rules::get_Emission(h), h, Key::Type::Coinbase));
+		}
+
+		struct MyPoller
+		{
+			Node* m_pNode;
+			Node* m_pNode2;
+			MyPeer* m_pPeer;
+			MiniWallet* m_pWallet;
+			Block::SystemState::ID m_ID; // expected at Node1
+			uint32_t m_Blocks = 0;
+			uint32_t m_Deadline_ms;
+			io::Timer::Ptr m_pTimer;
+
+			void MakeBlock()
+			{
+				NodeProcessor& np = m_pNode->get_Processor();
+
+				for (uint32_t i = 0; i < 4; i++) // half of them are in the Node1 pool
+				{
+					Transaction::Ptr pTx;
+					verify_test(m_pWallet->MakeTx(pTx, np.m_Cursor.m_ID.m_Height, 0));
+
+					Transaction::Context ctx;
+					ctx.m_Height.m_Min = ctx.m_Height.m_Max = np.m_Cursor.m_Sid.m_Height + 1;
+					verify_test(pTx->IsValid(ctx));
+
+					Transaction::KeyType key;
+					pTx->get_Key(key);
+
+					if (1 & i)
+					{
+						Transaction::Ptr pTx2 = pTx;
+						m_pNode2->get_TxPool().AddValidTx(std::move(pTx2), ctx, key);
+					}
+
+					m_pNode->get_TxPool().AddValidTx(std::move(pTx), ctx, key);
+				}
+
+				NodeProcessor::BlockContext bc(m_pNode->get_TxPool(), 0, *m_pWallet->m_pKdf, *m_pWallet->m_pKdf);
+				verify_test(np.GenerateNewBlock(bc));
+
+				Block::SystemState::ID id;
+				bc.m_Hdr.get_ID(id);
+
+				m_ID = id;
+
+				if (m_Blocks)
+				{
+					// relayed by the peer instead
+					m_pPeer->m_BodyP = std::move(bc.m_BodyP);
+					m_pPeer->m_BodyE = std::move(bc.m_BodyE);
+					m_pPeer->SendTip(bc.m_Hdr);
+					return;
+				}
+
+				np.OnState(bc.m_Hdr, PeerID());
+				np.OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID()); // Node1 is notified about the new tip
+
+				verify_test(m_pNode->get_TxPool().m_setTxs.empty()); // all the txs are included
+			}
+
+			void OnTimer()
+			{
+				if (m_pNode2->get_Processor().m_Cursor.m_ID == m_ID)
+				{
+					if (2 == m_Blocks)
+					{
+						io::Reactor::get_Current().stop();
+						return;
+					}
+
+					MakeBlock();
+					m_Blocks++;
+				}
+
+				if (int32_t(GetTime_ms() - m_Deadline_ms) > 0)
+				{
+					fail_test("Compact block relay timeout");
+					io::Reactor::get_Current().stop();
+					return;
+				}
+
+				m_pTimer->start(100, false, [this]() { OnTimer(); });
+			}
+
+		} poller;
+
+		poller.m_pNode = &node;
+		poller.m_pNode2 = &node2;
+		poller.m_pPeer = &peer;
+		poller.m_pWallet = &wallet;
+		poller.m_ID = node.get_Processor().m_Cursor.m_ID;
+		poller.m_pTimer = io::Timer::create(*pReactor);
+		poller.m_Deadline_ms = GetTime_ms() + 30000;
+
+		poller.OnTimer();
+		pReactor->run();
+
+		verify_test(2 == poller.m_Blocks);
+		verify_test(node2.get_Processor().m_Cursor.m_ID == poller.m_ID);
+
+		// the 1st block was rebuilt from the pool, with the missing txs round trip. The 2nd one was downloaded in full
+		verify_test(2 == node2.m_DownloadStats.m_Blocks);
+		verify_test(1 == node2.m_DownloadStats.m_Compact);
+		verify_test(1 == node2.m_DownloadStats.m_CompactMissing);
+		verify_test(1 == node2.m_DownloadStats.m_CompactMismatch);
+
+		verify_test(node2.get_TxPool().m_setTxs.empty()); // the included txs are evicted
+	}
+
+	void TestSlowPeer()
+	{
+		// Node1 downloads the blocks from Node0 and a peer which is slow to respond. The blocks it holds are re-requested from Node0,
+		// its late responses are consumed by the duplicate tasks left in place, and its window is halved.
+
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		const Height hTrg = 20;
+
+		Node node, node2;
+		node.m_Cfg.m_sPathLocal = g_sz;
+		node.m_Cfg.m_Listen.port(g_Port);
+		node.m_Cfg.m_Listen.ip(INADDR_ANY);
+
+		node2.m_Cfg.m_sPathLocal = g_sz2;
+		node2.m_Cfg.m_Listen.port(g_Port + 1);
+		node2.m_Cfg.m_Listen.ip(INADDR_ANY);
+		node2.m_Cfg.m_Connect.resize(1);
+		node2.m_Cfg.m_Connect[0].resolve("127.0.0.1");
+		node2.m_Cfg.m_Connect[0].port(g_Port);
+		node2.m_Cfg.m_BlockDownload.m_StragglerMin_ms = 100;
+		node2.m_Cfg.m_BlockDownload.m_CheckPeriod_ms = 50;
+
+		for (Node* pNode : { &node, &node2 })
+		{
+			pNode->m_Cfg.m_Sync.m_SrcPeers = 0;
+			pNode->m_Cfg.m_Treasury = g_Treasury;
+			ECC::SetRandom(*pNode);
+		}
+
+		node.Initialize();
+
+		struct MyPeer
+			:public TestPeer
+		{
+			// holds all the blocks, but responds with the bodies late (still in order)
+			std::vector<BlockPlus::Ptr> m_vBlocks;
+			std::deque<proto::Body> m_lstBodies;
+			io::Timer::Ptr m_pTimer;
+
+			const BlockPlus* Find(const Block::SystemState::ID& id) const
+			{
+				if ((id.m_Height < Rules::HeightGenesis) || (id.m_Height >= Rules::HeightGenesis + m_vBlocks.size()))
+					return nullptr;
+
+				const BlockPlus& b = *m_vBlocks[id.m_Height - Rules::HeightGenesis];
+
+				Merkle::Hash hv;
+				b.m_Hdr.get_Hash(hv);
+				return (hv == id.m_Hash) ? &b : nullptr;
+			}
+
+			virtual void OnConnectedSecure() override
+			{
+				TestPeer::OnConnectedSecure();
+				SendTip(m_vBlocks.back()->m_Hdr);
+			}
+
+			virtual void OnMsg(proto::GetHdr&& msg) override
+			{
+				const BlockPlus* pB = Find(msg.m_ID);
+				if (!pB)
+				{
+					Send(proto::DataMissing(Zero));
+					return;
+				}
+
+				proto::Hdr msgOut;
+				msgOut.m_Description = pB->m_Hdr;
+				Send(msgOut);
+			}
+
+			virtual void OnMsg(proto::GetHdrPack&& msg) override
+			{
+				if (!Find(msg.m_Top) || !msg.m_Count)
+				{
+					Send(proto::DataMissing(Zero));
+					return;
+				}
+
+				proto::HdrPack msgOut;
+
+				Height h = msg.m_Top.m_Height;
+				for (uint32_t n = 0; ; h--)
+				{
+					msgOut.m_vElements.push_back(m_vBlocks[h - Rules::HeightGenesis]->m_Hdr);
+
+					if ((++n == msg.m_Count) || (Rules::HeightGenesis == h))
+						break;
+				}
+
+				msgOut.m_Prefix = m_vBlocks[h - Rules::HeightGenesis]->m_Hdr;
+				Send(msgOut);
+			}
+
+			virtual void OnMsg(proto::GetBody&& msg) override
+			{
+				const BlockPlus* pB = Find(msg.m_ID);
+				if (!pB)
+				{
+					Send(proto::DataMissing(Zero));
+					return;
+				}
+
+				m_lstBodies.emplace_back();
+				m_lstBodies.back().m_Perishable = pB->m_BodyP;
+				m_lstBodies.back().m_Eternal = pB->m_BodyE;
+
+				if (1 == m_lstBodies.size())
+					m_pTimer->start(1000, false, [this]() { OnTimer(); });
+			}
+
+			void OnTimer()
+			{
+				for (; !m_lstBodies.empty(); m_lstBodies.pop_front())
+					Send(m_lstBodies.front());
+			}
+		};
 
+		MyPeer peer;
+		peer.m_pTimer = io::Timer::create(*pReactor);
+
+		for (Height h = 0; h < hTrg; h++)
 		{
-			MyNodeProcessor2 np;
-			np.m_Horizon = horz;
-			np.Initialize(g_sz);
+			TxPool::Fluff txPool; // empty, no transactions
+			NodeProcessor::BlockContext bc(txPool, 0, *node.m_Keys.m_pMiner, *node.m_Keys.m_pMiner);
 
-			PeerID peer;
-			ZeroObject(peer);
+			verify_test(node.get_Processor().GenerateNewBlock(bc));
 
-			for (size_t i = 1; i < blockChain.size(); i += 2)
-				np.OnState(blockChain[i]->m_Hdr, peer);
+			Block::SystemState::ID id;
+			bc.m_Hdr.get_ID(id);
+
+			node.get_Processor().OnState(bc.m_Hdr, PeerID());
+			node.get_Processor().OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+
+			peer.m_vBlocks.emplace_back(new BlockPlus);
+			BlockPlus& b = *peer.m_vBlocks.back();
+			b.m_Hdr = bc.m_Hdr;
+			b.m_BodyP = std::move(bc.m_BodyP);
+			b.m_BodyE = std::move(bc.m_BodyE);
 		}
 
-		{
-			MyNodeProcessor2 np;
-			np.m_Horizon = horz;
-			np.Initialize(g_sz);
+		node2.Initialize();
+		peer.ConnectTo(g_Port + 1);
 
-			PeerID peer;
-			ZeroObject(peer);
+		struct MyPoller
+		{
+			Node* m_pNode2;
+			Height m_hTrg;
+			uint32_t m_Deadline_ms;
+			io::Timer::Ptr m_pTimer;
 
-			for (size_t i = 0; i < nMid; i++)
+			void OnTimer()
 			{
-				Block::SystemState::ID id;
-				blockChain[i]->m_Hdr.get_ID(id);
-				np.OnBlock(id, blockChain[i]->m_BodyP, blockChain[i]->m_BodyE, peer);
-			}
-		}
+				const Node::DownloadStats& ds = m_pNode2->m_DownloadStats;
 
-		{
-			MyNodeProcessor2 np;
-			np.m_Horizon = horz;
-			np.Initialize(g_sz);
+				// wait for the late responses as well: all the blocks, and the re-requested ones once again from the slow peer
+				if ((m_pNode2->get_Processor().m_Cursor.m_ID.m_Height == m_hTrg) && (ds.m_Blocks == m_hTrg + ds.m_Stragglers))
+				{
+					io::Reactor::get_Current().stop();
+					return;
+				}
 
-			PeerID peer;
-			ZeroObject(peer);
+				if (int32_t(GetTime_ms() - m_Deadline_ms) > 0)
+				{
+					fail_test("Slow peer download timeout");
+					io::Reactor::get_Current().stop();
+					return;
+				}
 
-			for (size_t i = nMid; i < blockChain.size(); i++)
-			{
-				Block::SystemState::ID id;
-				blockChain[i]->m_Hdr.get_ID(id);
-				np.OnBlock(id, blockChain[i]->m_BodyP, blockChain[i]->m_BodyE, peer);
+				m_pTimer->start(100, false, [this]() { OnTimer(); });
 			}
-		}
 
-		{
-			MyNodeProcessor2 np;
-			np.m_Horizon = horz;
-			np.Initialize(g_sz, true); // reset cursor
-		}
+		} poller;
 
-	}
+		poller.m_pNode2 = &node2;
+		poller.m_hTrg = hTrg;
+		poller.m_pTimer = io::Timer::create(*pReactor);
+		poller.m_Deadline_ms = GetTime_ms() + 30000;
 
-	const uint16_t g_Port = 25003; // don't use the default port to prevent collisions with running nodes, beacons and etc.
+		poller.OnTimer();
+		pReactor->run();
 
-	void TestNodeConversation()
+		verify_test(node2.get_Processor().m_Cursor.m_ID == node.get_Processor().m_Cursor.m_ID);
+
+		// the blocks re-requested from the fast peer, each time the slow one had its window halved
+		verify_test(node2.m_DownloadStats.m_Stragglers);
+		verify_test(node2.m_DownloadStats.m_Blocks == hTrg + node2.m_DownloadStats.m_Stragglers);
+	}
+
+	void TestTxInvBatches()
 	{
-		// Testing configuration: Node0 <-> Node1 <-> Client.
+		// Node1 receives the txs of Node0 via the batched inventory. First from the pool dump on login, then announced as they arrive from a client.
+		// There are more of them than fit into a single batch, both the announcements and the requests are split.
 
 		io::Reactor::Ptr pReactor(io::Reactor::create());
 		io::Reactor::Scope scope(*pReactor);
@@ -996,115 +2156,308 @@ namespace beam
 		node.m_Cfg.m_Sync.m_SrcPeers = 0;
 		node.m_Cfg.m_Treasury = g_Treasury;
 
-		node.m_Cfg.m_Timeout.m_GetBlock_ms = 1000 * 60;
-		node.m_Cfg.m_Timeout.m_GetState_ms = 1000 * 60;
-
 		node2.m_Cfg.m_sPathLocal = g_sz2;
-		node2.m_Cfg.m_Listen.port(g_Port + 1);
-		node2.m_Cfg.m_Listen.ip(INADDR_ANY);
-		node2.m_Cfg.m_Timeout = node.m_Cfg.m_Timeout;
+		node2.m_Cfg.m_Connect.resize(1);
+		node2.m_Cfg.m_Connect[0].resolve("127.0.0.1");
+		node2.m_Cfg.m_Connect[0].port(g_Port);
 		node2.m_Cfg.m_Sync.m_SrcPeers = 0;
 		node2.m_Cfg.m_Treasury = g_Treasury;
 
-		node2.m_Cfg.m_BeaconPort = g_Port;
-
 		ECC::SetRandom(node);
 		ECC::SetRandom(node2);
 
 		node.Initialize();
 		node2.Initialize();
 
-		struct MyClient
-			:public proto::NodeConnection
+		MiniWallet wallet;
+		ECC::SetRandom(wallet.m_pKdf);
+
+		const uint32_t nTxsLogin = 10;
+		const uint32_t nTxsLive = proto::g_TxInvMaxSize + 1;
+		const uint32_t nTxs = nTxsLogin + nTxsLive;
+
+		// the same history for both, until a coinbase output is spendable. Then it's split, to fund the txs
+		for (Height h = Rules::HeightGenesis; ; h++)
 		{
-			Node* m_ppNode[2];
-			unsigned int m_iNode;
-			unsigned int m_WaitingCycles;
+			TxPool::Fluff txPool;
 
-			Height m_HeightMax;
-			const Height m_HeightTrg = 70;
+			Transaction::Ptr pTx;
+			Amount val = wallet.MakeTxInput(pTx, h - 1);
+			if (val)
+			{
+				ECC::Scalar::Native kOffset = pTx->m_Offset;
 
-			MyClient()
+				MiniWallet::MyUtxo utxo;
+				utxo.m_Kidv.m_Value = val / nTxs;
+				utxo.m_Kidv.m_SubIdx = 0;
+				utxo.m_Kidv.m_Type = Key::Type::Regular;
+
+				for (uint32_t i = 0; i < nTxs; i++)
+				{
+					utxo.m_Kidv.m_Idx = ++wallet.m_nRunningIndex;
+					wallet.ToOutput(utxo, *pTx, kOffset, 0);
+					wallet.m_MyUtxos.insert(std::make_pair(h, utxo));
+				}
+
+				MiniWallet::MyKernel mk;
+				mk.m_Fee = val - utxo.m_Kidv.m_Value * nTxs;
+				mk.m_bUseHashlock = false;
+				wallet.m_pKdf->DeriveKey(mk.m_k, Key::ID(++wallet.m_nRunningIndex, Key::Type::Kernel));
+
+				TxKernel::Ptr pKrn;
+				mk.Export(pKrn);
+				pTx->m_vKernels.push_back(std::move(pKrn));
+
+				ECC::Scalar::Native k = -mk.m_k;
+				kOffset += k;
+				pTx->m_Offset = kOffset;
+				pTx->Normalize();
+
+				Transaction::Context ctx;
+				ctx.m_Height.m_Min = ctx.m_Height.m_Max = h;
+				verify_test(pTx->IsValid(ctx));
+
+				Transaction::KeyType key;
+				pTx->get_Key(key);
+				txPool.AddValidTx(std::move(pTx), ctx, key);
+			}
+
+			NodeProcessor::BlockContext bc(txPool, 0, *wallet.m_pKdf, *wallet.m_pKdf);
+			verify_test(node.get_Processor().GenerateNewBlock(bc));
+
+			Block::SystemState::ID id;
+			bc.m_Hdr.get_ID(id);
+
+			for (Node* pNode : { &node, &node2 })
 			{
-				m_pTimer = io::Timer::create(io::Reactor::get_Current());
+				pNode->get_Processor().OnState(bc.m_Hdr, PeerID());
+				pNode->get_Processor().OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
 			}
 
-			virtual void OnConnectedSecure() override {
-				OnTimer();
+			if (val)
+				break;
+
+			wallet.AddMyUtxo(Key::IDV(Rules::get_Emission(h), h, Key::Type::Coinbase));
+		}
+
+		std::vector<Transaction::Ptr> vTxs;
+		Height h = node.get_Processor().m_Cursor.m_ID.m_Height;
+
+		for (uint32_t i = 0; i < nTxs; i++)
+		{
+			Transaction::Ptr pTx;
+			verify_test(wallet.MakeTx(pTx, h, 0));
+
+			Transaction::Context ctx;
+			ctx.m_Height.m_Min = ctx.m_Height.m_Max = h + 1;
+			verify_test(pTx->IsValid(ctx));
+
+			if (i < nTxsLogin)
+			{
+				Transaction::KeyType key;
+				pTx->get_Key(key);
+				node.get_TxPool().AddValidTx(std::move(pTx), ctx, key); // announced on login
+			}
+			else
+				vTxs.push_back(std::move(pTx));
+		}
+
+		struct MyClient
+			:public proto::NodeConnection
+		{
+			std::vector<Transaction::Ptr>* m_pTxs;
+
+			virtual void OnConnectedSecure() override
+			{
+				for (size_t i = 0; i < m_pTxs->size(); i++)
+				{
+					proto::NewTransaction msg;
+					msg.m_Transaction = (*m_pTxs)[i];
+					msg.m_Fluff = true;
+					Send(msg);
+				}
 			}
 
 			virtual void OnDisconnect(const DisconnectReason&) override {
 				fail_test("OnDisconnect");
 			}
+		};
 
+		struct MyPoller
+		{
+			Node* m_pNode;
+			Node* m_pNode2;
+			MyClient* m_pClient;
+			uint32_t m_nTxs;
+			bool m_bLive = false;
+			uint32_t m_Deadline_ms;
 			io::Timer::Ptr m_pTimer;
 
-			void OnTimer() {
+			void OnTimer()
+			{
+				size_t nTxs = m_pNode2->get_TxPool().m_setTxs.size();
 
+				if (!m_bLive && (nTxs == m_pNode->get_TxPool().m_setTxs.size()))
+				{
+					// the pool dump is received, Node1 is connected. Now the txs announced one by one
+					io::Address addr;
+					addr.resolve("127.0.0.1");
+					addr.port(g_Port);
 
-				if (m_HeightMax < m_HeightTrg)
+					m_pClient->Connect(addr);
+					m_bLive = true;
+				}
+
+				if (nTxs == m_nTxs)
 				{
-					Node& n = *m_ppNode[m_iNode];
+					io::Reactor::get_Current().stop();
+					return;
+				}
 
-					TxPool::Fluff txPool; // empty, no transactions
-					NodeProcessor::BlockContext bc(txPool, 0, *n.m_Keys.m_pMiner, *n.m_Keys.m_pMiner);
+				if (int32_t(GetTime_ms() - m_Deadline_ms) > 0)
+				{
+					fail_test("Tx inventory timeout");
+					io::Reactor::get_Current().stop();
+					return;
+				}
 
-					verify_test(n.get_Processor().GenerateNewBlock(bc));
+				m_pTimer->start(100, false, [this]() { OnTimer(); });
+			}
 
-					n.get_Processor().OnState(bc.m_Hdr, PeerID());
+		} poller;
 
-					Block::SystemState::ID id;
-					bc.m_Hdr.get_ID(id);
+		MyClient cl;
+		cl.m_pTxs = &vTxs;
 
-					n.get_Processor().OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+		poller.m_pNode = &node;
+		poller.m_pNode2 = &node2;
+		poller.m_pClient = &cl;
+		poller.m_nTxs = nTxs;
+		poller.m_pTimer = io::Timer::create(*pReactor);
+		poller.m_Deadline_ms = GetTime_ms() + 60000;
 
-					m_HeightMax = std::max(m_HeightMax, bc.m_Hdr.m_Height);
+		poller.OnTimer();
+		pReactor->run();
 
-					printf("Mined block Height = %u, node = %u \n", (unsigned int) bc.m_Hdr.m_Height, (unsigned int)m_iNode);
+		verify_test(poller.m_bLive);
+		verify_test(node.get_TxPool().m_setTxs.size() == nTxs);
+		verify_test(node2.get_TxPool().m_setTxs.size() == nTxs);
+	}
 
-					++m_iNode %= _countof(m_ppNode);
-				}
-				else
-					if (m_WaitingCycles++ > 60)
-					{
-						fail_test("Blockchain height didn't reach target");
-						io::Reactor::get_Current().stop();
-					}
+	void TestHdrPackPoW()
+	{
+		// A peer announces a tip, and responds to the header pack request with a pack in which one header PoW is corrupted.
+		// The whole pack must be rejected, including the valid header below the invalid one, and the peer is dropped.
 
-				SetTimer(100);
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		Node node;
+		node.m_Cfg.m_sPathLocal = g_sz;
+		node.m_Cfg.m_Listen.port(g_Port);
+		node.m_Cfg.m_Listen.ip(INADDR_ANY);
+		node.m_Cfg.m_Sync.m_SrcPeers = 0;
+		node.m_Cfg.m_Treasury = g_Treasury;
+		node.m_Cfg.m_VerificationThreads = 3; // PoW verified in parallel
+
+		ECC::SetRandom(node);
+		node.Initialize();
+
+		// The lowest header of the pack, with the real PoW solution. FakePoW is off while the pack is verified
+		Block::SystemState::Full s0;
+		s0.m_Height = 8;
+		s0.m_Prev = 1U;
+		s0.m_ChainWork = 100U;
+		s0.m_Kernels = 2U;
+		s0.m_Definition = 3U;
+		s0.m_TimeStamp = 1540000000;
+		s0.m_PoW.m_Difficulty.m_Packed = 0;
+		s0.m_PoW.m_Nonce = Zero;
+
+		static const uint8_t pIndices[] = {
+			0x01, 0x06, 0x03, 0xb5, 0xb7, 0x1a, 0x05, 0x17, 0xb6, 0x49, 0xb7, 0xa8, 0x93, 0xd2, 0xae, 0x83,
+			0xfa, 0x64, 0x25, 0x66, 0x62, 0x76, 0xd4, 0x8a, 0xe9, 0x22, 0xb4, 0x26, 0xec, 0xcb, 0x2b, 0xf7,
+			0x07, 0xc8, 0x5c, 0x4a, 0x5f, 0xb3, 0xd5, 0x97, 0x05, 0x30, 0x69, 0x3e, 0xd4, 0xa1, 0x11, 0xc2,
+			0x82, 0x98, 0x10, 0xf9, 0x6b, 0xf2, 0x9d, 0xf2, 0xe7, 0x0d, 0x27, 0x3e, 0x4b, 0x15, 0xe4, 0x9b,
+			0xa1, 0x0f, 0x5f, 0x22, 0x1e, 0x95, 0x30, 0xeb, 0xa1, 0x8e, 0xf1, 0x44, 0x08, 0x3e, 0x28, 0x1a,
+			0xeb, 0xd5, 0x8c, 0xd4, 0xff, 0x0e, 0x76, 0xf5, 0xf7, 0x92, 0x27, 0x3e, 0x72, 0xfd, 0xf4, 0x7a,
+			0x01, 0xf3, 0x51, 0xdc
+		};
+
+		static_assert(sizeof(pIndices) == Block::PoW::nSolutionBytes, "");
+		memcpy(&s0.m_PoW.m_Indices.front(), pIndices, sizeof(pIndices));
+
+		// the next one, with the corrupted solution, and the announced tip on top of it
+		Block::SystemState::Full s1 = s0;
+		s1.NextPrefix();
+		s1.m_ChainWork += s1.m_PoW.m_Difficulty;
+		s1.m_TimeStamp++;
+		s1.m_PoW.m_Indices[5] ^= 1;
+
+		Block::SystemState::Full sTip = s1;
+		sTip.NextPrefix();
+		sTip.m_ChainWork += sTip.m_PoW.m_Difficulty;
+		sTip.m_TimeStamp++;
+
+		struct MyPeer
+			:public TestPeer
+		{
+			Block::SystemState::Full m_pS[3];
+			bool m_bPackSent = false;
+			bool m_bDropped = false;
+
+			virtual void OnConnectedSecure() override
+			{
+				TestPeer::OnConnectedSecure();
+				SendTip(m_pS[2]);
 			}
 
-			virtual void OnMsg(proto::NewTip&& msg) override
+			virtual void OnMsg(proto::GetHdrPack&& msg) override
 			{
-				printf("Tip Height=%u\n", (unsigned int) msg.m_Description.m_Height);
-				verify_test(msg.m_Description.m_Height <= m_HeightMax);
-				if (msg.m_Description.m_Height == m_HeightTrg)
-					io::Reactor::get_Current().stop();
+				proto::HdrPack msgOut;
+				msgOut.m_Prefix = m_pS[0];
+				msgOut.m_vElements.push_back(m_pS[1]); // from the top
+				msgOut.m_vElements.push_back(m_pS[0]);
+
+				Rules::get().FakePoW = false;
+				m_bPackSent = true;
+				Send(msgOut);
 			}
 
-			void SetTimer(uint32_t timeout_ms) {
-				m_pTimer->start(timeout_ms, false, [this]() { return (this->OnTimer)(); });
+			virtual void OnDisconnect(const DisconnectReason&) override
+			{
+				m_bDropped = true;
+				io::Reactor::get_Current().stop();
 			}
 		};
 
-		MyClient cl;
-		cl.m_iNode = 0;
-		cl.m_HeightMax = 0;
-		cl.m_WaitingCycles = 0;
-		cl.m_ppNode[0] = &node;
-		cl.m_ppNode[1] = &node2;
-
-		io::Address addr;
-		addr.resolve("127.0.0.1");
-		addr.port(g_Port + 1);
-
-		cl.Connect(addr);
+		MyPeer peer;
+		peer.m_pS[0] = s0;
+		peer.m_pS[1] = s1;
+		peer.m_pS[2] = sTip;
+		peer.ConnectTo(g_Port);
 
+		io::Timer::Ptr pTimer = io::Timer::create(*pReactor);
+		pTimer->start(30000, false, []() {
+			fail_test("Header pack timeout");
+			io::Reactor::get_Current().stop();
+		});
 
 		pReactor->run();
-	}
 
+		verify_test(s0.IsValidPoW() && !s1.IsValidPoW());
+		Rules::get().FakePoW = true;
 
+		verify_test(peer.m_bPackSent && peer.m_bDropped);
+
+		NodeDB& db = node.get_Processor().get_DB();
+		for (const Block::SystemState::Full* pS : { &s0, &s1, &sTip })
+		{
+			Block::SystemState::ID id;
+			pS->get_ID(id);
+			verify_test(!db.StateFindSafe(id) == (pS != &sTip)); // only the announced tip is known
+		}
+	}
 
 	void TestNodeClientProto()
 	{
@@ -1625,9 +2978,23 @@ namespace beam
 
 		NodeProcessor::UtxoRecoverEx urec(node2.get_Processor());
 		urec.m_vKeys.push_back(node.m_Keys.m_pMiner);
-		urec.Proceed();
+		verify_test(urec.Proceed());
 
 		verify_test(!urec.m_Map.empty());
+
+		// parallel recovery must yield the same result
+		NodeProcessor::UtxoRecoverEx urec2(node2.get_Processor());
+		urec2.m_vKeys.push_back(node.m_Keys.m_pMiner);
+		urec2.m_nThreads = 3;
+		verify_test(urec2.Proceed());
+
+		verify_test(urec.m_Map.size() == urec2.m_Map.size());
+		for (NodeProcessor::UtxoRecoverEx::UtxoMap::const_iterator it = urec.m_Map.begin(), it2 = urec2.m_Map.begin(); urec.m_Map.end() != it; it++, it2++)
+		{
+			verify_test(it->first == it2->first);
+			verify_test(it->second.m_Count == it2->second.m_Count);
+			verify_test(it->second.m_Kidv == it2->second.m_Kidv);
+		}
 	}
 
 
@@ -1667,6 +3034,14 @@ namespace beam
 			cwp2.m_LowerBound = cc.m_vStates[cc.m_vStates.size() - nStates].m_Hdr.m_ChainWork;
 			verify_test(cwp2.Crop(cwp));
 
+			// trusted crop must give the same
+			Block::ChainWorkProof cwp3;
+			cwp3.m_LowerBound = cwp2.m_LowerBound;
+			verify_test(cwp3.Crop(cwp, false));
+			verify_test(cwp3.m_vArbitraryStates.size() == cwp2.m_vArbitraryStates.size());
+			verify_test(cwp3.m_Heading.m_vElements.size() == cwp2.m_Heading.m_vElements.size());
+			verify_test(cwp3.m_Proof.m_vData == cwp2.m_Proof.m_vData);
+
 			cwp.m_LowerBound = cwp2.m_LowerBound;
 			verify_test(cwp.Crop());
 
@@ -1968,6 +3343,40 @@ int main()
 	beam::DeleteFile(beam::g_sz);
 	beam::DeleteFile(beam::g_sz2);
 
+	printf("Node <---> Node macroblock sync test...\n");
+	fflush(stdout);
+
+	beam::TestMacroblockSync();
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+
+	printf("Node <---> Node compact block relay test...\n");
+	fflush(stdout);
+
+	beam::TestCompactBlocks();
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+
+	printf("Node <---> Node slow peer test...\n");
+	fflush(stdout);
+
+	beam::TestSlowPeer();
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+
+	printf("Node <---> Node tx inventory test...\n");
+	fflush(stdout);
+
+	beam::TestTxInvBatches();
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+
+	printf("Node <---> Node header pack PoW test...\n");
+	fflush(stdout);
+
+	beam::TestHdrPackPoW();
+	beam::DeleteFile(beam::g_sz);
+
 	printf("Node <---> FlyClient test...\n");
 	fflush(stdout);
 
@@ -15,6 +15,7 @@
 #include "core/block_crypt.h"
 #include <iostream>
 #include "3rdparty/crypto/equihash.h"
+#include "3rdparty/crypto/blake/blake2b-multi.h"
 #include "wallet/unittests/test_helpers.h"
 #include <algorithm>
 
@@ -89,9 +90,97 @@ void TestArrayExpanding()
     TestArrayExpanding(96, 5);
 }
 
+void TestMultiLaneHash(bool bSimd)
+{
+    cout << "Test multi-lane hash, simd=" << bSimd << "...\n";
+    blake2b_multi_simd_enable(bSimd);
+
+    typedef Equihash<beam::Block::PoW::N, beam::Block::PoW::K> Eh;
+    const size_t nHash = Eh::HashOutput;
+    const size_t nCount = 11; // not a multiple of the lane count
+
+    // vary the absorbed prefix, so that the index either fits the pending block or spills into the next one
+    for (size_t nPrefix = 0; nPrefix <= 260; nPrefix += (nPrefix % 128 > 118) ? 1 : 29)
+    {
+        Eh eh;
+        eh_HashState state;
+        eh.InitialiseState(state);
+        vector<uint8_t> vPrefix(nPrefix);
+        for (size_t i = 0; i < nPrefix; i++)
+            vPrefix[i] = uint8_t(i * 7 + 3);
+        blake2b_update(&state, vPrefix.data(), vPrefix.size());
+
+        vector<eh_index> vG(nCount);
+        for (size_t i = 0; i < nCount; i++)
+            vG[i] = eh_index(i * 0x01010101 + nPrefix);
+
+        vector<uint8_t> vMulti(nCount * nHash);
+        GenerateHashes(state, vG.data(), nCount, vMulti.data(), nHash, beam::Block::PoW::N);
+
+        vector<uint8_t> vOne(nHash);
+        for (size_t i = 0; i < nCount; i++)
+        {
+            GenerateHash(state, vG[i], vOne.data(), nHash, beam::Block::PoW::N);
+            WALLET_CHECK(equal(vOne.begin(), vOne.end(), vMulti.begin() + i * nHash));
+        }
+    }
+
+    blake2b_multi_simd_enable(true);
+}
+
+void BenchMultiLaneHash()
+{
+    typedef Equihash<beam::Block::PoW::N, beam::Block::PoW::K> Eh;
+    const size_t nHash = Eh::HashOutput;
+    const eh_index nCount = 1U << 18;
+    const eh_index nBatch = 64;
+
+    Eh eh;
+    eh_HashState state;
+    eh.InitialiseState(state);
+    uint8_t pInput[] = { 1, 2, 3, 4, 56 };
+    blake2b_update(&state, pInput, sizeof(pInput));
+
+    vector<uint8_t> vHash(nBatch * nHash);
+    uint8_t nSum = 0;
+
+    uint32_t t0 = beam::GetTime_ms();
+    for (eh_index g = 0; g < nCount; g++)
+    {
+        GenerateHash(state, g, vHash.data(), nHash, beam::Block::PoW::N);
+        nSum ^= vHash[0];
+    }
+    uint32_t dtScalar = beam::GetTime_ms() - t0;
+
+    eh_index pG[nBatch];
+    for (int iSimd = 0; iSimd < 2; iSimd++)
+    {
+        blake2b_multi_simd_enable(iSimd);
+        bool bActive = !!blake2b_multi_simd_active();
+
+        t0 = beam::GetTime_ms();
+        for (eh_index g0 = 0; g0 < nCount; g0 += nBatch)
+        {
+            for (eh_index j = 0; j < nBatch; j++)
+                pG[j] = g0 + j;
+            GenerateHashes(state, pG, nBatch, vHash.data(), nHash, beam::Block::PoW::N);
+            nSum ^= vHash[0];
+        }
+        uint32_t dt = beam::GetTime_ms() - t0;
+
+        cout << "Blake2b x" << nCount << ": single=" << dtScalar << " ms, lanes=" << BLAKE2B_MULTI_LANES << " simd=" << bActive << ": " << dt << " ms\n";
+    }
+
+    blake2b_multi_simd_enable(true);
+    cout << "(checksum " << unsigned(nSum) << ")\n";
+}
+
 int main()
 {
     TestArrayExpanding();
+    TestMultiLaneHash(false);
+    TestMultiLaneHash(true);
+    BenchMultiLaneHash();
     
     {
         cout << "Test PoW...\n";
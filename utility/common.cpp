@@ -151,6 +151,36 @@ namespace std
 		return true;
 	}
 
+	bool FStream::OpenUpdate(const char* sz, bool bStrict /* = false */)
+	{
+		m_Remaining = 0;
+
+#ifdef WIN32
+		std::wstring sPathArg = beam::Utf8toUtf16(sz);
+#else // WIN32
+		const char* sPathArg = sz;
+#endif // WIN32
+
+		const ios_base::openmode mode = ios_base::binary | ios_base::in | ios_base::out;
+
+		m_F.open(sPathArg, mode);
+		if (m_F.fail())
+		{
+			// in+out doesn't create the file
+			m_F.clear();
+			m_F.open(sPathArg, mode | ios_base::trunc);
+
+			if (m_F.fail())
+			{
+				if (bStrict)
+					ThrowLastError();
+				return false;
+			}
+		}
+
+		return true;
+	}
+
 	void FStream::Close()
 	{
 		if (m_F.is_open())
@@ -173,6 +203,12 @@ namespace std
 		m_Remaining -= m_F.tellg();
 	}
 
+	void FStream::SeekWrite(uint64_t n)
+	{
+		m_F.seekp(n);
+		TestNoError(m_F);
+	}
+
 	void FStream::NotImpl()
 	{
 		throw runtime_error("not impl");
@@ -214,12 +214,14 @@ namespace std
 	public:
 		FStream();
 		bool Open(const char*, bool bRead, bool bStrict = false, bool bAppend = false); // strict - throw exc if error
+		bool OpenUpdate(const char*, bool bStrict = false); // read-write, the file is created if missing. Doesn't truncate
 		bool IsOpen() const { return m_F.is_open(); }
 		void Close();
 		uint64_t get_Remaining() const { return m_Remaining; }
 
 		void Restart(); // for read-stream - jump to the beginning of the file
 		void Seek(uint64_t);
+		void SeekWrite(uint64_t); // the following write goes to this position. The file is extended if necessary
 		uint64_t Tell() { return m_F.tellg(); }
 
 		// read/write always return the size requested. Exception is thrown if underflow or error
@@ -15,6 +15,7 @@
 #include "coarsetimer.h"
 #include "utility/helpers.h"
 #include <assert.h>
+#include <string.h>
 
 #ifndef LOG_VERBOSE_ENABLED
     #define LOG_VERBOSE_ENABLED 0
@@ -37,6 +38,7 @@ CoarseTimer::CoarseTimer(unsigned resolutionMsec, const Callback& cb, Timer::Ptr
     _callback(cb),
     _timer(std::move(timer))
 {
+    memset(_wheel, 0, sizeof(_wheel));
     auto result = _timer->start(unsigned(-1), false, BIND_THIS_MEMFN(on_timer));
     if (!result) IO_EXCEPTION(result.error());
 }
@@ -50,19 +52,36 @@ static inline uint64_t mono_clock() {
 }
 
 Result CoarseTimer::set_timer(unsigned intervalMsec, ID id) {
-    if (_validIds.count(id)) {
+    if (_entries.count(id)) {
         LOG_DEBUG() << "coarse timer: existing id " << std::hex << id << std::dec;
         return make_unexpected(EC_EINVAL);
     }
     if (intervalMsec > 0 && intervalMsec < unsigned(-1) - _resolution) {
-        // if 0 then callback will fire on next event loop cycle, otherwise adjust to coarse resolution
+        // if 0 then callback will fire on next coarse tick, otherwise adjust to coarse resolution
         intervalMsec -= ((intervalMsec + _resolution) % _resolution);
     }
     Clock now = mono_clock();
+    if (_entries.empty() && !_insideCallback) {
+        // wheel is idle, nothing to catch up with
+        _currentTick = now / _resolution;
+    }
+
     Clock clock = now + intervalMsec;
-    _queue.insert({ clock, id });
-    _validIds.insert({ id, clock });
+    Tick expires = (clock + _resolution - 1) / _resolution;
+    if (expires <= _currentTick) {
+        expires = _currentTick + 1;
+    } else if (expires - _currentTick >= (Tick(1) << (WHEEL_BITS * WHEEL_LEVELS))) {
+        expires = _currentTick + (Tick(1) << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    }
+
+    Entry& e = _entries[id];
+    e.id = id;
+    e.expires = expires;
+    place(e);
+
+    clock = expires * _resolution;
     if (!_insideCallback && _timerSetTo > clock) {
+        intervalMsec = (clock > now) ? unsigned(clock - now) : 0;
         LOG_VERBOSE() << TRACE(intervalMsec);
         _timerSetTo = clock;
         return _timer->restart(intervalMsec, false);
@@ -71,62 +90,146 @@ Result CoarseTimer::set_timer(unsigned intervalMsec, ID id) {
 }
 
 void CoarseTimer::cancel(ID id) {
-    _validIds.erase(id);
-    if (_validIds.empty()) cancel_all();
+    auto it = _entries.find(id);
+    if (it == _entries.end()) return;
+    unlink(it->second);
+    _entries.erase(it);
+    if (_entries.empty()) cancel_all();
 }
 
 void CoarseTimer::cancel_all() {
-    _validIds.clear();
-    _queue.clear();
+    if (!_entries.empty()) {
+        _entries.clear();
+        memset(_wheel, 0, sizeof(_wheel));
+    }
+    _expiring = nullptr;
     if (_timerSetTo != NEVER) {
-        _timer->cancel();
+        // the one-shot timer is rescheduled by on_timer() if called from inside
+        if (!_insideCallback) {
+            _timer->cancel();
+            // Timer::cancel() resets the callback
+            _timer->start(unsigned(-1), false, BIND_THIS_MEMFN(on_timer));
+        }
         _timerSetTo = NEVER;
     }
 }
 
-// uv timers inaccurate intervals
-static constexpr unsigned TIMER_ACCURACY = 10;
-
-void CoarseTimer::on_timer() {
-    LOG_VERBOSE() << TRACE(_queue.size());
+void CoarseTimer::place(Entry& e) {
+    assert(e.expires >= _currentTick);
+    Tick delta = e.expires - _currentTick;
+    unsigned level = 0;
+    while (level + 1 < WHEEL_LEVELS && delta >= (Tick(1) << (WHEEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    Entry*& head = _wheel[level][(e.expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    e.next = head;
+    if (head) head->pprev = &e.next;
+    head = &e;
+    e.pprev = &head;
+}
 
-    if (_queue.empty()) return;
-    Clock now = mono_clock();
+void CoarseTimer::unlink(Entry& e) {
+    *e.pprev = e.next;
+    if (e.next) e.next->pprev = e.pprev;
+}
 
-    _insideCallback = true;
+CoarseTimer::Entry* CoarseTimer::detach(Entry*& head) {
+    // slots are filled at front, reversing restores the order of set_timer() calls
+    Entry* list = nullptr;
+    while (head) {
+        Entry* e = head;
+        head = e->next;
+        e->next = list;
+        if (list) list->pprev = &e->next;
+        list = e;
+    }
+    return list;
+}
 
-    Clock clock = 0;
+void CoarseTimer::cascade(unsigned level, unsigned idx) {
+    Entry* list = detach(_wheel[level][idx]);
+    while (list) {
+        Entry* e = list;
+        list = e->next;
+        place(*e);
+    }
+}
 
-    while (!_queue.empty()) {
-        auto it = _queue.begin();
+void CoarseTimer::advance(Tick target) {
+    while (_currentTick < target && !_entries.empty()) {
+        Tick t = ++_currentTick;
+        unsigned idx = t & WHEEL_MASK;
+        if (!idx) {
+            for (unsigned level = 1; level < WHEEL_LEVELS; ++level) {
+                unsigned i = (t >> (WHEEL_BITS * level)) & WHEEL_MASK;
+                cascade(level, i);
+                if (i) break;
+            }
+        }
 
-        clock = it->first;
+        // detached slot is accessible to cancel() and cancel_all() from inside callbacks
+        _expiring = detach(_wheel[0][idx]);
+        if (!_expiring) continue;
+        _expiring->pprev = &_expiring;
 
-        LOG_VERBOSE() << TRACE(now) << TRACE(clock) << TRACE(_timerSetTo);
+        while (_expiring) {
+            Entry& e = *_expiring;
+            unlink(e);
+            ID id = e.id;
+            _entries.erase(id);
 
-        if (clock > now + TIMER_ACCURACY) break;
-        ID id = it->second;
+            LOG_VERBOSE() << TRACE(id);
+            _callback(id);
+        }
+    }
 
-        LOG_VERBOSE() << TRACE(id);
+    if (_currentTick < target) _currentTick = target;
+}
 
-        // this helps calling set_timer(), cancel(), cancel_all() from inside callbacks
-        _queue.erase(it);
+CoarseTimer::Tick CoarseTimer::next_wake() const {
+    // level 0 holds everything that expires within WHEEL_SIZE ticks
+    Tick wrap = (_currentTick | WHEEL_MASK) + 1;
+    for (Tick t = _currentTick + 1; t < wrap; ++t) {
+        if (_wheel[0][t & WHEEL_MASK]) return t;
+    }
 
-        auto v = _validIds.find(id);
-        if (v != _validIds.end()) {
-            if (v->second == clock) {
-                _validIds.erase(v);
-                _callback(id);
-            }
+    Tick nearest = NEVER;
+    for (Tick t = wrap; t <= _currentTick + WHEEL_MASK; ++t) {
+        if (_wheel[0][t & WHEEL_MASK]) {
+            nearest = t;
+            break;
         }
     }
 
+    // skip cascade points with nothing to move down
+    for (Tick t = wrap; t < nearest; t += WHEEL_SIZE) {
+        unsigned idx = (t >> WHEEL_BITS) & WHEEL_MASK;
+        if (!idx || _wheel[1][idx]) return t;
+    }
+
+    return nearest;
+}
+
+// uv timers inaccurate intervals
+static constexpr unsigned TIMER_ACCURACY = 10;
+
+void CoarseTimer::on_timer() {
+    LOG_VERBOSE() << TRACE(_entries.size());
+
+    if (_entries.empty()) return;
+    Clock now = mono_clock();
+
+    _insideCallback = true;
+
+    advance((now + TIMER_ACCURACY) / _resolution);
+
     _insideCallback = false;
 
-    if (_queue.empty()) {
-        cancel_all();
+    if (_entries.empty()) {
+        _timerSetTo = NEVER;
     } else {
         now = mono_clock();
+        Clock clock = next_wake() * _resolution;
         unsigned intervalMsec = 0;
         if (clock > now) intervalMsec = unsigned(clock - now);
         LOG_VERBOSE() << TRACE(intervalMsec);
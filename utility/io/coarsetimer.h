@@ -14,13 +14,14 @@
 
 #pragma once
 #include "timer.h"
-#include <map>
-#include <vector>
+#include <unordered_map>
 #include <limits>
 
 namespace beam { namespace io {
 
-/// Coarse timer helper, for connect/reconnect timers
+/// Coarse timer helper, for connect/reconnect timers.
+/// Deadlines are kept in a hierarchical timing wheel (4 levels of 256 slots, one tick == resolution),
+/// so set_timer(), cancel() and expiration are O(1) regardless of the number of active timers
 class CoarseTimer {
 public:
     using ID = uint64_t;
@@ -51,6 +52,40 @@ private:
     using Clock = uint64_t;
     static constexpr Clock NEVER = std::numeric_limits<Clock>::max();
 
+    /// abs. time in resolution units
+    using Tick = uint64_t;
+
+    static constexpr unsigned WHEEL_BITS = 8;
+    static constexpr unsigned WHEEL_SIZE = 1 << WHEEL_BITS;
+    static constexpr unsigned WHEEL_MASK = WHEEL_SIZE - 1;
+    static constexpr unsigned WHEEL_LEVELS = 4;
+
+    /// Wheel slot entry, intrusive list node
+    struct Entry {
+        ID id;
+        Tick expires;
+        Entry* next;
+        Entry** pprev;
+    };
+
+    /// Puts entry into the slot according to its expiration tick
+    void place(Entry& e);
+
+    /// Removes entry from its slot
+    static void unlink(Entry& e);
+
+    /// Empties the slot, returns its entries in insertion order
+    static Entry* detach(Entry*& head);
+
+    /// Moves entries of the higher level slot down the wheel
+    void cascade(unsigned level, unsigned idx);
+
+    /// Fires callbacks for all ticks up to target (inclusive)
+    void advance(Tick target);
+
+    /// Next tick worth waking up at: the nearest non-empty slot of level 0 or the next cascade
+    Tick next_wake() const;
+
     /// Flag that prevents from updating timer too often
     bool _insideCallback=false;
 
@@ -60,11 +95,17 @@ private:
     /// External callback
     Callback _callback;
 
-    /// Timers queue
-    std::multimap<Clock, ID> _queue;
+    /// Active entries by id
+    std::unordered_map<ID, Entry> _entries;
+
+    /// Timing wheel slots
+    Entry* _wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+    /// Slot being expired, detached from the wheel while callbacks run
+    Entry* _expiring=nullptr;
 
-    /// Valid Ids
-    std::map<ID, Clock> _validIds;
+    /// Last processed tick
+    Tick _currentTick=0;
 
     /// Next time to wake
     Clock _timerSetTo=NEVER;
@@ -90,7 +131,7 @@ public:
 private:
     void on_timer(CoarseTimer::ID id);
 
-    std::map<CoarseTimer::ID, Timer::Callback> _timerCallbacks;
+    std::unordered_map<CoarseTimer::ID, Timer::Callback> _timerCallbacks;
     io::CoarseTimer::Ptr _timer;
 };
 
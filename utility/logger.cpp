@@ -34,6 +34,10 @@
 #include <iostream>
 #include <fstream>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <vector>
 #include <algorithm>
 
 namespace beam {
@@ -42,9 +46,155 @@ using namespace std;
 
 Logger* Logger::g_logger = 0;
 
+namespace {
+
+/// Single producer single consumer byte ring, one per logging thread.
+/// Record: [record size][message size][header][message], 8-byte aligned, zero record size means wrap
+class LogRing {
+public:
+    explicit LogRing(size_t capacity) :
+        _buf(capacity),
+        _mask(capacity - 1)
+    {
+        assert(capacity >= 4096 && (capacity & (capacity - 1)) == 0);
+    }
+
+    /// Producer side, false if there is no room. Messages longer than half of the ring are truncated
+    bool try_push(const LogMessageHeader& header, const char* msg, size_t size) {
+        size_t maxSize = _buf.size() / 2 - OVERHEAD;
+        bool truncated = (size > maxSize);
+        if (truncated) size = maxSize;
+
+        uint64_t need = (OVERHEAD + size + 7) & ~uint64_t(7);
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        size_t offset = head & _mask;
+        uint64_t skip = (_buf.size() - offset < need) ? _buf.size() - offset : 0;
+
+        if (head + skip + need - _tail.load(std::memory_order_acquire) > _buf.size()) return false;
+
+        if (skip) {
+            uint64_t wrap = 0;
+            memcpy(&_buf[offset], &wrap, sizeof(wrap));
+            head += skip;
+            offset = 0;
+        }
+
+        uint64_t msgSize = size;
+        char* p = &_buf[offset];
+        memcpy(p, &need, sizeof(need));
+        memcpy(p + 8, &msgSize, sizeof(msgSize));
+        memcpy(p + 16, &header, sizeof(header));
+        memcpy(p + OVERHEAD, msg, size);
+        if (truncated) p[OVERHEAD + size - 1] = '\n';
+
+        _head.store(head + need, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side, passes the oldest message to func
+    template <class Func> bool pop(Func&& func) {
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            if (tail == _head.load(std::memory_order_acquire)) return false;
+
+            size_t offset = tail & _mask;
+            uint64_t recordSize = 0;
+            memcpy(&recordSize, &_buf[offset], sizeof(recordSize));
+            if (!recordSize) {
+                tail += _buf.size() - offset;
+                _tail.store(tail, std::memory_order_release);
+                continue;
+            }
+
+            uint64_t msgSize = 0;
+            memcpy(&msgSize, &_buf[offset + 8], sizeof(msgSize));
+            const LogMessageHeader* header = reinterpret_cast<const LogMessageHeader*>(&_buf[offset + 16]);
+            func(*header, &_buf[offset + OVERHEAD], size_t(msgSize));
+
+            _tail.store(tail + recordSize, std::memory_order_release);
+            return true;
+        }
+    }
+
+    bool empty() const {
+        return _tail.load(std::memory_order_relaxed) == _head.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t OVERHEAD = 16 + ((sizeof(LogMessageHeader) + 7) & ~size_t(7));
+
+    std::vector<char> _buf;
+    const size_t _mask;
+
+    alignas(64) std::atomic<uint64_t> _head{0};
+    alignas(64) std::atomic<uint64_t> _tail{0};
+};
+
+/// Ring of the current thread, a new one is registered when another writer starts
+struct AsyncThreadContext {
+    uint64_t writerId=0;
+    std::shared_ptr<LogRing> ring;
+};
+
+std::atomic<uint64_t> g_nextWriterId{0};
+
+} //namespace
+
+class LoggerImpl;
+
+/// Background thread that formats and writes messages queued by logging threads
+class AsyncLogWriter {
+public:
+    AsyncLogWriter(LoggerImpl& target, size_t ringSize, bool blockOnOverflow);
+
+    /// Drains all rings and stops the thread
+    ~AsyncLogWriter();
+
+    /// Called from logging threads
+    void push(const LogMessageHeader& header, const char* buf, size_t size);
+
+    /// Rotation is performed by the background thread
+    void request_rotate();
+
+    uint64_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    void thread_func();
+    bool drain_all();
+    LogRing* get_ring();
+    void wake();
+
+    // idle wait, also bounds the latency of a missed wake-up
+    static constexpr unsigned IDLE_WAIT_MSEC = 20;
+
+    // per ring per pass, for fairness between threads
+    static constexpr unsigned MAX_BATCH = 64;
+
+    LoggerImpl& _target;
+    const size_t _ringSize;
+    const bool _blockOnOverflow;
+    const uint64_t _id;
+
+    mutex _ringsMutex;
+    std::vector<std::shared_ptr<LogRing>> _rings;
+
+    mutex _waitMutex;
+    condition_variable _cv;
+    std::atomic<bool> _sleeping{false};
+    std::atomic<bool> _stop{false};
+    std::atomic<bool> _rotate{false};
+
+    std::atomic<uint64_t> _dropped{0};
+    uint64_t _droppedReported=0;
+
+    std::thread _thread;
+};
+
 class LoggerImpl : public Logger {
-    mutex _mutex;
 protected:
+    mutex _mutex;
     static const size_t MAX_HEADER_SIZE = 256;
     static const size_t MAX_TIMESTAMP_SIZE = 80;
 
@@ -87,6 +237,38 @@ protected:
     }
 
     void write_message(const LogMessageHeader& header, const char* buf, size_t size) override {
+        if (_async) {
+            _async->push(header, buf, size);
+        } else {
+            write_formatted(header, buf, size);
+        }
+    }
+
+    void rotate() override {
+        if (_async) {
+            _async->request_rotate();
+        } else {
+            do_rotate();
+        }
+    }
+
+    void enable_async(size_t ringSize, bool blockOnOverflow) override {
+        if (!_async) _async = std::make_unique<AsyncLogWriter>(*this, ringSize, blockOnOverflow);
+    }
+
+    uint64_t get_dropped_count() const override {
+        return _async ? _async->dropped() : 0;
+    }
+
+    std::unique_ptr<AsyncLogWriter> _async;
+
+public:
+    bool level_accepted(int level) override {
+        return level >= _minLevel;
+    }
+
+    /// Formats header and writes the message to sink(s), called from the logging thread or the async writer
+    virtual void write_formatted(const LogMessageHeader& header, const char* buf, size_t size) {
         char timestampFormatted[MAX_TIMESTAMP_SIZE];
         char headerFormatted[MAX_HEADER_SIZE];
         if (!_timeFormat.empty()) {
@@ -98,9 +280,19 @@ protected:
         write_impl(header.level, headerFormatted, headerSize, buf, size);
     }
 
-public:
-    bool level_accepted(int level) override {
-        return level >= _minLevel;
+    /// Does the actual rotation, called from rotate() or the async writer
+    virtual void do_rotate() {}
+
+    virtual void flush() {
+        if (!_sink) return;
+        lock_guard<mutex> lock(_mutex);
+        fflush(_sink);
+    }
+
+    /// Stops async writer while the object is still complete
+    static void destroy(LoggerImpl* logger) {
+        logger->_async.reset();
+        delete logger;
     }
 
     void write_impl(int level, const char* header, size_t headerSize, const char* msg, size_t size) {
@@ -117,9 +309,6 @@ public:
     ConsoleLogger(int flushLevel, int consoleLevel) :
         LoggerImpl(stdout, consoleLevel, flushLevel)
     {}
-
-    // does nothing for console
-    void rotate() override {}
 };
 
 class FileLogger : public LoggerImpl {
@@ -132,7 +321,7 @@ public:
         open_new_file();
     }
 
-    void rotate() override {
+    void do_rotate() override {
         try {
             open_new_file();
         } catch (const std::exception& e) {
@@ -149,6 +338,8 @@ private:
         fileName += format_timestamp("%y_%m_%d_%H_%M_%S", local_timestamp_msec(), false);
         fileName += ".log";
 
+        FILE* sink = 0;
+
         if (!_dstPath.empty())
         {
 #ifdef WIN32
@@ -164,21 +355,25 @@ private:
 
             path /= fileName;
 #ifdef WIN32
-            _sink = _wfsopen(path.wstring().c_str(), L"ab", _SH_DENYNO);
+            sink = _wfsopen(path.wstring().c_str(), L"ab", _SH_DENYNO);
 #else
-            _sink = fopen(path.string().c_str(), "ab");
+            sink = fopen(path.string().c_str(), "ab");
 #endif
         }
         else
         {
 #ifdef WIN32
-            _sink = _wfsopen(Utf8toUtf16(fileName.c_str()).c_str(), L"ab", _SH_DENYNO);
+            sink = _wfsopen(Utf8toUtf16(fileName.c_str()).c_str(), L"ab", _SH_DENYNO);
 #else
-            _sink = fopen(fileName.c_str(), "ab");
+            sink = fopen(fileName.c_str(), "ab");
 #endif
         }
 
-        if (!_sink) throw runtime_error(string("cannot open file ") + fileName);
+        if (!sink) throw runtime_error(string("cannot open file ") + fileName);
+
+        lock_guard<mutex> lock(_mutex);
+        if (_sink) fclose(_sink);
+        _sink = sink;
     }
 
     std::string _fileNamePrefix;
@@ -196,7 +391,7 @@ public:
         _consoleSink(flushLevel, consoleLevel)
     {}
 
-    void write_message(const LogMessageHeader& header, const char* buf, size_t size) override {
+    void write_formatted(const LogMessageHeader& header, const char* buf, size_t size) override {
         char timestampFormatted[MAX_TIMESTAMP_SIZE];
         char headerFormatted[MAX_HEADER_SIZE];
         if (!_timeFormat.empty()) {
@@ -213,11 +408,123 @@ public:
         }
     }
 
-    void rotate() override {
-        _fileSink.rotate();
+    void do_rotate() override {
+        _fileSink.do_rotate();
+    }
+
+    void flush() override {
+        _consoleSink.flush();
+        _fileSink.flush();
     }
 };
 
+AsyncLogWriter::AsyncLogWriter(LoggerImpl& target, size_t ringSize, bool blockOnOverflow) :
+    _target(target),
+    _ringSize(ringSize),
+    _blockOnOverflow(blockOnOverflow),
+    _id(++g_nextWriterId)
+{
+    if (ringSize < 4096 || (ringSize & (ringSize - 1))) throw runtime_error("logger: ring size must be a power of 2, at least 4096");
+    _thread = std::thread(&AsyncLogWriter::thread_func, this);
+}
+
+AsyncLogWriter::~AsyncLogWriter() {
+    _stop.store(true);
+    wake();
+    _thread.join();
+}
+
+LogRing* AsyncLogWriter::get_ring() {
+    static thread_local AsyncThreadContext ctx;
+    if (ctx.writerId != _id) {
+        ctx.ring = std::make_shared<LogRing>(_ringSize);
+        ctx.writerId = _id;
+        lock_guard<mutex> lock(_ringsMutex);
+        _rings.push_back(ctx.ring);
+    }
+    return ctx.ring.get();
+}
+
+void AsyncLogWriter::push(const LogMessageHeader& header, const char* buf, size_t size) {
+    LogRing* ring = get_ring();
+    while (!ring->try_push(header, buf, size)) {
+        if (!_blockOnOverflow || _stop.load(std::memory_order_relaxed)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wake();
+        std::this_thread::yield();
+    }
+    if (_sleeping.load(std::memory_order_acquire)) wake();
+}
+
+void AsyncLogWriter::request_rotate() {
+    _rotate.store(true);
+    wake();
+}
+
+void AsyncLogWriter::wake() {
+    _cv.notify_one();
+}
+
+bool AsyncLogWriter::drain_all() {
+    bool any = false;
+    {
+        lock_guard<mutex> lock(_ringsMutex);
+        for (auto it = _rings.begin(); it != _rings.end(); ) {
+            LogRing& ring = **it;
+            for (unsigned i = 0; i < MAX_BATCH; ++i) {
+                if (!ring.pop([this](const LogMessageHeader& header, const char* buf, size_t size) {
+                    _target.write_formatted(header, buf, size);
+                })) {
+                    break;
+                }
+                any = true;
+            }
+            // logging thread has exited
+            if (it->use_count() == 1 && ring.empty()) {
+                it = _rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+    if (dropped != _droppedReported) {
+        char buf[80];
+        int size = snprintf(buf, sizeof(buf), "logger: %llu messages dropped\n", (unsigned long long)(dropped - _droppedReported));
+        _droppedReported = dropped;
+        _target.write_formatted(LogMessageHeader(LOG_LEVEL_WARNING, 0, 0, 0), buf, size_t(size));
+    }
+
+    return any;
+}
+
+void AsyncLogWriter::thread_func() {
+    for (;;) {
+        bool any = drain_all();
+
+        if (_rotate.exchange(false)) {
+            _target.do_rotate();
+        }
+
+        if (any) continue;
+
+        if (_stop.load()) break;
+
+        _target.flush();
+
+        unique_lock<mutex> lock(_waitMutex);
+        _sleeping.store(true);
+        _cv.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MSEC));
+        _sleeping.store(false);
+    }
+
+    while (drain_all()) {}
+    _target.flush();
+}
+
 std::shared_ptr<Logger> Logger::create(
     int flushLevel,
     int consoleLevel,
@@ -238,13 +545,13 @@ std::shared_ptr<Logger> Logger::create(
 
     switch (what) {
         case 3:
-            logger.reset(new CombinedLogger(flushLevel, consoleLevel, fileLevel, fileNamePrefix, dstPath));
+            logger.reset(new CombinedLogger(flushLevel, consoleLevel, fileLevel, fileNamePrefix, dstPath), LoggerImpl::destroy);
             break;
         case 2:
-            logger.reset(new FileLogger(flushLevel, fileLevel, fileNamePrefix, dstPath));
+            logger.reset(new FileLogger(flushLevel, fileLevel, fileNamePrefix, dstPath), LoggerImpl::destroy);
             break;
         case 1:
-            logger.reset(new ConsoleLogger(flushLevel, consoleLevel));
+            logger.reset(new ConsoleLogger(flushLevel, consoleLevel), LoggerImpl::destroy);
             break;
         default:
             throw runtime_error("no logger sink configured");
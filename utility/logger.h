@@ -16,6 +16,7 @@
 #include <iostream>
 #include <memory>
 #include <type_traits>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
@@ -157,6 +158,14 @@ public:
     /// Rotates file name, called externally
     virtual void rotate() = 0;
 
+    /// Moves timestamp/header formatting, writing, flushing and rotation to a background thread.
+    /// Completed messages are copied into per-thread lock-free rings of ringSize bytes,
+    /// on overflow the message is dropped (and counted) or, if blockOnOverflow, the caller waits
+    virtual void enable_async(size_t ringSize = 1 << 20, bool blockOnOverflow = false) = 0;
+
+    /// Number of messages dropped due to ring overflow in async mode
+    virtual uint64_t get_dropped_count() const = 0;
+
     static bool will_log(int level) {
         return g_logger && g_logger->level_accepted(level);
     }
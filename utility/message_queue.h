@@ -16,6 +16,10 @@
 #include "io/asyncevent.h"
 #include <mutex>
 #include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <stdint.h>
 #include <assert.h>
 
 namespace beam {
@@ -23,7 +27,7 @@ namespace beam {
 /// Inter-thread message queue, backend for RX and TX sides (see below)
 /// Current impl (may be changed if performance bottleneck detected):
 /// 1) unlimited size - should be controlled by channel sides explicitly;
-/// 2) std::deque and std::mutex inside
+/// 2) std::deque and std::mutex inside, receiver takes all pending messages at once
 /// Message type (class T) requirement: default constructible + callable *or* movable (see send() functions)
 template <class T> class MessageQueue {
 public:
@@ -58,6 +62,21 @@ public:
         return true;
     }
 
+    /// Called from receiver thread via RX object, passes all pending messages to func with one lock
+    template <class Func> size_t drain(Func&& func) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_queue.empty()) return 0;
+            _batch.swap(_queue);
+        }
+        size_t n = _batch.size();
+        for (T& message : _batch) {
+            func(std::move(message));
+        }
+        _batch.clear();
+        return n;
+    }
+
     /// Called by RX to indicate that the channel is being closed
     void close_rx() {
         std::lock_guard<std::mutex> lock(_mutex);
@@ -70,12 +89,119 @@ private:
 
     std::deque<T> _queue;
 
+    /// Receiver side buffer, accessed from receiver thread only
+    std::deque<T> _batch;
+
     bool _rxClosed=false;
     // TODO consider atomic flag
 };
 
+/// Bounded lock-free inter-thread message queue, drop-in alternative to MessageQueue
+/// Multiple producers, single consumer (RX thread), ring buffer of Capacity cells with per-cell sequence numbers.
+/// Senders yield while the ring is full, so Capacity should exceed the expected burst size
+template <class T, size_t Capacity = 65536> class BoundedMessageQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of 2");
+
+public:
+    BoundedMessageQueue() : _cells(new Cell[Capacity]) {
+        for (size_t i=0; i<Capacity; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMessageQueue(const BoundedMessageQueue&) = delete;
+    BoundedMessageQueue& operator=(const BoundedMessageQueue&) = delete;
+
+    /// Called from sender thread via TX object
+    bool send(const T& message) {
+        T copy(message);
+        return send(std::move(copy));
+    }
+
+    /// Called from sender thread via TX object
+    bool send(T&& message) {
+        for (;;) {
+            if (_rxClosed.load(std::memory_order_acquire)) return false;
+            if (try_send(message)) return true;
+            std::this_thread::yield();
+        }
+    }
+
+    /// Called from sender thread, false if the ring is full
+    bool try_send(T& message) {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell = 0;
+        for (;;) {
+            cell = &_cells[pos & MASK];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(message);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// May be called by both TX and RX, approximate
+    size_t current_size() {
+        size_t enq = _enqueuePos.load(std::memory_order_relaxed);
+        size_t deq = _dequeuePos.load(std::memory_order_relaxed);
+        return (enq > deq) ? enq - deq : 0;
+    }
+
+    /// Called from receiver thread via RX object
+    bool receive(T& message) {
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        Cell& cell = _cells[pos & MASK];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+        message = std::move(cell.data);
+        cell.data = T();
+        cell.sequence.store(pos + Capacity, std::memory_order_release);
+        _dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /// Called from receiver thread via RX object, passes all ready messages to func
+    template <class Func> size_t drain(Func&& func) {
+        size_t n = 0;
+        T message;
+        while (receive(message)) {
+            func(std::move(message));
+            ++n;
+        }
+        return n;
+    }
+
+    /// Called by RX to indicate that the channel is being closed
+    void close_rx() {
+        _rxClosed.store(true, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+
+    /// Separate cache lines for producers and consumer
+    alignas(64) std::atomic<size_t> _enqueuePos{0};
+    alignas(64) std::atomic<size_t> _dequeuePos{0};
+
+    std::atomic<bool> _rxClosed{false};
+};
+
 /// Transmitter side of inter-thread channel
-template <class T> class TX {
+template <class T, class Queue = MessageQueue<T>> class TX {
 public:
 
     bool send(const T& message) {
@@ -87,33 +213,34 @@ public:
     }
 
     size_t queue_size() {
-        return _queue.current_size();
+        return _queue->current_size();
     }
 
 private:
-    template <class> friend class RX; // friend because RX creates TX-es
+    template <class, class> friend class RX; // friend because RX creates TX-es
 
     /// Ctor called by RX, see friendship
-    TX(const std::shared_ptr<MessageQueue<T>>& queue, const io::AsyncEvent::Ptr& asyncEvent) :
+    TX(const std::shared_ptr<Queue>& queue, const io::AsyncEvent::Ptr& asyncEvent) :
         _queue(queue), _asyncEvent(asyncEvent)
     {}
 
     /// Queue
-    std::shared_ptr<MessageQueue<T>> _queue;
+    std::shared_ptr<Queue> _queue;
 
     /// io::Reactor event that can be called from another thread
     io::AsyncEvent::Trigger _asyncEvent;
 };
 
 /// Receiver side of inter=thread channel
-template <class T> class RX {
+/// Queue is either MessageQueue<T> (unbounded) or BoundedMessageQueue<T, N> (lock-free)
+template <class T, class Queue = MessageQueue<T>> class RX {
 public:
     /// Message callback, called from reactor thread
     using Callback = std::function<void(T&& message)>;
 
     /// Ctor called by receiver side
     explicit RX(io::Reactor& reactor, Callback&& callback) :
-        _queue(std::make_shared<MessageQueue<T>>()),
+        _queue(std::make_shared<Queue>()),
         _asyncEvent(io::AsyncEvent::create(reactor, [this]() { on_receive(); } )),
         _callback(std::move(callback))
     {
@@ -127,12 +254,12 @@ public:
     }
 
     /// RX creates TXes
-    TX<T> get_tx() {
-        return TX<T>(_queue, _asyncEvent);
+    TX<T, Queue> get_tx() {
+        return TX<T, Queue>(_queue, _asyncEvent);
     }
 
     size_t queue_size() {
-        return _queue.current_size();
+        return _queue->current_size();
     }
 
     void close() {
@@ -141,17 +268,13 @@ public:
 
 private:
     void on_receive() {
-        while (_queue->receive(_msg)) {
-            _callback(std::move(_msg));
-        }
+        // one wake-up processes everything queued so far
+        _queue->drain(_callback);
     }
 
-    std::shared_ptr<MessageQueue<T>> _queue;
+    std::shared_ptr<Queue> _queue;
     io::AsyncEvent::Ptr _asyncEvent;
     Callback _callback;
-
-    /// Message must be default-constructible
-    T _msg;
 };
 
 } //namespace
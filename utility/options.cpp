@@ -75,6 +75,7 @@ namespace beam
         const char* RECEIVE = "receive";
         const char* LOG_LEVEL = "log_level";
         const char* FILE_LOG_LEVEL = "file_log_level";
+        const char* LOG_ASYNC = "log_async";
         const char* LOG_INFO = "info";
         const char* LOG_DEBUG = "debug";
         const char* LOG_VERBOSE = "verbose";
@@ -138,6 +139,7 @@ namespace beam
 			(cli::KEY_OWNER, po::value<string>(), "Owner viewer key")
 			(cli::KEY_MINE, po::value<string>(), "Standalone miner key")
 			(cli::PASS, po::value<string>(), "password for keys")
+			(cli::LOG_ASYNC, po::value<bool>()->default_value(false), "format and write log messages on a background thread")
 			;
 
         po::options_description wallet_options("Wallet options");
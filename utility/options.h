@@ -74,6 +74,7 @@ namespace beam
         extern const char* RECEIVE;
         extern const char* LOG_LEVEL;
         extern const char* FILE_LOG_LEVEL;
+        extern const char* LOG_ASYNC;
         extern const char* LOG_INFO;
         extern const char* LOG_DEBUG;
         extern const char* LOG_VERBOSE;
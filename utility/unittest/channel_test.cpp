@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "utility/message_queue.h"
+#include "utility/test_helpers.h"
 #include <future>
 #include <iostream>
 #include <assert.h>
@@ -47,8 +48,8 @@ struct SomeAsyncObject {
     void wait() { f.get(); }
 };
 
-struct RXThread : SomeAsyncObject {
-    RX<Message> rx;
+template <class Queue = MessageQueue<Message>> struct RXThread : SomeAsyncObject {
+    RX<Message, Queue> rx;
     std::vector<int> received;
 
     RXThread() :
@@ -69,9 +70,9 @@ struct RXThread : SomeAsyncObject {
     {}
 };
 
-void simplex_channel_test() {
-    RXThread remote;
-    TX<Message> tx = remote.rx.get_tx();
+template <class Queue = MessageQueue<Message>> void simplex_channel_test() {
+    RXThread<Queue> remote;
+    TX<Message, Queue> tx = remote.rx.get_tx();
     std::vector<int> sent;
 
     remote.run();
@@ -88,7 +89,48 @@ void simplex_channel_test() {
     assert(remote.received == sent);
 }
 
+template <class Queue> void channel_throughput_test(const char* name) {
+    static const int PRODUCERS = 4;
+    static const int MESSAGES = 250000;
+
+    io::Reactor::Ptr reactor = io::Reactor::create();
+    int received = 0;
+    RX<int, Queue> rx(
+        *reactor,
+        [&reactor, &received](int&&) {
+            if (++received == PRODUCERS * MESSAGES) reactor->stop();
+        }
+    );
+
+    helpers::StopWatch sw;
+    sw.start();
+
+    std::vector<std::future<void>> producers;
+    for (int i=0; i<PRODUCERS; ++i) {
+        TX<int, Queue> tx = rx.get_tx();
+        producers.push_back(std::async(
+            std::launch::async,
+            [tx]() mutable {
+                for (int j=1; j<=MESSAGES; ++j) {
+                    tx.send(j);
+                }
+            }
+        ));
+    }
+
+    reactor->run();
+    for (auto& f : producers) f.get();
+    sw.stop();
+
+    assert(received == PRODUCERS * MESSAGES);
+    cout << name << ": " << PRODUCERS << " producers x " << MESSAGES << " messages in " << sw.milliseconds() << " msec, "
+        << uint64_t(double(received) / sw.seconds()) << " msg/sec" << endl;
+}
+
 int main() {
     simplex_channel_test();
+    simplex_channel_test<BoundedMessageQueue<Message, 1024>>();
+    channel_throughput_test<MessageQueue<int>>("mutex queue");
+    channel_throughput_test<BoundedMessageQueue<int>>("lock-free ring");
 }
 
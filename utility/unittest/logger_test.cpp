@@ -15,6 +15,7 @@
 #include "utility/logger_checkpoints.h"
 #include "utility/helpers.h"
 #include <thread>
+#include <vector>
 #include "wallet/secstring.h"
 
 using namespace beam;
@@ -80,6 +81,27 @@ void test_ndc_2(bool exc)
     }
 }
 
+void test_logger_async(bool blockOnOverflow) {
+    auto logger = Logger::create(LOG_LEVEL_CRITICAL, LOG_LEVEL_DEBUG);
+    logger->set_header_formatter(custom_header_formatter);
+    logger->enable_async(4096, blockOnOverflow);
+
+    std::vector<std::thread> threads;
+    for (int i=0; i<4; ++i) {
+        threads.emplace_back([i] {
+            XXX xxx;
+            for (int j=0; j<1000; ++j) {
+                LOG_INFO() << "thread " << i << " message " << j << " " << xxx;
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    LOG_WARNING() << "dropped: " << logger->get_dropped_count();
+    if (blockOnOverflow && logger->get_dropped_count() != 0) throw std::runtime_error("messages dropped in blocking mode");
+    logger->rotate();
+}
+
 void test_read_password() {
     SecString buf;
     read_password("Enter seed: ", buf);
@@ -93,6 +115,8 @@ int main() {
     test_logger_1();
     test_ndc_1();
     test_ndc_2(false);
+    test_logger_async(false);
+    test_logger_async(true);
     try {
         test_ndc_2(true);
     }
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "utility/io/coarsetimer.h"
+#include "utility/test_helpers.h"
 #include <set>
 
 #ifndef LOG_VERBOSE_ENABLED
@@ -99,6 +100,49 @@ void coarsetimer_test() {
     LOG_DEBUG() << "Stopping";
 }
 
+void coarsetimer_benchmark() {
+    // 100k active connection timers, as on a busy stratum or explorer server
+    static const unsigned N = 100000;
+
+    reactor = Reactor::create();
+    unsigned fired = 0;
+    MultipleTimers timers(*reactor, 100);
+    helpers::StopWatch sw;
+
+    sw.start();
+    for (unsigned i=0; i<N; ++i) {
+        timers.set_timer(i, 30000 + (i % 30000), [] {});
+    }
+    sw.stop();
+    LOG_INFO() << "set " << N << " timers: " << sw.microseconds() << " usec";
+
+    // connection activity: each timer is rearmed
+    sw.start();
+    for (unsigned i=0; i<N; ++i) {
+        timers.set_timer(i, 60000 - (i % 30000), [] {});
+    }
+    sw.stop();
+    LOG_INFO() << "reset " << N << " timers: " << sw.microseconds() << " usec";
+
+    sw.start();
+    for (unsigned i=0; i<N; ++i) {
+        timers.cancel(i);
+    }
+    sw.stop();
+    LOG_INFO() << "cancel " << N << " timers: " << sw.microseconds() << " usec";
+
+    for (unsigned i=0; i<N; ++i) {
+        timers.set_timer(i, 100 + (i % 1000), [&fired] {
+            if (++fired == N) reactor->stop();
+        });
+    }
+    sw.start();
+    reactor->run();
+    sw.stop();
+    LOG_INFO() << "expired " << fired << " timers in " << sw.milliseconds() << " msec";
+    assert(fired == N);
+}
+
 int main() {
     int logLevel = LOG_LEVEL_DEBUG;
 #if LOG_VERBOSE_ENABLED
@@ -107,5 +151,6 @@ int main() {
     auto logger = Logger::create(logLevel, logLevel);
     timer_test();
     coarsetimer_test();
+    coarsetimer_benchmark();
 }
 